@@ -14,7 +14,23 @@
 #ifndef PAT_STDPSRAM_H
 #define PAT_STDPSRAM_H
 
+#if defined(ARDUINO)
 #include <Arduino.h>
+// Console output used by the diagnostics in the stdpsram headers
+#define STDPSRAM_PRINTF(...) Serial.printf(__VA_ARGS__)
+#else
+// Host build (unit experiments, benchmarks): PSRAM and internal SRAM are both plain heap memory
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+#define MALLOC_CAP_8BIT (1 << 2)
+inline void *ps_malloc(size_t size) { return std::malloc(size); }
+inline void *heap_caps_malloc(size_t size, uint32_t) { return std::malloc(size); }
+#define STDPSRAM_PRINTF(...) std::printf(__VA_ARGS__)
+#endif
+#include <functional>
 #include <iostream>
 #include <vector>
 #include <list>
@@ -23,6 +39,14 @@
 #include <tuple>
 #include <memory>
 
+// Build with -DSTDPSRAM_INSTRUMENT to count accesses per container (see PAT_stdpsram_instrument.h)
+#if defined(STDPSRAM_INSTRUMENT)
+#include "PAT_stdpsram_instrument.h"
+#define STDPSRAM_TAG(container, name) stdpsram::tag(container, name)
+#else
+#define STDPSRAM_TAG(container, name) ((void)0)
+#endif
+
 ///////////////////////////////////////////////////
 // PSRAMAllocator: Custom allocator for PSRAM memory
 // This allocator uses ps_malloc and free for memory allocation
@@ -102,6 +126,93 @@ public:
         using other = PSRAMAllocator<U>;
     };
 };
+
+// Stateless allocator: any two instances can free each other's memory
+template <typename T, typename U>
+bool operator==(const PSRAMAllocator<T> &, const PSRAMAllocator<U> &) noexcept
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const PSRAMAllocator<T> &, const PSRAMAllocator<U> &) noexcept
+{
+    return false;
+}
+///////////////////////////////////////////////////
+// SRAMAllocator: Custom allocator for internal SRAM
+// Counterpart of PSRAMAllocator for data that has to stay in fast internal
+// memory (hot data, staging buffers). Uses heap_caps_malloc with MALLOC_CAP_INTERNAL.
+template <typename T>
+class SRAMAllocator
+{
+public:
+    using value_type = T;
+
+    // Default constructor
+    SRAMAllocator() noexcept = default;
+
+    // Copy constructor for different types
+    template <typename U>
+    SRAMAllocator(const SRAMAllocator<U> &) noexcept {}
+
+    // Allocate memory for n objects of type T
+    T *allocate(std::size_t n)
+    {
+        if (n > std::size_t(-1) / sizeof(T))
+        {
+            throw std::bad_alloc();
+        }
+        T *ptr = static_cast<T *>(heap_caps_malloc(n * sizeof(T), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+        if (!ptr)
+        {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    //--------------------------------
+    // Deallocate memory for a single object of type T
+    void deallocate(T *ptr, std::size_t) noexcept
+    {
+        if (ptr)
+        {
+            free(ptr);
+        }
+    }
+
+    // Construct an object of type T at ptr with value
+    void construct(T *ptr, const T &value)
+    {
+        new (ptr) T(value);
+    }
+
+    // Destroy an object of type T at ptr
+    void destroy(T *ptr) noexcept
+    {
+        ptr->~T();
+    }
+
+    // Rebind allocator to another type
+    template <typename U>
+    struct rebind
+    {
+        using other = SRAMAllocator<U>;
+    };
+};
+
+// Stateless allocator: any two instances can free each other's memory
+template <typename T, typename U>
+bool operator==(const SRAMAllocator<T> &, const SRAMAllocator<U> &) noexcept
+{
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const SRAMAllocator<T> &, const SRAMAllocator<U> &) noexcept
+{
+    return false;
+}
 ///////////////////////////////////////////////////
 // Wrapper for creating objects in external PSRAM
 template <typename T>
@@ -251,6 +362,17 @@ public:
 // Namespace stdpsram: Defines containers using PSRAMAllocator
 namespace stdpsram
 {
+#if defined(STDPSRAM_INSTRUMENT)
+    //------------------------------------------------
+    // Instrumented containers: same PSRAM storage, with access counting
+    template <typename T>
+    using vector = instrumented<std::vector<T, PSRAMAllocator<T>>>;
+    template <typename T>
+    using list = instrumented<std::list<T, PSRAMAllocator<T>>>;
+    template <typename Key, typename Value>
+    using map = instrumented<std::map<Key, Value, std::less<Key>, PSRAMAllocator<std::pair<const Key, Value>>>>;
+    using string = instrumented<std::basic_string<char, std::char_traits<char>, PSRAMAllocator<char>>>;
+#else
     //------------------------------------------------
     // Vector with PSRAMAllocator
     template <typename T>
@@ -266,6 +388,7 @@ namespace stdpsram
     //------------------------------------------------
     // String with PSRAMAllocator
     using string = std::basic_string<char, std::char_traits<char>, PSRAMAllocator<char>>;
+#endif
     //------------------------------------------------
     // Tuple (unchanged)
     template <typename... Types>
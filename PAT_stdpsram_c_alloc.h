@@ -0,0 +1,245 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Allocator adapters for third-party libraries:
+// Libraries that allocate through malloc or their own hooks (JSON parsers, TLS, image codecs) bypass
+// PSRAMAllocator. tracked_heap<Memory, Tag> exposes the same placement policy (PSRAM or internal SRAM) as plain
+// C functions and counts every allocation, so a library's footprint can be measured per Tag.
+//
+//   struct tls_tag;
+//   typedef stdpsram::tracked_heap<stdpsram::psram_memory, tls_tag> tls_heap;
+//   mbedtls_platform_set_calloc_free(tls_heap::calloc, tls_heap::free);
+//
+//   stdpsram::c_allocator t = tls_heap::table();           // malloc/free/realloc/calloc table
+//   tls_heap::stats().print("mbedtls");
+//
+// ArduinoJson:
+// - 6.x: BasicJsonDocument<stdpsram::json_allocator<stdpsram::psram_memory>> doc(16384);
+// - 7.x: JsonDocument doc(stdpsram::arduinojson_allocator<stdpsram::psram_memory>::instance());
+//   (include <ArduinoJson.h> before this header for the 7.x adapter)
+//
+// Each block carries a small header holding its size, so free() and realloc() keep the byte counters exact.
+// Pointers from these functions must be released through the same tracked_heap, never through ::free.
+
+#ifndef PAT_STDPSRAM_C_ALLOC_H
+#define PAT_STDPSRAM_C_ALLOC_H
+
+#include "PAT_stdpsram.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace stdpsram
+{
+    ///////////////////////////////////////////////////
+    // Placement policies, matching PSRAMAllocator and SRAMAllocator
+    struct psram_memory
+    {
+        static const uint32_t caps = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+    };
+
+    struct sram_memory
+    {
+        static const uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    };
+
+    ///////////////////////////////////////////////////
+    // Counters of one tracked heap (updated from any task)
+    struct allocation_stats
+    {
+        std::atomic<std::size_t> allocations; // successful malloc/calloc/realloc(nullptr, n)
+        std::atomic<std::size_t> frees;
+        std::atomic<std::size_t> reallocs;
+        std::atomic<std::size_t> failures; // requests the heap could not satisfy
+        std::atomic<std::size_t> bytes;    // currently allocated (payload only)
+        std::atomic<std::size_t> peak;     // high-water mark of bytes
+
+        std::size_t live() const noexcept { return allocations - frees; }
+
+        void reset() noexcept
+        {
+            allocations = 0;
+            frees = 0;
+            reallocs = 0;
+            failures = 0;
+            peak = bytes.load();
+        }
+
+        void print(const char *name) const
+        {
+            STDPSRAM_PRINTF("%-16s bytes: %8u peak: %8u live: %6u allocs: %8u reallocs: %6u failures: %u\n", name,
+                            unsigned(bytes.load()), unsigned(peak.load()), unsigned(live()), unsigned(allocations.load()),
+                            unsigned(reallocs.load()), unsigned(failures.load()));
+        }
+    };
+
+    // C-style allocation function table
+    struct c_allocator
+    {
+        void *(*malloc)(std::size_t);
+        void (*free)(void *);
+        void *(*realloc)(void *, std::size_t);
+        void *(*calloc)(std::size_t, std::size_t);
+    };
+
+    namespace detail
+    {
+        // Keeps the payload aligned like malloc's result
+        static const std::size_t c_alloc_header = alignof(std::max_align_t) > sizeof(std::size_t) ? alignof(std::max_align_t) : sizeof(std::size_t);
+
+        inline void *caps_realloc(void *p, std::size_t n, uint32_t caps)
+        {
+#if defined(ARDUINO)
+            return heap_caps_realloc(p, n, caps);
+#else
+            static_cast<void>(caps);
+            return std::realloc(p, n);
+#endif
+        }
+    }
+
+    ///////////////////////////////////////////////////
+    // tracked_heap: malloc/free/realloc/calloc over Memory, with counters per Tag
+    template <typename Memory, typename Tag = void>
+    class tracked_heap
+    {
+    private:
+        static const std::size_t header = detail::c_alloc_header;
+
+        static void grow(std::size_t n)
+        {
+            allocation_stats &s = stats();
+            std::size_t now = s.bytes.fetch_add(n) + n;
+            std::size_t peak = s.peak.load();
+            while (now > peak && !s.peak.compare_exchange_weak(peak, now))
+            {
+            }
+        }
+
+        static void *payload(void *block, std::size_t n)
+        {
+            *static_cast<std::size_t *>(block) = n;
+            return static_cast<uint8_t *>(block) + header;
+        }
+
+        static void *block_of(void *p)
+        {
+            return static_cast<uint8_t *>(p) - header;
+        }
+
+    public:
+        static allocation_stats &stats()
+        {
+            static allocation_stats s{};
+            return s;
+        }
+
+        // Bytes requested for p (0 for nullptr)
+        static std::size_t size_of(void *p)
+        {
+            return p ? *static_cast<std::size_t *>(block_of(p)) : 0;
+        }
+
+        static void *malloc(std::size_t n)
+        {
+            void *block = n <= std::size_t(-1) - header ? heap_caps_malloc(n + header, Memory::caps) : nullptr;
+            if (!block)
+            {
+                stats().failures++;
+                return nullptr;
+            }
+            stats().allocations++;
+            grow(n);
+            return payload(block, n);
+        }
+
+        static void free(void *p)
+        {
+            if (!p)
+            {
+                return;
+            }
+            stats().frees++;
+            stats().bytes -= size_of(p);
+            std::free(block_of(p));
+        }
+
+        static void *realloc(void *p, std::size_t n)
+        {
+            if (!p)
+            {
+                return malloc(n);
+            }
+            if (n == 0)
+            {
+                free(p);
+                return nullptr;
+            }
+            std::size_t old = size_of(p);
+            void *block = n <= std::size_t(-1) - header ? detail::caps_realloc(block_of(p), n + header, Memory::caps) : nullptr;
+            if (!block)
+            {
+                stats().failures++;
+                return nullptr; // p is still valid, as with realloc
+            }
+            stats().reallocs++;
+            stats().bytes -= old;
+            grow(n);
+            return payload(block, n);
+        }
+
+        static void *calloc(std::size_t count, std::size_t size)
+        {
+            if (size && count > std::size_t(-1) / size)
+            {
+                stats().failures++;
+                return nullptr;
+            }
+            void *p = malloc(count * size);
+            if (p)
+            {
+                std::memset(p, 0, count * size);
+            }
+            return p;
+        }
+
+        static c_allocator table()
+        {
+            return c_allocator{&tracked_heap::malloc, &tracked_heap::free, &tracked_heap::realloc, &tracked_heap::calloc};
+        }
+    };
+
+    ///////////////////////////////////////////////////
+    // ArduinoJson 6 allocator (the Allocator parameter of BasicJsonDocument)
+    template <typename Memory, typename Tag = void>
+    struct json_allocator
+    {
+        void *allocate(std::size_t n) { return tracked_heap<Memory, Tag>::malloc(n); }
+        void deallocate(void *p) { tracked_heap<Memory, Tag>::free(p); }
+        void *reallocate(void *p, std::size_t n) { return tracked_heap<Memory, Tag>::realloc(p, n); }
+    };
+
+#if defined(ARDUINOJSON_VERSION_MAJOR) && ARDUINOJSON_VERSION_MAJOR >= 7
+    ///////////////////////////////////////////////////
+    // ArduinoJson 7 allocator (passed by pointer to JsonDocument)
+    template <typename Memory, typename Tag = void>
+    class arduinojson_allocator : public ArduinoJson::Allocator
+    {
+    public:
+        void *allocate(size_t n) override { return tracked_heap<Memory, Tag>::malloc(n); }
+        void deallocate(void *p) override { tracked_heap<Memory, Tag>::free(p); }
+        void *reallocate(void *p, size_t n) override { return tracked_heap<Memory, Tag>::realloc(p, n); }
+
+        static arduinojson_allocator *instance()
+        {
+            static arduinojson_allocator a;
+            return &a;
+        }
+    };
+#endif
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_C_ALLOC_H
@@ -0,0 +1,467 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// LZ4-compressed cold storage in PSRAM:
+// stdpsram::compressed_blob is an append-only byte store that keeps its data as independently compressed blocks
+// (LZ4 block format, so blocks can also be decoded by any stock LZ4 implementation). Reads decompress on demand
+// into a small cache of scratch buffers (SRAM by default), so repeated reads of the same region decode once.
+// Blocks that do not shrink are kept raw. The open tail block stays uncompressed until it fills or flush().
+//
+//   stdpsram::compressed_blob log;
+//   log.append(line.data(), line.size());
+//   log.flush();                                   // compress the tail, e.g. once a response is complete
+//   char buf[128];
+//   log.read(offset, buf, sizeof(buf));
+//   STDPSRAM_PRINTF("ratio %.2f, decode %.1f MB/s\n", log.stats().ratio(), log.stats().decode_mb_per_s());
+
+#ifndef PAT_STDPSRAM_COMPRESSED_H
+#define PAT_STDPSRAM_COMPRESSED_H
+
+#include "PAT_stdpsram.h"
+#include "PAT_stdpsram_memory.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(ARDUINO)
+#include <esp_timer.h>
+#else
+#include <chrono>
+#endif
+
+#ifndef STDPSRAM_LZ4_BLOCK
+#define STDPSRAM_LZ4_BLOCK 4096 // uncompressed bytes per block (at most 65536)
+#endif
+
+#ifndef STDPSRAM_LZ4_CACHE
+#define STDPSRAM_LZ4_CACHE 2 // decompressed blocks kept per blob
+#endif
+
+namespace stdpsram
+{
+    namespace detail
+    {
+        inline uint64_t now_us()
+        {
+#if defined(ARDUINO)
+            return uint64_t(esp_timer_get_time());
+#else
+            return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now().time_since_epoch())
+                                .count());
+#endif
+        }
+
+        inline uint32_t lz4_read32(const uint8_t *p)
+        {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        static const int lz4_hash_bits = 12;
+
+        // Writes a length continuation (the part above 15) as 255-runs; false if it does not fit
+        inline bool lz4_put_length(uint8_t *&op, const uint8_t *oend, std::size_t len)
+        {
+            for (; len >= 255; len -= 255)
+            {
+                if (op >= oend)
+                    return false;
+                *op++ = 255;
+            }
+            if (op >= oend)
+                return false;
+            *op++ = uint8_t(len);
+            return true;
+        }
+
+        // One sequence: literals [lit, lit + lit_len), then a match (match_len == 0 for the final literals)
+        inline bool lz4_put_sequence(uint8_t *&op, const uint8_t *oend, const uint8_t *lit, std::size_t lit_len,
+                                     std::size_t offset, std::size_t match_len)
+        {
+            if (op >= oend)
+                return false;
+            uint8_t *token = op++;
+            *token = uint8_t((lit_len >= 15 ? 15 : lit_len) << 4);
+            if (lit_len >= 15 && !lz4_put_length(op, oend, lit_len - 15))
+                return false;
+            if (std::size_t(oend - op) < lit_len)
+                return false;
+            std::memcpy(op, lit, lit_len);
+            op += lit_len;
+            if (!match_len)
+                return true;
+            if (oend - op < 2)
+                return false;
+            *op++ = uint8_t(offset);
+            *op++ = uint8_t(offset >> 8);
+            std::size_t m = match_len - 4;
+            *token |= uint8_t(m >= 15 ? 15 : m);
+            return m < 15 || lz4_put_length(op, oend, m - 15);
+        }
+
+        // Greedy LZ4 block compression; returns the compressed size, or 0 if it does not fit in cap bytes
+        inline std::size_t lz4_compress(const uint8_t *src, std::size_t n, uint8_t *dst, std::size_t cap, uint32_t *table)
+        {
+            const uint8_t *ip = src;
+            const uint8_t *anchor = src;
+            const uint8_t *end = src + n;
+            uint8_t *op = dst;
+            const uint8_t *oend = dst + cap;
+            std::fill(table, table + (1 << lz4_hash_bits), 0);
+
+            if (n >= 13)
+            {
+                const uint8_t *mflimit = end - 12; // the last match must start 12 bytes before the end
+                const uint8_t *matchlimit = end - 5; // and leave 5 literals
+                while (ip <= mflimit)
+                {
+                    uint32_t seq = lz4_read32(ip);
+                    uint32_t h = (seq * 2654435761u) >> (32 - lz4_hash_bits);
+                    const uint8_t *ref = src + table[h];
+                    table[h] = uint32_t(ip - src);
+                    if (ref < ip && ip - ref <= 65535 && lz4_read32(ref) == seq)
+                    {
+                        std::size_t len = 4;
+                        while (ip + len < matchlimit && ref[len] == ip[len])
+                        {
+                            len++;
+                        }
+                        if (!lz4_put_sequence(op, oend, anchor, std::size_t(ip - anchor), std::size_t(ip - ref), len))
+                        {
+                            return 0;
+                        }
+                        ip += len;
+                        anchor = ip;
+                    }
+                    else
+                    {
+                        ip++;
+                    }
+                }
+            }
+            if (!lz4_put_sequence(op, oend, anchor, std::size_t(end - anchor), 0, 0))
+            {
+                return 0;
+            }
+            return std::size_t(op - dst);
+        }
+
+        // Decodes exactly n bytes; false on malformed input
+        inline bool lz4_decompress(const uint8_t *src, std::size_t csize, uint8_t *dst, std::size_t n)
+        {
+            const uint8_t *ip = src;
+            const uint8_t *iend = src + csize;
+            uint8_t *op = dst;
+            uint8_t *oend = dst + n;
+            while (ip < iend)
+            {
+                uint8_t token = *ip++;
+                std::size_t lit = token >> 4;
+                if (lit == 15)
+                {
+                    uint8_t b;
+                    do
+                    {
+                        if (ip >= iend)
+                            return false;
+                        b = *ip++;
+                        lit += b;
+                    } while (b == 255);
+                }
+                if (std::size_t(iend - ip) < lit || std::size_t(oend - op) < lit)
+                    return false;
+                std::memcpy(op, ip, lit);
+                ip += lit;
+                op += lit;
+                if (ip == iend)
+                    break; // final literals
+
+                if (iend - ip < 2)
+                    return false;
+                std::size_t offset = std::size_t(ip[0]) | (std::size_t(ip[1]) << 8);
+                ip += 2;
+                std::size_t len = (token & 15u) + 4;
+                if ((token & 15u) == 15)
+                {
+                    uint8_t b;
+                    do
+                    {
+                        if (ip >= iend)
+                            return false;
+                        b = *ip++;
+                        len += b;
+                    } while (b == 255);
+                }
+                if (offset == 0 || std::size_t(op - dst) < offset || std::size_t(oend - op) < len)
+                    return false;
+                const uint8_t *match = op - offset;
+                while (len--)
+                {
+                    *op++ = *match++; // byte by byte: source and destination may overlap
+                }
+            }
+            return op == oend;
+        }
+    }
+
+    ///////////////////////////////////////////////////
+    // compressed_blob: append-only LZ4-compressed byte store with a decompressed-block cache
+    template <typename ScratchAllocator = SRAMAllocator<uint8_t>>
+    class basic_compressed_blob
+    {
+    public:
+        struct statistics
+        {
+            std::size_t raw_bytes;    // bytes appended
+            std::size_t stored_bytes; // PSRAM used by block payloads, including the open tail block
+            std::size_t blocks;
+            std::size_t cache_hits;
+            std::size_t cache_misses;
+            std::size_t decoded_bytes;
+            uint64_t decode_us;
+
+            float ratio() const { return stored_bytes ? float(raw_bytes) / float(stored_bytes) : 1.0f; }
+            float decode_mb_per_s() const { return decode_us ? float(decoded_bytes) / float(decode_us) : 0.0f; }
+        };
+
+    private:
+        struct block
+        {
+            std::size_t offset; // of the first uncompressed byte
+            uint32_t raw_size;
+            uint32_t stored_size; // == raw_size: kept uncompressed
+            vector<uint8_t> data;
+        };
+
+        struct cache_slot
+        {
+            std::size_t index; // block index, or npos
+            uint32_t used;     // last-use tick
+            std::vector<uint8_t, ScratchAllocator> data;
+        };
+
+        static const std::size_t npos = std::size_t(-1);
+
+        std::size_t block_size;
+        vector<block> blocks;
+        vector<uint8_t> tail;
+        std::vector<cache_slot> cache;
+        uint32_t tick;
+        statistics counters;
+
+        // Block holding byte offset pos (pos < size of sealed data)
+        std::size_t find_block(std::size_t pos) const
+        {
+            std::size_t lo = 0, hi = blocks.size();
+            while (hi - lo > 1)
+            {
+                std::size_t mid = (lo + hi) / 2;
+                if (blocks[mid].offset <= pos)
+                    lo = mid;
+                else
+                    hi = mid;
+            }
+            return lo;
+        }
+
+        const uint8_t *decoded(std::size_t index)
+        {
+            const block &b = blocks[index];
+            if (b.stored_size == b.raw_size)
+            {
+                return b.data.data();
+            }
+            cache_slot *victim = &cache[0];
+            for (cache_slot &slot : cache)
+            {
+                if (slot.index == index)
+                {
+                    slot.used = ++tick;
+                    counters.cache_hits++;
+                    return slot.data.data();
+                }
+                if (slot.used < victim->used)
+                {
+                    victim = &slot;
+                }
+            }
+            counters.cache_misses++;
+            victim->data.resize(block_size);
+            victim->index = npos;
+            uint64_t start = detail::now_us();
+            if (!detail::lz4_decompress(b.data.data(), b.stored_size, victim->data.data(), b.raw_size))
+            {
+                throw std::runtime_error("compressed_blob: corrupt block");
+            }
+            counters.decode_us += detail::now_us() - start;
+            counters.decoded_bytes += b.raw_size;
+            victim->index = index;
+            victim->used = ++tick;
+            return victim->data.data();
+        }
+
+        void seal_tail()
+        {
+            if (tail.empty())
+            {
+                return;
+            }
+            block b;
+            b.offset = sealed_size();
+            b.raw_size = uint32_t(tail.size());
+            {
+                std::vector<uint8_t, SRAMAllocator<uint8_t>> out(tail.size());
+                std::vector<uint32_t, SRAMAllocator<uint32_t>> table(std::size_t(1) << detail::lz4_hash_bits);
+                std::size_t n = detail::lz4_compress(tail.data(), tail.size(), out.data(), out.size() - 1, table.data());
+                if (n)
+                {
+                    b.stored_size = uint32_t(n);
+                    b.data.assign(out.begin(), out.begin() + n);
+                }
+                else
+                {
+                    b.stored_size = b.raw_size; // incompressible
+                    b.data.swap(tail);
+                }
+            }
+            counters.stored_bytes += b.stored_size;
+            blocks.push_back(std::move(b));
+            counters.blocks = blocks.size();
+            vector<uint8_t>().swap(tail);
+        }
+
+        std::size_t sealed_size() const
+        {
+            return blocks.empty() ? 0 : blocks.back().offset + blocks.back().raw_size;
+        }
+
+    public:
+        // block_size: uncompressed bytes per block; cache_blocks: decompressed blocks kept for repeated reads
+        explicit basic_compressed_blob(std::size_t block_size = STDPSRAM_LZ4_BLOCK, std::size_t cache_blocks = STDPSRAM_LZ4_CACHE)
+            : block_size(std::min<std::size_t>(std::max<std::size_t>(block_size, 64), 65536)),
+              cache(cache_blocks ? cache_blocks : 1), tick(0), counters()
+        {
+            for (cache_slot &slot : cache)
+            {
+                slot.index = npos;
+                slot.used = 0;
+            }
+        }
+
+        basic_compressed_blob(const basic_compressed_blob &) = delete;
+        basic_compressed_blob &operator=(const basic_compressed_blob &) = delete;
+
+        //--------------------------------
+        void append(const void *data, std::size_t n)
+        {
+            const uint8_t *p = static_cast<const uint8_t *>(data);
+            while (n)
+            {
+                if (tail.capacity() < block_size)
+                {
+                    tail.reserve(block_size);
+                }
+                std::size_t len = std::min(n, block_size - tail.size());
+                std::size_t old = tail.size();
+                tail.resize(old + len);
+                stdpsram::memcpy(tail.data() + old, p, len);
+                counters.raw_bytes += len;
+                p += len;
+                n -= len;
+                if (tail.size() == block_size)
+                {
+                    seal_tail();
+                }
+            }
+        }
+
+        void append(const string &s)
+        {
+            append(s.data(), s.size());
+        }
+
+        // Compress the open tail block now (it becomes a short block) and release its buffer
+        void flush()
+        {
+            seal_tail();
+        }
+
+        // Copy n bytes starting at offset into dst; returns the number of bytes copied (short at the end)
+        std::size_t read(std::size_t offset, void *dst, std::size_t n)
+        {
+            uint8_t *out = static_cast<uint8_t *>(dst);
+            std::size_t copied = 0;
+            const std::size_t sealed = sealed_size();
+            while (n && offset < sealed)
+            {
+                std::size_t index = find_block(offset);
+                const block &b = blocks[index];
+                std::size_t in = offset - b.offset;
+                std::size_t len = std::min(n, b.raw_size - in);
+                stdpsram::memcpy(out, decoded(index) + in, len);
+                out += len;
+                offset += len;
+                copied += len;
+                n -= len;
+            }
+            if (n && offset >= sealed && offset - sealed < tail.size())
+            {
+                std::size_t len = std::min(n, tail.size() - (offset - sealed));
+                stdpsram::memcpy(out, tail.data() + (offset - sealed), len);
+                copied += len;
+            }
+            return copied;
+        }
+
+        // Whole content as a stdpsram::string
+        string str()
+        {
+            string s(size(), '\0');
+            if (!s.empty())
+            {
+                read(0, &s[0], s.size());
+            }
+            return s;
+        }
+
+        void clear()
+        {
+            blocks.clear();
+            vector<uint8_t>().swap(tail);
+            for (cache_slot &slot : cache)
+            {
+                slot.index = npos;
+            }
+            counters = statistics();
+        }
+
+        // Drop the decompressed blocks (their scratch buffers are freed)
+        void drop_cache()
+        {
+            for (cache_slot &slot : cache)
+            {
+                slot.index = npos;
+                std::vector<uint8_t, ScratchAllocator>().swap(slot.data);
+            }
+        }
+
+        std::size_t size() const noexcept { return sealed_size() + tail.size(); }
+        bool empty() const noexcept { return size() == 0; }
+
+        statistics stats() const
+        {
+            statistics s = counters;
+            s.stored_bytes += tail.size();
+            return s;
+        }
+    };
+
+    typedef basic_compressed_blob<> compressed_blob;
+    typedef basic_compressed_blob<PSRAMAllocator<uint8_t>> compressed_blob_psram_cache;
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_COMPRESSED_H
@@ -0,0 +1,338 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// External merge sort for datasets larger than PSRAM:
+// Records are pushed one by one. Every SRAM-sized run is sorted in SRAM and appended to a PSRAM buffer; when
+// the PSRAM buffer is full its runs are merged into one long run and streamed to a spill file. finish() merges
+// all spilled runs and the runs still in PSRAM with a loser tree and hands each record, in order, to a callback.
+// The full dataset is never materialised in memory.
+//
+// The spill file goes through stdio, so on ESP32 pass a path on a mounted VFS partition
+// (e.g. "/littlefs/sort.tmp" after LittleFS.begin(), or "/spiffs/sort.tmp"); on host any writable path works.
+//
+//   stdpsram::external_sorter<Event> sorter("/littlefs/events.tmp");
+//   for (...) sorter.push(event);
+//   sorter.finish([](const Event &e) { upload(e); });
+
+#ifndef PAT_STDPSRAM_EXTERNAL_SORT_H
+#define PAT_STDPSRAM_EXTERNAL_SORT_H
+
+#include "PAT_stdpsram.h"
+#include "PAT_stdpsram_memory.h"
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+
+#ifndef STDPSRAM_EXTSORT_BLOCK
+#define STDPSRAM_EXTSORT_BLOCK 4096 // bytes per file read/write block
+#endif
+
+namespace stdpsram
+{
+    ///////////////////////////////////////////////////
+    // loser_tree: k-way merge selection with log2(k) comparisons per record
+    // Source i is described by less(i, j), which must order exhausted sources last.
+    template <typename Less>
+    class loser_tree
+    {
+    private:
+        std::vector<std::size_t, SRAMAllocator<std::size_t>> tree; // tree[0] = winner, tree[1..k) = losers
+        std::size_t k;
+        Less less;
+
+    public:
+        loser_tree(std::size_t sources, Less less) : tree(sources ? sources : 1), k(sources), less(less)
+        {
+            if (k == 0)
+            {
+                return;
+            }
+            // Bottom-up tournament over a heap-shaped tree: leaves are nodes k..2k-1
+            std::vector<std::size_t, SRAMAllocator<std::size_t>> winner(2 * k);
+            for (std::size_t i = 0; i < k; i++)
+            {
+                winner[k + i] = i;
+            }
+            for (std::size_t node = k - 1; node >= 1; node--)
+            {
+                std::size_t a = winner[2 * node], b = winner[2 * node + 1];
+                bool a_wins = !this->less(b, a);
+                winner[node] = a_wins ? a : b;
+                tree[node] = a_wins ? b : a;
+            }
+            tree[0] = k > 1 ? winner[1] : 0;
+        }
+
+        std::size_t top() const
+        {
+            return tree[0];
+        }
+
+        // Re-run the matches on the path of the current winner after its source advanced
+        void replay()
+        {
+            std::size_t w = tree[0];
+            for (std::size_t node = (w + k) / 2; node >= 1; node /= 2)
+            {
+                if (less(tree[node], w))
+                {
+                    std::swap(tree[node], w);
+                }
+            }
+            tree[0] = w;
+        }
+    };
+
+    ///////////////////////////////////////////////////
+    // external_sorter: SRAM runs -> PSRAM -> spill file -> k-way merge
+    template <typename T, typename Compare = std::less<T>>
+    class external_sorter
+    {
+    private:
+        static_assert(std::is_trivially_copyable<T>::value, "external_sorter writes raw records; T must be trivially copyable");
+
+        struct run
+        {
+            long offset; // byte offset in the spill file
+            std::size_t count;
+        };
+
+        // One input of a merge: a slice of PSRAM or a run in the spill file read block by block
+        struct source
+        {
+            const T *next;
+            const T *last;
+            long file_offset;
+            std::size_t file_left;
+            T *block;
+        };
+
+        const char *path;
+        Compare comp;
+        std::size_t run_capacity;
+        std::size_t psram_capacity;
+        std::size_t block_records;
+
+        std::vector<T, SRAMAllocator<T>> current;
+        vector<T> staged;
+        vector<std::size_t> staged_runs; // start index of each run in staged
+        vector<run> spilled;
+        FILE *file;
+        long file_end;
+        std::size_t total;
+
+        FILE *spill_file()
+        {
+            if (!file)
+            {
+                file = std::fopen(path, "w+b");
+                if (!file)
+                {
+                    throw std::runtime_error("external_sorter: cannot open spill file");
+                }
+                file_end = 0;
+            }
+            return file;
+        }
+
+        bool refill(source &s)
+        {
+            if (!s.file_left)
+            {
+                return false;
+            }
+            std::size_t n = s.file_left < block_records ? s.file_left : block_records;
+            if (std::fseek(file, s.file_offset, SEEK_SET) != 0 || std::fread(s.block, sizeof(T), n, file) != n)
+            {
+                throw std::runtime_error("external_sorter: spill file read failed");
+            }
+            s.file_offset += long(n * sizeof(T));
+            s.file_left -= n;
+            s.next = s.block;
+            s.last = s.block + n;
+            return true;
+        }
+
+        // Merge the given sources, handing every record to sink in order
+        template <typename Sink>
+        void merge(vector<source> &sources, Sink &&sink)
+        {
+            auto less = [&sources, this](std::size_t a, std::size_t b)
+            {
+                const source &x = sources[a], &y = sources[b];
+                if (x.next == x.last)
+                    return false;
+                if (y.next == y.last)
+                    return true;
+                return comp(*x.next, *y.next);
+            };
+            loser_tree<decltype(less)> tree(sources.size(), less);
+            while (!sources.empty())
+            {
+                source &s = sources[tree.top()];
+                if (s.next == s.last)
+                {
+                    break; // the winner is exhausted, so all are
+                }
+                sink(*s.next);
+                if (++s.next == s.last && s.file_left)
+                {
+                    refill(s);
+                }
+                tree.replay();
+            }
+        }
+
+        // Sources for the runs currently held in PSRAM
+        void add_staged_sources(vector<source> &sources)
+        {
+            for (std::size_t r = 0; r < staged_runs.size(); r++)
+            {
+                std::size_t first = staged_runs[r];
+                std::size_t last = r + 1 < staged_runs.size() ? staged_runs[r + 1] : staged.size();
+                sources.push_back(source{staged.data() + first, staged.data() + last, 0, 0, nullptr});
+            }
+        }
+
+        // Merge the PSRAM runs into one run at the end of the spill file
+        void spill()
+        {
+            if (staged.empty())
+            {
+                return;
+            }
+            FILE *f = spill_file();
+            if (std::fseek(f, file_end, SEEK_SET) != 0)
+            {
+                throw std::runtime_error("external_sorter: spill file seek failed");
+            }
+            run r{file_end, staged.size()};
+
+            std::vector<T, SRAMAllocator<T>> out;
+            out.reserve(block_records);
+            auto flush = [&out, f]()
+            {
+                if (std::fwrite(out.data(), sizeof(T), out.size(), f) != out.size())
+                {
+                    throw std::runtime_error("external_sorter: spill file write failed");
+                }
+                out.clear();
+            };
+            vector<source> sources;
+            add_staged_sources(sources);
+            merge(sources, [&out, &flush, this](const T &x)
+                  {
+                      out.push_back(x);
+                      if (out.size() == block_records)
+                          flush(); });
+            flush();
+
+            file_end += long(r.count * sizeof(T));
+            spilled.push_back(r);
+            staged.clear();
+            staged_runs.clear();
+        }
+
+        // Sort the SRAM run and move it to PSRAM, spilling first if it does not fit
+        void stage_current()
+        {
+            if (current.empty())
+            {
+                return;
+            }
+            std::sort(current.begin(), current.end(), comp);
+            if (staged.size() + current.size() > psram_capacity)
+            {
+                spill();
+            }
+            staged_runs.push_back(staged.size());
+            staged.insert(staged.end(), current.begin(), current.end());
+            current.clear();
+        }
+
+    public:
+        // spill_path: file used for runs that do not fit in PSRAM (created on first spill, removed by finish())
+        // run_bytes: SRAM used to sort one run; psram_bytes: PSRAM used to collect runs before spilling
+        explicit external_sorter(const char *spill_path, std::size_t run_bytes = 16 * 1024,
+                                 std::size_t psram_bytes = 1024 * 1024, Compare comp = Compare())
+            : path(spill_path), comp(comp),
+              run_capacity(run_bytes / sizeof(T) ? run_bytes / sizeof(T) : 1),
+              psram_capacity(psram_bytes / sizeof(T) > run_capacity ? psram_bytes / sizeof(T) : run_capacity),
+              block_records(STDPSRAM_EXTSORT_BLOCK / sizeof(T) ? STDPSRAM_EXTSORT_BLOCK / sizeof(T) : 1),
+              file(nullptr), file_end(0), total(0)
+        {
+            current.reserve(run_capacity);
+            staged.reserve(psram_capacity);
+        }
+
+        ~external_sorter()
+        {
+            if (file)
+            {
+                std::fclose(file);
+                std::remove(path);
+            }
+        }
+
+        external_sorter(const external_sorter &) = delete;
+        external_sorter &operator=(const external_sorter &) = delete;
+
+        //--------------------------------
+        void push(const T &record)
+        {
+            current.push_back(record);
+            total++;
+            if (current.size() == run_capacity)
+            {
+                stage_current();
+            }
+        }
+
+        // Records pushed since construction or the last finish()
+        std::size_t size() const noexcept
+        {
+            return total;
+        }
+
+        // Runs written to the spill file so far
+        std::size_t spilled_runs() const noexcept
+        {
+            return spilled.size();
+        }
+
+        //--------------------------------
+        // Stream every record in sorted order to sink(const T &), then reset the sorter and delete the spill file
+        template <typename Sink>
+        void finish(Sink &&sink)
+        {
+            stage_current();
+
+            vector<source> sources;
+            vector<T> blocks(spilled.size() * block_records);
+            for (std::size_t r = 0; r < spilled.size(); r++)
+            {
+                source s{nullptr, nullptr, spilled[r].offset, spilled[r].count, blocks.data() + r * block_records};
+                refill(s);
+                sources.push_back(s);
+            }
+            add_staged_sources(sources);
+            merge(sources, sink);
+
+            staged.clear();
+            staged_runs.clear();
+            spilled.clear();
+            total = 0;
+            if (file)
+            {
+                std::fclose(file);
+                std::remove(path);
+                file = nullptr;
+            }
+        }
+    };
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_EXTERNAL_SORT_H
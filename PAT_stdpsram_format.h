@@ -0,0 +1,965 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Allocation-free formatting:
+// stdpsram::format_to renders fmt-style format strings ("{}", "{:08.3f}", "{:>10}", "{:#x}", "{{" / "}}")
+// straight into a stdpsram::string, a fixed char buffer or any output iterator. Numbers are converted in small
+// stack buffers (no snprintf, whose float path allocates in newlib), and the string target is sized with a
+// counting pass first so it grows at most once.
+//
+// Format strings wrapped in STDPSRAM_FMT are checked at compile time: unbalanced braces or a placeholder count
+// that differs from the number of arguments is a static_assert. Strings only known at run time go through
+// stdpsram::runtime_format and are checked while formatting (std::invalid_argument).
+//
+//   stdpsram::string line;
+//   stdpsram::format_to(line, STDPSRAM_FMT("t={} T={:.2f} id={:#06x}\n"), millis(), temp, id);
+//   char buf[64];
+//   stdpsram::format_to(buf, STDPSRAM_FMT("free PSRAM: {} kB"), free_kb);   // truncates, always terminated
+//
+// Spec grammar: [[fill]align][+][#][0][width][.precision][type], align one of < > ^,
+// type one of d x X b o c (integers), f e g (floating point), s (strings), p (pointers).
+// Floating point output is exact and rounded like printf (ties to even); precision is capped at 40, and a float
+// conversion takes about 1 KB of stack.
+
+#ifndef PAT_STDPSRAM_FORMAT_H
+#define PAT_STDPSRAM_FORMAT_H
+
+#include "PAT_stdpsram.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+// Wraps a string literal into a type so format_to can check it at compile time (C++11: no constexpr params)
+#define STDPSRAM_FMT(literal)                                          \
+    []                                                                 \
+    {                                                                  \
+        struct stdpsram_format_string                                  \
+        {                                                              \
+            static constexpr const char *str() { return literal; }     \
+        };                                                             \
+        return stdpsram_format_string();                               \
+    }()
+
+namespace stdpsram
+{
+    // A format string checked only at run time
+    struct runtime_format
+    {
+        const char *text;
+        explicit runtime_format(const char *text) : text(text) {}
+    };
+
+    // Result of formatting into a fixed buffer
+    struct format_result
+    {
+        std::size_t size;  // characters the full output needs (excluding the terminator)
+        bool truncated;
+    };
+
+    namespace detail
+    {
+        //--------------------------------
+        // Compile-time check: number of placeholders, or -1 for unbalanced braces
+        constexpr const char *format_close(const char *s)
+        {
+            return !*s ? nullptr : *s == '}' ? s + 1 : *s == '{' ? nullptr : format_close(s + 1);
+        }
+
+        constexpr int format_arg_count(const char *s, int n = 0)
+        {
+            return !s     ? -1
+                   : !*s  ? n
+                   : *s == '{' ? (s[1] == '{' ? format_arg_count(s + 2, n) : format_arg_count(format_close(s + 1), n + 1))
+                   : *s == '}' ? (s[1] == '}' ? format_arg_count(s + 2, n) : -1)
+                               : format_arg_count(s + 1, n);
+        }
+
+        template <typename Fmt, std::size_t Args>
+        struct format_string
+        {
+            static_assert(format_arg_count(Fmt::str()) >= 0, "format string has unbalanced braces");
+            static_assert(format_arg_count(Fmt::str()) == int(Args), "format string placeholders do not match the arguments");
+            static const char *get(Fmt) { return Fmt::str(); }
+        };
+
+        template <std::size_t Args>
+        struct format_string<runtime_format, Args>
+        {
+            static const char *get(runtime_format f) { return f.text; }
+        };
+
+        //--------------------------------
+        // Sinks: put(char) and write(const char *, n)
+        struct counting_sink
+        {
+            std::size_t count = 0;
+            void put(char) { count++; }
+            void write(const char *, std::size_t n) { count += n; }
+        };
+
+        struct buffer_sink
+        {
+            char *out;
+            std::size_t room; // excluding the terminator
+            std::size_t count;
+
+            void put(char c)
+            {
+                if (count < room)
+                    out[count] = c;
+                count++;
+            }
+
+            void write(const char *s, std::size_t n)
+            {
+                if (count < room)
+                    std::memcpy(out + count, s, n < room - count ? n : room - count);
+                count += n;
+            }
+        };
+
+        template <typename Iterator>
+        struct iterator_sink
+        {
+            Iterator it;
+            void put(char c) { *it++ = c; }
+            void write(const char *s, std::size_t n)
+            {
+                while (n--)
+                    *it++ = *s++;
+            }
+        };
+
+        struct string_sink
+        {
+            string *s;
+            void put(char c) { s->push_back(c); }
+            void write(const char *p, std::size_t n) { s->append(p, n); }
+        };
+
+        //--------------------------------
+        struct format_spec
+        {
+            char fill = ' ';
+            char align = 0; // '<', '>', '^' or 0 for the type's default
+            bool plus = false;
+            bool alt = false;
+            int width = 0;
+            int precision = -1;
+            char type = 0;
+        };
+
+        inline void format_fail(const char *what)
+        {
+            throw std::invalid_argument(what);
+        }
+
+        // Parses "[[fill]align][+][#][0][width][.precision][type]" up to the closing brace
+        inline const char *parse_spec(const char *p, format_spec &spec)
+        {
+            auto is_align = [](char c)
+            { return c == '<' || c == '>' || c == '^'; };
+            if (*p && *p != '}' && is_align(p[1]))
+            {
+                spec.fill = *p;
+                spec.align = p[1];
+                p += 2;
+            }
+            else if (is_align(*p))
+            {
+                spec.align = *p++;
+            }
+            if (*p == '+')
+            {
+                spec.plus = true;
+                p++;
+            }
+            if (*p == '#')
+            {
+                spec.alt = true;
+                p++;
+            }
+            if (*p == '0')
+            {
+                if (!spec.align)
+                {
+                    spec.fill = '0';
+                    spec.align = '=';
+                }
+                p++;
+            }
+            while (*p >= '0' && *p <= '9')
+            {
+                spec.width = spec.width * 10 + (*p++ - '0');
+            }
+            if (*p == '.')
+            {
+                spec.precision = 0;
+                p++;
+                while (*p >= '0' && *p <= '9')
+                {
+                    spec.precision = spec.precision * 10 + (*p++ - '0');
+                }
+            }
+            if (*p && *p != '}')
+            {
+                spec.type = *p++;
+            }
+            if (*p != '}')
+            {
+                format_fail("format: bad format spec");
+            }
+            return p + 1;
+        }
+
+        // Writes prefix (sign, 0x) and body padded to spec; '=' alignment pads between prefix and body (zero fill)
+        template <typename Sink>
+        void pad(Sink &out, const format_spec &spec, char default_align, const char *prefix, std::size_t prefix_len,
+                 const char *body, std::size_t body_len)
+        {
+            std::size_t len = prefix_len + body_len;
+            std::size_t fill = spec.width > 0 && std::size_t(spec.width) > len ? std::size_t(spec.width) - len : 0;
+            char align = spec.align ? spec.align : default_align;
+            std::size_t before = align == '>' ? fill : align == '^' ? fill / 2 : 0;
+            if (align == '=')
+            {
+                out.write(prefix, prefix_len);
+                for (std::size_t i = 0; i < fill; i++)
+                    out.put(spec.fill);
+                out.write(body, body_len);
+                return;
+            }
+            for (std::size_t i = 0; i < before; i++)
+                out.put(spec.fill);
+            out.write(prefix, prefix_len);
+            out.write(body, body_len);
+            for (std::size_t i = before; i < fill; i++)
+                out.put(spec.fill);
+        }
+
+        // Digits of v in the given base, written backwards ending at end; returns the first digit
+        inline char *to_digits(char *end, uint64_t v, unsigned base, bool upper)
+        {
+            const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+            do
+            {
+                *--end = digits[v % base];
+                v /= base;
+            } while (v);
+            return end;
+        }
+
+        template <typename Sink>
+        void format_integer(Sink &out, const format_spec &spec, uint64_t magnitude, bool negative)
+        {
+            if (spec.type == 'c')
+            {
+                char c = char(magnitude);
+                pad(out, spec, '<', "", 0, &c, 1);
+                return;
+            }
+            unsigned base = 10;
+            const char *prefix_text = "";
+            switch (spec.type)
+            {
+            case 0:
+            case 'd':
+                break;
+            case 'x':
+                base = 16;
+                prefix_text = "0x";
+                break;
+            case 'X':
+                base = 16;
+                prefix_text = "0X";
+                break;
+            case 'b':
+                base = 2;
+                prefix_text = "0b";
+                break;
+            case 'o':
+                base = 8;
+                prefix_text = "0";
+                break;
+            default:
+                format_fail("format: bad type for an integer");
+            }
+            char buf[64];
+            char *first = to_digits(buf + sizeof(buf), magnitude, base, spec.type == 'X');
+            char prefix[4];
+            std::size_t n = 0;
+            if (negative)
+                prefix[n++] = '-';
+            else if (spec.plus)
+                prefix[n++] = '+';
+            if (spec.alt)
+                for (const char *p = prefix_text; *p; p++)
+                    prefix[n++] = *p;
+            pad(out, spec, '>', prefix, n, first, std::size_t(buf + sizeof(buf) - first));
+        }
+
+        // Little bit of arbitrary precision for exact float to decimal conversion: enough for 10 * 2^1077,
+        // the largest intermediate of the digit loop (a subnormal scaled by 10^324)
+        struct big_uint
+        {
+            uint32_t w[40];
+            int n; // words in use; w[n - 1] != 0 unless n == 0
+
+            explicit big_uint(uint64_t v) : n(0)
+            {
+                for (; v; v >>= 32)
+                    w[n++] = uint32_t(v);
+            }
+
+            // Copies only the words in use
+            big_uint(const big_uint &o) : n(o.n)
+            {
+                std::memcpy(w, o.w, std::size_t(n) * sizeof(uint32_t));
+            }
+
+            big_uint &operator=(const big_uint &o)
+            {
+                n = o.n;
+                std::memcpy(w, o.w, std::size_t(n) * sizeof(uint32_t));
+                return *this;
+            }
+
+            void mul_small(uint32_t m)
+            {
+                uint64_t carry = 0;
+                for (int i = 0; i < n; i++)
+                {
+                    carry += uint64_t(w[i]) * m;
+                    w[i] = uint32_t(carry);
+                    carry >>= 32;
+                }
+                if (carry)
+                    w[n++] = uint32_t(carry);
+            }
+
+            void mul_pow10(int e)
+            {
+                for (; e >= 9; e -= 9)
+                    mul_small(1000000000u);
+                static const uint32_t small[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+                mul_small(small[e]);
+            }
+
+            void shift_left(int bits)
+            {
+                int words = bits / 32;
+                bits %= 32;
+                if (n == 0)
+                    return;
+                w[n + words] = 0;
+                for (int i = n - 1; i >= 0; i--)
+                {
+                    w[i + words + 1] |= bits ? w[i] >> (32 - bits) : 0;
+                    w[i + words] = w[i] << bits;
+                }
+                for (int i = 0; i < words; i++)
+                    w[i] = 0;
+                n += words + 1;
+                if (w[n - 1] == 0)
+                    n--;
+            }
+
+            void add(const big_uint &o)
+            {
+                uint64_t carry = 0;
+                int words = n > o.n ? n : o.n;
+                for (int i = 0; i < words; i++)
+                {
+                    carry += uint64_t(i < n ? w[i] : 0) + (i < o.n ? o.w[i] : 0);
+                    w[i] = uint32_t(carry);
+                    carry >>= 32;
+                }
+                n = words;
+                if (carry)
+                    w[n++] = uint32_t(carry);
+            }
+
+            // this -= o, with o <= this
+            void subtract(const big_uint &o)
+            {
+                int64_t borrow = 0;
+                for (int i = 0; i < n; i++)
+                {
+                    borrow += int64_t(w[i]) - (i < o.n ? int64_t(o.w[i]) : 0);
+                    w[i] = uint32_t(borrow);
+                    borrow = borrow < 0 ? -1 : 0;
+                }
+                while (n > 0 && w[n - 1] == 0)
+                    n--;
+            }
+
+            int compare(const big_uint &o) const
+            {
+                if (n != o.n)
+                    return n < o.n ? -1 : 1;
+                for (int i = n - 1; i >= 0; i--)
+                {
+                    if (w[i] != o.w[i])
+                        return w[i] < o.w[i] ? -1 : 1;
+                }
+                return 0;
+            }
+
+            // this /= s, keeping the remainder; the quotient is a single decimal digit in the digit loops
+            unsigned divide(const big_uint &s)
+            {
+                unsigned q = 0;
+                while (compare(s) >= 0)
+                {
+                    subtract(s);
+                    q++;
+                }
+                return q;
+            }
+
+            // Below 2^60: the digit loops (values < 10 s) then fit in 64 bits
+            bool small() const { return n < 2 || (n == 2 && w[1] < (1u << 28)); }
+            uint64_t low64() const { return n == 0 ? 0 : n == 1 ? w[0] : (uint64_t(w[1]) << 32) | w[0]; }
+        };
+
+        // The digit-loop subset of big_uint on one 64-bit word, used for values of everyday magnitude
+        struct small_uint
+        {
+            uint64_t v;
+
+            void mul_small(uint32_t m) { v *= m; }
+            void add(const small_uint &o) { v += o.v; }
+            int compare(const small_uint &o) const { return v < o.v ? -1 : v > o.v ? 1 : 0; }
+
+            unsigned divide(const small_uint &s)
+            {
+                unsigned q = unsigned(v / s.v);
+                v %= s.v;
+                return q;
+            }
+        };
+
+        // Writes n digits of r / s, a fraction in [0, 1); returns how the rest compares to half a unit of the last
+        template <typename Num>
+        int fixed_digit_loop(char *digits, int n, Num r, const Num &s)
+        {
+            for (int i = 0; i < n; i++)
+            {
+                r.mul_small(10);
+                digits[i] = char('0' + r.divide(s));
+            }
+            r.mul_small(2);
+            return r.compare(s);
+        }
+
+        // Digits of r / s until the text is within half a gap of the value: m_minus / s below, m_plus / s above
+        // (inclusive with an even mantissa, which strtod rounds to). Returns the digit count.
+        template <typename Num>
+        int shortest_digit_loop(char *digits, Num r, const Num &s, Num m_plus, Num m_minus, bool even)
+        {
+            int n = 0;
+            for (;;)
+            {
+                r.mul_small(10);
+                m_plus.mul_small(10);
+                m_minus.mul_small(10);
+                char digit = char('0' + r.divide(s));
+                Num high(r);
+                high.add(m_plus);
+                int low_cmp = r.compare(m_minus);
+                int high_cmp = high.compare(s);
+                bool down = even ? low_cmp <= 0 : low_cmp < 0; // the digit as is already reads back as v
+                bool up = even ? high_cmp >= 0 : high_cmp > 0;  // so does the digit plus one
+                if (down && up)
+                {
+                    Num twice(r);
+                    twice.mul_small(2);
+                    int half = twice.compare(s);
+                    up = half > 0 || (half == 0 && (digit - '0') % 2);
+                }
+                if (up)
+                    digit++;
+                digits[n++] = digit;
+                if (down || up)
+                    return n;
+            }
+        }
+
+        // Digits after the point (or after the first digit in scientific notation) are capped at this
+        static const int float_precision_limit = 40;
+
+        // Decimal digits of a value: digits[0] is worth 10^exp; places past count are zero
+        struct decimal_digits
+        {
+            char digits[309 + 1 + float_precision_limit];
+            int count;
+            int exp;
+
+            char at(int i) const { return i >= 0 && i < count ? digits[i] : '0'; }
+        };
+
+        // Exact decimal expansion of a finite v >= 0, correctly rounded with ties to even like printf: every
+        // digit down to the 10^-precision place if fixed, otherwise precision + 1 significant digits.
+        // The exponent is the one of the rounded value (9.995 to 3 digits is 1.00e+01).
+        inline void round_decimal(decimal_digits &d, double v, bool fixed, int precision)
+        {
+            d.count = 0;
+            d.exp = 0;
+            if (v == 0)
+                return;
+
+            // v = r / s exactly
+            int e2;
+            uint64_t mantissa = uint64_t(std::ldexp(std::frexp(v, &e2), 53));
+            e2 -= 53;
+            big_uint r(mantissa), s(1);
+            if (e2 >= 0)
+                r.shift_left(e2);
+            else
+                s.shift_left(-e2);
+
+            // Scale so that r / s = v / 10^(k + 1) lies in [0.1, 1); the log10 estimate is off by at most one
+            int k = int(std::floor(std::log10(v)));
+            if (k >= 0)
+                s.mul_pow10(k);
+            else
+                r.mul_pow10(-k);
+            if (r.compare(s) < 0)
+            {
+                r.mul_small(10);
+                k--;
+            }
+            s.mul_small(10);
+            if (r.compare(s) >= 0)
+            {
+                s.mul_small(10);
+                k++;
+            }
+
+            int n = fixed ? k + 1 + precision : precision + 1;
+            if (n < 0)
+                return; // below half a unit of the last place
+            int half = s.small() ? fixed_digit_loop(d.digits, n, small_uint{r.low64()}, small_uint{s.low64()})
+                                 : fixed_digit_loop(d.digits, n, r, s);
+            if (half > 0 || (half == 0 && n > 0 && (d.digits[n - 1] - '0') % 2))
+            {
+                int i = n - 1;
+                while (i >= 0 && d.digits[i] == '9')
+                    d.digits[i--] = '0';
+                if (i >= 0)
+                {
+                    d.digits[i]++;
+                }
+                else
+                {
+                    // 9.99 -> 10.0: the rounded value has one more integer digit
+                    d.digits[0] = '1';
+                    n = n ? n : 1;
+                    k++;
+                }
+            }
+            d.count = n;
+            d.exp = k;
+        }
+
+        // Fewest significant digits that read back as v, a finite value >= 0 of a type with `bits` mantissa bits
+        // and smallest exponent min_exp (53 / -1074 for double): the free-format algorithm of Steele & White and
+        // Burger & Dybvig. With an even mantissa, text exactly halfway to a neighbour reads back as v.
+        inline void shortest_decimal(decimal_digits &d, double v, int bits, int min_exp)
+        {
+            d.count = 0;
+            d.exp = 0;
+            if (v == 0)
+                return;
+
+            int e2;
+            std::frexp(v, &e2);
+            e2 = e2 - bits < min_exp ? min_exp : e2 - bits;
+            uint64_t f = uint64_t(std::ldexp(v, -e2));
+            bool even = (f & 1) == 0;
+            bool lower_closer = f == uint64_t(1) << (bits - 1) && e2 > min_exp;
+
+            // v = r / s; the neighbours are (r - m_minus) / s and (r + m_plus) / s away by half a gap each
+            big_uint r(f << (lower_closer ? 2 : 1)), s(lower_closer ? 4 : 2), m_plus(lower_closer ? 2 : 1), m_minus(1);
+            if (e2 >= 0)
+            {
+                r.shift_left(e2);
+                m_plus.shift_left(e2);
+                m_minus.shift_left(e2);
+            }
+            else
+            {
+                s.shift_left(-e2);
+            }
+
+            // Scale so that (r + m_plus) / s lies in [0.1, 1); the log10 estimate is off by at most one
+            int k = int(std::floor(std::log10(v)));
+            if (k >= 0)
+            {
+                s.mul_pow10(k);
+            }
+            else
+            {
+                r.mul_pow10(-k);
+                m_plus.mul_pow10(-k);
+                m_minus.mul_pow10(-k);
+            }
+            s.mul_small(10);
+            big_uint high(r);
+            high.add(m_plus);
+            int top = high.compare(s);
+            if (even ? top >= 0 : top > 0)
+            {
+                s.mul_small(10);
+                k++;
+            }
+            else
+            {
+                high.mul_small(10);
+                top = high.compare(s);
+                if (even ? top < 0 : top <= 0)
+                {
+                    r.mul_small(10);
+                    m_plus.mul_small(10);
+                    m_minus.mul_small(10);
+                    k--;
+                }
+            }
+
+            if (s.small())
+                d.count = shortest_digit_loop(d.digits, small_uint{r.low64()}, small_uint{s.low64()},
+                                              small_uint{m_plus.low64()}, small_uint{m_minus.low64()}, even);
+            else
+                d.count = shortest_digit_loop(d.digits, r, s, m_plus, m_minus, even);
+            d.exp = k;
+        }
+
+        // Fixed notation with `precision` digits after the point
+        inline char *put_fixed(char *p, const decimal_digits &d, int precision)
+        {
+            for (int place = d.exp > 0 ? d.exp : 0; place >= 0; place--)
+                *p++ = d.at(d.exp - place);
+            if (precision > 0)
+            {
+                *p++ = '.';
+                for (int place = -1; place >= -precision; place--)
+                    *p++ = d.at(d.exp - place);
+            }
+            return p;
+        }
+
+        // Scientific notation with `precision` digits after the point, optionally without trailing zeros
+        inline char *put_exp(char *p, const decimal_digits &d, int precision, bool trim)
+        {
+            *p++ = d.at(0);
+            if (trim)
+            {
+                while (precision > 0 && d.at(precision) == '0')
+                    precision--;
+            }
+            if (precision > 0)
+            {
+                *p++ = '.';
+                for (int i = 1; i <= precision; i++)
+                    *p++ = d.at(i);
+            }
+            *p++ = 'e';
+            *p++ = d.exp < 0 ? '-' : '+';
+            unsigned ae = unsigned(d.exp < 0 ? -d.exp : d.exp);
+            if (ae >= 100)
+                *p++ = char('0' + ae / 100);
+            *p++ = char('0' + ae / 10 % 10);
+            *p++ = char('0' + ae % 10);
+            return p;
+        }
+
+        // Shortest text that reads back as the finite value v (as a float if single), laid out like %.17g:
+        // fixed notation for exponents -4 .. 16, scientific otherwise. Needs at most 25 characters.
+        inline std::size_t shortest_chars(char *buf, double v, bool single)
+        {
+            char *p = buf;
+            if (std::signbit(v))
+                *p++ = '-';
+            decimal_digits d;
+            shortest_decimal(d, std::fabs(v), single ? 24 : 53, single ? -149 : -1074);
+            int significant = d.count ? d.count : 1;
+            if (d.exp < -4 || d.exp >= 17)
+                p = put_exp(p, d, significant - 1, false);
+            else
+                p = put_fixed(p, d, significant - 1 - d.exp > 0 ? significant - 1 - d.exp : 0);
+            return std::size_t(p - buf);
+        }
+
+        template <typename Sink>
+        void format_float(Sink &out, const format_spec &spec, double v)
+        {
+            bool negative = std::signbit(v);
+            v = std::fabs(v);
+            char prefix[1];
+            std::size_t n = 0;
+            if (negative)
+                prefix[n++] = '-';
+            else if (spec.plus)
+                prefix[n++] = '+';
+            char buf[sizeof(decimal_digits::digits) + 8];
+            char *p = buf;
+            if (std::isnan(v) || std::isinf(v))
+            {
+                std::memcpy(buf, std::isnan(v) ? "nan" : "inf", 3);
+                p += 3;
+                format_spec plain = spec;
+                if (plain.align == '=')
+                {
+                    plain.align = '>';
+                    plain.fill = ' ';
+                }
+                pad(out, plain, '>', prefix, n, buf, 3);
+                return;
+            }
+            int precision = spec.precision < 0 ? 6 : spec.precision;
+            precision = precision > float_precision_limit ? float_precision_limit : precision;
+            decimal_digits d;
+            switch (spec.type)
+            {
+            case 'f':
+                round_decimal(d, v, true, precision);
+                p = put_fixed(p, d, precision);
+                break;
+            case 'e':
+                round_decimal(d, v, false, precision);
+                p = put_exp(p, d, precision, false);
+                break;
+            case 0:
+            case 'g':
+            {
+                // Like printf %g: `precision` significant digits, trailing zeros removed; the notation depends
+                // on the exponent after rounding
+                int significant = precision ? precision : 1;
+                round_decimal(d, v, false, significant - 1);
+                if (d.exp < -4 || d.exp >= significant)
+                {
+                    p = put_exp(p, d, significant - 1, true);
+                }
+                else
+                {
+                    p = put_fixed(p, d, significant - 1 - d.exp);
+                    if (std::memchr(buf, '.', std::size_t(p - buf)))
+                    {
+                        while (p[-1] == '0')
+                            p--;
+                        if (p[-1] == '.')
+                            p--;
+                    }
+                }
+                break;
+            }
+            default:
+                format_fail("format: bad type for a floating point value");
+            }
+            pad(out, spec, '>', prefix, n, buf, std::size_t(p - buf));
+        }
+
+        template <typename Sink>
+        void format_text(Sink &out, const format_spec &spec, const char *s, std::size_t n)
+        {
+            if (spec.type && spec.type != 's')
+                format_fail("format: bad type for a string");
+            if (spec.precision >= 0 && std::size_t(spec.precision) < n)
+                n = std::size_t(spec.precision);
+            pad(out, spec, '<', "", 0, s, n);
+        }
+
+        //--------------------------------
+        // Argument dispatch
+        template <typename Sink, typename T>
+        typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value && !std::is_same<T, char>::value>::type
+        format_value(Sink &out, const format_spec &spec, T v)
+        {
+            bool negative = std::is_signed<T>::value && v < 0;
+            uint64_t magnitude = negative ? uint64_t(0) - uint64_t(int64_t(v)) : uint64_t(v);
+            format_integer(out, spec, magnitude, negative);
+        }
+
+        template <typename Sink>
+        void format_value(Sink &out, const format_spec &spec, char c)
+        {
+            if (spec.type && spec.type != 'c')
+                format_integer(out, spec, uint64_t(uint8_t(c)), false);
+            else
+                pad(out, spec, '<', "", 0, &c, 1);
+        }
+
+        template <typename Sink>
+        void format_value(Sink &out, const format_spec &spec, bool b)
+        {
+            if (spec.type && spec.type != 's')
+                format_integer(out, spec, b ? 1 : 0, false);
+            else
+                format_text(out, spec, b ? "true" : "false", b ? 4 : 5);
+        }
+
+        template <typename Sink, typename T>
+        typename std::enable_if<std::is_floating_point<T>::value>::type
+        format_value(Sink &out, const format_spec &spec, T v)
+        {
+            format_float(out, spec, double(v));
+        }
+
+        template <typename Sink>
+        void format_value(Sink &out, const format_spec &spec, const char *s)
+        {
+            format_text(out, spec, s ? s : "(null)", s ? std::strlen(s) : 6);
+        }
+
+        template <typename Sink>
+        void format_value(Sink &out, const format_spec &spec, char *s)
+        {
+            format_value(out, spec, static_cast<const char *>(s));
+        }
+
+        template <typename Sink, typename Traits, typename Alloc>
+        void format_value(Sink &out, const format_spec &spec, const std::basic_string<char, Traits, Alloc> &s)
+        {
+            format_text(out, spec, s.data(), s.size());
+        }
+
+        template <typename Sink>
+        void format_value(Sink &out, const format_spec &spec, const void *p)
+        {
+            format_spec hex = spec;
+            hex.type = 'x';
+            hex.alt = true;
+            format_integer(out, hex, uint64_t(uintptr_t(p)), false);
+        }
+
+        //--------------------------------
+        template <typename Sink>
+        void format_args(Sink &out, const char *f)
+        {
+            // No arguments left: the rest must be plain text
+            for (; *f; f++)
+            {
+                if (*f == '{' || *f == '}')
+                {
+                    if (f[1] != *f)
+                        format_fail("format: more placeholders than arguments");
+                    f++;
+                }
+                out.put(*f);
+            }
+        }
+
+        // Copies text up to the next placeholder and returns a pointer to its spec (after '{' / ':')
+        template <typename Sink>
+        const char *next_placeholder(Sink &out, const char *f)
+        {
+            const char *text = f;
+            for (;;)
+            {
+                if (!*f)
+                    format_fail("format: more arguments than placeholders");
+                if (*f == '{' || *f == '}')
+                {
+                    out.write(text, std::size_t(f - text));
+                    if (f[1] == *f)
+                    {
+                        out.put(*f);
+                        f += 2;
+                        text = f;
+                        continue;
+                    }
+                    if (*f == '}')
+                        format_fail("format: unmatched '}'");
+                    f++;
+                    return *f == ':' ? f + 1 : f;
+                }
+                f++;
+            }
+        }
+
+        template <typename Sink, typename T, typename... Rest>
+        void format_args(Sink &out, const char *f, const T &first, const Rest &...rest)
+        {
+            f = next_placeholder(out, f);
+            format_spec spec;
+            f = parse_spec(f, spec);
+            format_value(out, spec, first);
+            format_args(out, f, rest...);
+        }
+
+        template <typename Sink, typename... Args>
+        void format(Sink &out, const char *f, const Args &...args)
+        {
+            format_args(out, f, args...);
+        }
+    }
+
+    ///////////////////////////////////////////////////
+    // Number of characters the output needs
+    template <typename Fmt, typename... Args>
+    std::size_t formatted_size(Fmt fmt, const Args &...args)
+    {
+        detail::counting_sink count;
+        detail::format(count, detail::format_string<Fmt, sizeof...(Args)>::get(fmt), args...);
+        return count.count;
+    }
+
+    // Append to a stdpsram::string, reserving the exact size first
+    template <typename Fmt, typename... Args>
+    void format_to(string &s, Fmt fmt, const Args &...args)
+    {
+        const char *f = detail::format_string<Fmt, sizeof...(Args)>::get(fmt);
+        detail::counting_sink count;
+        detail::format(count, f, args...);
+        s.reserve(s.size() + count.count);
+        detail::string_sink out{&s};
+        detail::format(out, f, args...);
+    }
+
+    // Write into [buf, buf + n): at most n - 1 characters plus a terminator
+    template <typename Fmt, typename... Args>
+    format_result format_to_n(char *buf, std::size_t n, Fmt fmt, const Args &...args)
+    {
+        detail::buffer_sink out{buf, n ? n - 1 : 0, 0};
+        detail::format(out, detail::format_string<Fmt, sizeof...(Args)>::get(fmt), args...);
+        if (n)
+        {
+            buf[out.count < n - 1 ? out.count : n - 1] = '\0';
+        }
+        return format_result{out.count, n == 0 || out.count > n - 1};
+    }
+
+    template <std::size_t N, typename Fmt, typename... Args>
+    format_result format_to(char (&buf)[N], Fmt fmt, const Args &...args)
+    {
+        return format_to_n(buf, N, fmt, args...);
+    }
+
+    // Write through an output iterator; returns the iterator past the output
+    template <typename OutputIt, typename Fmt, typename... Args>
+    typename std::enable_if<!std::is_same<typename std::decay<OutputIt>::type, string>::value &&
+                                !std::is_array<typename std::remove_reference<OutputIt>::type>::value,
+                            OutputIt>::type
+    format_to(OutputIt it, Fmt fmt, const Args &...args)
+    {
+        detail::iterator_sink<OutputIt> out{it};
+        detail::format(out, detail::format_string<Fmt, sizeof...(Args)>::get(fmt), args...);
+        return out.it;
+    }
+
+    // New stdpsram::string holding the output
+    template <typename Fmt, typename... Args>
+    string format(Fmt fmt, const Args &...args)
+    {
+        string s;
+        format_to(s, fmt, args...);
+        return s;
+    }
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_FORMAT_H
@@ -0,0 +1,369 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Read-only frozen maps built offline:
+// frozen_map_builder (used from a host program or a build step) compiles key/value pairs into a compact binary
+// image: a header, the keys in Eytzinger (breadth-first search tree) order and the values in the same order.
+// frozen_map is a view over such an image that looks keys up in place - no construction at boot, no PSRAM.
+// The Eytzinger layout keeps the top levels of the search tree in the same few cache lines, so lookups from
+// memory-mapped flash touch O(log n) lines with a branch-free loop.
+//
+//   // host side
+//   stdpsram::frozen_map_builder<uint32_t, Calibration> b;
+//   for (...) b.add(id, curve);
+//   b.write("calibration.bin");   // e.g. flashed to a data partition labelled "calib"
+//
+//   // device side
+//   stdpsram::frozen_image image = stdpsram::frozen_image::map_partition("calib");
+//   stdpsram::frozen_map<uint32_t, Calibration> table(image.data(), image.size());
+//   const Calibration *c = table.find(id);
+//
+// Keys and values must be trivially copyable with the same layout on the build host and the target (use
+// fixed-width types); keys need operator<. The image is native byte order (little endian on x86 and ESP32).
+
+#ifndef PAT_STDPSRAM_FROZEN_H
+#define PAT_STDPSRAM_FROZEN_H
+
+#include "PAT_stdpsram.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#if defined(ARDUINO)
+#include <esp_idf_version.h>
+#include <esp_partition.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace stdpsram
+{
+    namespace detail
+    {
+        struct frozen_header
+        {
+            uint32_t magic;
+            uint16_t format;
+            uint16_t key_size;
+            uint32_t value_size;
+            uint32_t count;
+            uint32_t keys_offset;   // from the start of the image, 8-byte aligned
+            uint32_t values_offset; // from the start of the image, 8-byte aligned
+        };
+
+        static const uint32_t frozen_magic = 0x5A525046u; // "FPRZ"
+        static const uint16_t frozen_format = 1;
+
+        inline uint32_t frozen_align(std::size_t n)
+        {
+            return uint32_t((n + 7) & ~std::size_t(7));
+        }
+    }
+
+    ///////////////////////////////////////////////////
+    // frozen_map_builder: collects pairs and emits a frozen_map image
+    template <typename Key, typename Value>
+    class frozen_map_builder
+    {
+    private:
+        static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                      "frozen_map stores raw keys and values; both must be trivially copyable");
+
+        std::vector<std::pair<Key, Value>> pairs;
+
+        // In-order walk of the implicit tree rooted at node i (1-based) assigns sorted entries to tree slots
+        static void place(const std::vector<std::pair<Key, Value>> &sorted, std::vector<std::size_t> &slot_of,
+                          std::size_t &next, std::size_t i)
+        {
+            if (i > sorted.size())
+            {
+                return;
+            }
+            place(sorted, slot_of, next, 2 * i);
+            slot_of[i - 1] = next++;
+            place(sorted, slot_of, next, 2 * i + 1);
+        }
+
+    public:
+        void add(const Key &key, const Value &value)
+        {
+            pairs.push_back(std::make_pair(key, value));
+        }
+
+        std::size_t size() const noexcept
+        {
+            return pairs.size();
+        }
+
+        // Image bytes; throws std::invalid_argument on duplicate keys
+        std::vector<uint8_t> build() const
+        {
+            std::vector<std::pair<Key, Value>> sorted(pairs);
+            std::stable_sort(sorted.begin(), sorted.end(),
+                             [](const std::pair<Key, Value> &a, const std::pair<Key, Value> &b)
+                             { return a.first < b.first; });
+            for (std::size_t i = 1; i < sorted.size(); i++)
+            {
+                if (!(sorted[i - 1].first < sorted[i].first))
+                {
+                    throw std::invalid_argument("frozen_map_builder: duplicate key");
+                }
+            }
+
+            const std::size_t n = sorted.size();
+            detail::frozen_header h;
+            h.magic = detail::frozen_magic;
+            h.format = detail::frozen_format;
+            h.key_size = uint16_t(sizeof(Key));
+            h.value_size = uint32_t(sizeof(Value));
+            h.count = uint32_t(n);
+            h.keys_offset = detail::frozen_align(sizeof(h));
+            h.values_offset = detail::frozen_align(h.keys_offset + n * sizeof(Key));
+
+            std::vector<uint8_t> image(detail::frozen_align(h.values_offset + n * sizeof(Value)), 0);
+            std::memcpy(&image[0], &h, sizeof(h));
+
+            std::vector<std::size_t> slot_of(n);
+            std::size_t next = 0;
+            place(sorted, slot_of, next, 1);
+            for (std::size_t slot = 0; slot < n; slot++)
+            {
+                const std::pair<Key, Value> &p = sorted[slot_of[slot]];
+                std::memcpy(&image[h.keys_offset + slot * sizeof(Key)], &p.first, sizeof(Key));
+                std::memcpy(&image[h.values_offset + slot * sizeof(Value)], &p.second, sizeof(Value));
+            }
+            return image;
+        }
+
+        void write(const char *path) const
+        {
+            std::vector<uint8_t> image = build();
+            FILE *f = std::fopen(path, "wb");
+            if (!f)
+            {
+                throw std::runtime_error("frozen_map_builder: cannot create file");
+            }
+            bool ok = std::fwrite(image.data(), 1, image.size(), f) == image.size();
+            ok = std::fclose(f) == 0 && ok;
+            if (!ok)
+            {
+                throw std::runtime_error("frozen_map_builder: write failed");
+            }
+        }
+    };
+
+    ///////////////////////////////////////////////////
+    // frozen_map: read-only view over an image; the image must outlive the view
+    template <typename Key, typename Value>
+    class frozen_map
+    {
+    private:
+        const Key *keys;
+        const Value *values;
+        std::size_t entries;
+
+    public:
+        // image: start of the image, at least 8-byte aligned (flash mappings and mmap are page aligned)
+        frozen_map(const void *image, std::size_t size) : keys(nullptr), values(nullptr), entries(0)
+        {
+            detail::frozen_header h;
+            if (size < sizeof(h))
+            {
+                throw std::invalid_argument("frozen_map: image too small");
+            }
+            std::memcpy(&h, image, sizeof(h));
+            if (h.magic != detail::frozen_magic || h.format != detail::frozen_format)
+            {
+                throw std::invalid_argument("frozen_map: not a frozen_map image");
+            }
+            if (h.key_size != sizeof(Key) || h.value_size != sizeof(Value))
+            {
+                throw std::invalid_argument("frozen_map: key/value sizes do not match the image");
+            }
+            if (h.keys_offset + std::size_t(h.count) * sizeof(Key) > size ||
+                h.values_offset + std::size_t(h.count) * sizeof(Value) > size)
+            {
+                throw std::invalid_argument("frozen_map: truncated image");
+            }
+            const uint8_t *base = static_cast<const uint8_t *>(image);
+            keys = reinterpret_cast<const Key *>(base + h.keys_offset);
+            values = reinterpret_cast<const Value *>(base + h.values_offset);
+            entries = h.count;
+        }
+
+        // Pointer to the value stored for key, or nullptr
+        const Value *find(const Key &key) const
+        {
+            // Descend the implicit tree; the path encodes the lower bound in the bits of k
+            std::size_t k = 1;
+            while (k <= entries)
+            {
+                k = 2 * k + (keys[k - 1] < key ? 1 : 0);
+            }
+            // Drop the trailing right turns and the last left turn
+            while (k & 1)
+            {
+                k >>= 1;
+            }
+            k >>= 1;
+            if (k == 0 || key < keys[k - 1])
+            {
+                return nullptr;
+            }
+            return &values[k - 1];
+        }
+
+        std::size_t count(const Key &key) const
+        {
+            return find(key) ? 1 : 0;
+        }
+
+        const Value &at(const Key &key) const
+        {
+            const Value *v = find(key);
+            if (!v)
+            {
+                throw std::out_of_range("frozen_map::at");
+            }
+            return *v;
+        }
+
+        // Entries in storage (Eytzinger) order, for iteration
+        const Key &key_at(std::size_t i) const { return keys[i]; }
+        const Value &value_at(std::size_t i) const { return values[i]; }
+
+        std::size_t size() const noexcept { return entries; }
+        bool empty() const noexcept { return entries == 0; }
+    };
+
+    ///////////////////////////////////////////////////
+    // frozen_image: read-only mapping of an image - a flash data partition on ESP32, a file on host
+    class frozen_image
+    {
+    private:
+        const void *ptr;
+        std::size_t length;
+#if defined(ARDUINO)
+#if ESP_IDF_VERSION_MAJOR >= 5
+        esp_partition_mmap_handle_t handle;
+#else
+        spi_flash_mmap_handle_t handle;
+#endif
+#endif
+
+        frozen_image() : ptr(nullptr), length(0) {}
+
+        void release()
+        {
+            if (!ptr)
+            {
+                return;
+            }
+#if defined(ARDUINO)
+#if ESP_IDF_VERSION_MAJOR >= 5
+            esp_partition_munmap(handle);
+#else
+            spi_flash_munmap(handle);
+#endif
+#else
+            ::munmap(const_cast<void *>(ptr), length);
+#endif
+            ptr = nullptr;
+        }
+
+    public:
+#if defined(ARDUINO)
+        // Map a whole data partition (by label) into the flash cache address space
+        static frozen_image map_partition(const char *label)
+        {
+            const esp_partition_t *part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+            if (!part)
+            {
+                throw std::runtime_error("frozen_image: partition not found");
+            }
+            frozen_image image;
+#if ESP_IDF_VERSION_MAJOR >= 5
+            esp_err_t err = esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &image.ptr, &image.handle);
+#else
+            esp_err_t err = esp_partition_mmap(part, 0, part->size, SPI_FLASH_MMAP_DATA, &image.ptr, &image.handle);
+#endif
+            if (err != ESP_OK)
+            {
+                image.ptr = nullptr;
+                throw std::runtime_error("frozen_image: cannot map partition");
+            }
+            image.length = part->size;
+            return image;
+        }
+#else
+        // Map a file read-only
+        static frozen_image map_file(const char *path)
+        {
+            int fd = ::open(path, O_RDONLY);
+            if (fd < 0)
+            {
+                throw std::runtime_error("frozen_image: cannot open file");
+            }
+            struct stat st;
+            void *p = MAP_FAILED;
+            if (::fstat(fd, &st) == 0 && st.st_size > 0)
+            {
+                p = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+            }
+            ::close(fd);
+            if (p == MAP_FAILED)
+            {
+                throw std::runtime_error("frozen_image: cannot map file");
+            }
+            frozen_image image;
+            image.ptr = p;
+            image.length = std::size_t(st.st_size);
+            return image;
+        }
+#endif
+
+        frozen_image(frozen_image &&other) noexcept : ptr(other.ptr), length(other.length)
+        {
+#if defined(ARDUINO)
+            handle = other.handle;
+#endif
+            other.ptr = nullptr;
+        }
+
+        frozen_image &operator=(frozen_image &&other) noexcept
+        {
+            if (this != &other)
+            {
+                release();
+                ptr = other.ptr;
+                length = other.length;
+#if defined(ARDUINO)
+                handle = other.handle;
+#endif
+                other.ptr = nullptr;
+            }
+            return *this;
+        }
+
+        frozen_image(const frozen_image &) = delete;
+        frozen_image &operator=(const frozen_image &) = delete;
+
+        ~frozen_image()
+        {
+            release();
+        }
+
+        const void *data() const noexcept { return ptr; }
+        std::size_t size() const noexcept { return length; }
+    };
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_FROZEN_H
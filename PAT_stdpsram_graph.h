@@ -0,0 +1,360 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Compressed sparse row graph:
+// A stdpsram::map<int, stdpsram::list<int>> adjacency costs a node allocation per edge and a pointer chase per
+// step. csr_graph keeps one offset array and one neighbour array (plus weights) in PSRAM, so the edges of a
+// node are contiguous and a traversal streams through them. graph_search holds the per-query scratch (distances,
+// parents, queue / heap) in internal SRAM and is reused between queries, so route recomputation allocates
+// nothing.
+//
+//   stdpsram::csr_graph_builder b(node_count);
+//   b.add_edge(0, 1, 5);                       // directed, weight 5
+//   b.add_undirected(1, 2);                    // both directions, weight 1
+//   stdpsram::csr_graph g = b.build();
+//
+//   stdpsram::graph_search q(g.nodes());       // SRAM: 16 bytes per node
+//   q.dijkstra(g, 0);                          // or q.bfs(g, 0) for hop counts
+//   if (q.reached(2)) { uint32_t d = q.distance(2); uint32_t hop = q.parent(2); }
+//
+// Node ids are dense 0 .. nodes() - 1. Dijkstra needs an unsigned integer Weight. With a target, a query stops
+// as soon as the target is settled: its distance and path are final, but other nodes may be unreached or (for
+// dijkstra) hold tentative distances, so do not read them after a targeted query.
+
+#ifndef PAT_STDPSRAM_GRAPH_H
+#define PAT_STDPSRAM_GRAPH_H
+
+#include "PAT_stdpsram.h"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace stdpsram
+{
+    ///////////////////////////////////////////////////
+    // csr_graph: immutable adjacency in two (three, with weights) contiguous PSRAM arrays
+    template <typename Weight = uint32_t>
+    class basic_csr_graph
+    {
+    private:
+        vector<uint32_t> offsets; // nodes + 1 entries; edges of u are [offsets[u], offsets[u + 1])
+        vector<uint32_t> targets;
+        vector<Weight> weights;
+
+    public:
+        typedef Weight weight_type;
+
+        // Contiguous view of one node's edges
+        struct edge_range
+        {
+            const uint32_t *first;
+            const uint32_t *last;
+            const Weight *weight;
+
+            const uint32_t *begin() const { return first; }
+            const uint32_t *end() const { return last; }
+            std::size_t size() const { return std::size_t(last - first); }
+        };
+
+        basic_csr_graph() : offsets(1, 0) {}
+
+        basic_csr_graph(vector<uint32_t> &&offsets, vector<uint32_t> &&targets, vector<Weight> &&weights)
+            : offsets(std::move(offsets)), targets(std::move(targets)), weights(std::move(weights))
+        {
+            if (this->offsets.empty() || this->offsets.back() != this->targets.size() || this->weights.size() != this->targets.size())
+            {
+                throw std::invalid_argument("csr_graph: inconsistent arrays");
+            }
+        }
+
+        std::size_t nodes() const noexcept { return offsets.size() - 1; }
+        std::size_t edges() const noexcept { return targets.size(); }
+        std::size_t degree(uint32_t u) const { return offsets[u + 1] - offsets[u]; }
+
+        edge_range neighbours(uint32_t u) const
+        {
+            const uint32_t *t = targets.data();
+            return edge_range{t + offsets[u], t + offsets[u + 1], weights.data() + offsets[u]};
+        }
+
+        std::size_t bytes() const noexcept
+        {
+            return offsets.capacity() * sizeof(uint32_t) + targets.capacity() * sizeof(uint32_t) + weights.capacity() * sizeof(Weight);
+        }
+
+        const vector<uint32_t> &edge_offsets() const noexcept { return offsets; }
+        const vector<uint32_t> &edge_targets() const noexcept { return targets; }
+        const vector<Weight> &edge_weights() const noexcept { return weights; }
+    };
+
+    typedef basic_csr_graph<uint32_t> csr_graph;
+
+    ///////////////////////////////////////////////////
+    // csr_graph_builder: collects an edge list, then sorts it into CSR form
+    template <typename Weight = uint32_t>
+    class basic_csr_graph_builder
+    {
+    private:
+        std::size_t n;
+        vector<uint32_t> from;
+        vector<uint32_t> to;
+        vector<Weight> weight;
+
+    public:
+        explicit basic_csr_graph_builder(std::size_t nodes) : n(nodes)
+        {
+            if (nodes >= 0xFFFFFFFFu)
+            {
+                throw std::length_error("csr_graph_builder: too many nodes");
+            }
+        }
+
+        void reserve(std::size_t edges)
+        {
+            from.reserve(edges);
+            to.reserve(edges);
+            weight.reserve(edges);
+        }
+
+        void add_edge(uint32_t u, uint32_t v, Weight w = Weight(1))
+        {
+            if (u >= n || v >= n)
+            {
+                throw std::out_of_range("csr_graph_builder::add_edge");
+            }
+            from.push_back(u);
+            to.push_back(v);
+            weight.push_back(w);
+        }
+
+        void add_undirected(uint32_t u, uint32_t v, Weight w = Weight(1))
+        {
+            add_edge(u, v, w);
+            add_edge(v, u, w);
+        }
+
+        std::size_t edges() const noexcept { return to.size(); }
+
+        // Counting sort by source; edges of a node keep their insertion order. The builder is emptied.
+        basic_csr_graph<Weight> build()
+        {
+            if (to.size() >= 0xFFFFFFFFu)
+            {
+                throw std::length_error("csr_graph_builder: too many edges");
+            }
+            vector<uint32_t> offsets(n + 1, 0);
+            for (uint32_t u : from)
+                offsets[u + 1]++;
+            for (std::size_t u = 0; u < n; u++)
+                offsets[u + 1] += offsets[u];
+
+            vector<uint32_t> targets(to.size());
+            vector<Weight> weights(to.size());
+            {
+                vector<uint32_t> next(offsets.begin(), offsets.end() - 1);
+                for (std::size_t e = 0; e < to.size(); e++)
+                {
+                    uint32_t slot = next[from[e]]++;
+                    targets[slot] = to[e];
+                    weights[slot] = weight[e];
+                }
+            }
+            from = vector<uint32_t>();
+            to = vector<uint32_t>();
+            weight = vector<Weight>();
+            return basic_csr_graph<Weight>(std::move(offsets), std::move(targets), std::move(weights));
+        }
+    };
+
+    typedef basic_csr_graph_builder<uint32_t> csr_graph_builder;
+
+    ///////////////////////////////////////////////////
+    // graph_search: BFS / Dijkstra with reusable SRAM scratch
+    class graph_search
+    {
+    public:
+        enum : uint32_t
+        {
+            unreached = 0xFFFFFFFFu // distance / parent of nodes the last query did not reach
+        };
+
+    private:
+        template <typename T>
+        using sram_vector = std::vector<T, SRAMAllocator<T>>;
+
+        sram_vector<uint32_t> dist;
+        sram_vector<uint32_t> prev;
+        sram_vector<uint32_t> work; // BFS queue, or Dijkstra heap of nodes
+        sram_vector<uint32_t> slot; // Dijkstra: position of a node in the heap (unreached if not queued)
+        std::size_t heap_size;
+
+        void reset(std::size_t n, bool heap)
+        {
+            if (dist.size() < n)
+            {
+                dist.resize(n);
+                prev.resize(n);
+                work.resize(n);
+            }
+            std::fill(dist.begin(), dist.begin() + n, unreached);
+            std::fill(prev.begin(), prev.begin() + n, unreached);
+            if (heap)
+            {
+                slot.resize(dist.size());
+                std::fill(slot.begin(), slot.begin() + n, unreached);
+            }
+            heap_size = 0;
+        }
+
+        // Indexed binary min-heap keyed by dist[], supporting decrease-key
+        void sift_up(std::size_t i)
+        {
+            uint32_t node = work[i];
+            while (i > 0)
+            {
+                std::size_t parent = (i - 1) / 2;
+                if (dist[work[parent]] <= dist[node])
+                    break;
+                work[i] = work[parent];
+                slot[work[i]] = uint32_t(i);
+                i = parent;
+            }
+            work[i] = node;
+            slot[node] = uint32_t(i);
+        }
+
+        void sift_down(std::size_t i)
+        {
+            uint32_t node = work[i];
+            for (;;)
+            {
+                std::size_t child = 2 * i + 1;
+                if (child >= heap_size)
+                    break;
+                if (child + 1 < heap_size && dist[work[child + 1]] < dist[work[child]])
+                    child++;
+                if (dist[work[child]] >= dist[node])
+                    break;
+                work[i] = work[child];
+                slot[work[i]] = uint32_t(i);
+                i = child;
+            }
+            work[i] = node;
+            slot[node] = uint32_t(i);
+        }
+
+        uint32_t pop_min()
+        {
+            uint32_t top = work[0];
+            slot[top] = unreached;
+            if (--heap_size)
+            {
+                work[0] = work[heap_size];
+                sift_down(0);
+            }
+            return top;
+        }
+
+    public:
+        explicit graph_search(std::size_t nodes = 0) : heap_size(0)
+        {
+            dist.reserve(nodes);
+        }
+
+        // Hop counts from source; stops early once target (if given) is reached. After an early exit only the
+        // target's distance and path are meaningful: nodes beyond the frontier still read as unreached.
+        template <typename Weight>
+        void bfs(const basic_csr_graph<Weight> &g, uint32_t source, uint32_t target = unreached)
+        {
+            reset(g.nodes(), false);
+            std::size_t head = 0, tail = 0;
+            dist[source] = 0;
+            work[tail++] = source;
+            while (head < tail)
+            {
+                uint32_t u = work[head++];
+                if (u == target)
+                    return;
+                uint32_t next = dist[u] + 1;
+                for (uint32_t v : g.neighbours(u))
+                {
+                    if (dist[v] == unreached)
+                    {
+                        dist[v] = next;
+                        prev[v] = u;
+                        work[tail++] = v;
+                    }
+                }
+            }
+        }
+
+        // Shortest weighted distances from source; early exit at target. After an early exit only the target's
+        // distance and path are final: nodes still queued hold tentative distances, others read as unreached.
+        template <typename Weight>
+        void dijkstra(const basic_csr_graph<Weight> &g, uint32_t source, uint32_t target = unreached)
+        {
+            static_assert(std::is_integral<Weight>::value && std::is_unsigned<Weight>::value,
+                          "dijkstra: Weight must be an unsigned integer type (distances are summed as uint64_t)");
+            reset(g.nodes(), true);
+            dist[source] = 0;
+            work[0] = source;
+            slot[source] = 0;
+            heap_size = 1;
+            while (heap_size)
+            {
+                uint32_t u = pop_min();
+                if (u == target)
+                    return;
+                typename basic_csr_graph<Weight>::edge_range edges = g.neighbours(u);
+                for (std::size_t e = 0; e < edges.size(); e++)
+                {
+                    uint32_t v = edges.first[e];
+                    uint64_t d = uint64_t(dist[u]) + uint64_t(edges.weight[e]);
+                    if (d >= dist[v])
+                        continue;
+                    dist[v] = uint32_t(d);
+                    prev[v] = u;
+                    if (slot[v] == unreached)
+                    {
+                        work[heap_size] = v;
+                        sift_up(heap_size++);
+                    }
+                    else
+                    {
+                        sift_up(slot[v]);
+                    }
+                }
+            }
+        }
+
+        //--------------------------------
+        // Results of the last query
+        bool reached(uint32_t v) const { return dist[v] != unreached; }
+        uint32_t distance(uint32_t v) const { return dist[v]; }
+        uint32_t parent(uint32_t v) const { return prev[v]; }
+
+        // Nodes from the source to v (empty if unreached); returns the hop count
+        template <typename Out>
+        std::size_t path(uint32_t v, Out &out) const
+        {
+            out.clear();
+            if (!reached(v))
+                return 0;
+            for (uint32_t u = v; u != unreached; u = prev[u])
+                out.push_back(u);
+            std::reverse(out.begin(), out.end());
+            return out.size() - 1;
+        }
+
+        // SRAM held by the scratch arrays
+        std::size_t bytes() const noexcept
+        {
+            return (dist.capacity() + prev.capacity() + work.capacity() + slot.capacity()) * sizeof(uint32_t);
+        }
+    };
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_GRAPH_H
@@ -0,0 +1,405 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Compacting PSRAM heap:
+// Objects live in a single PSRAM arena and are reached through handles instead of raw pointers, so the heap
+// is free to slide live blocks together and recover large free blocks on long-running devices. Raw access is
+// only valid while a block is pinned; pinned blocks are never moved by the compactor.
+//
+// Typical use:
+//   stdpsram::compacting_heap heap(512 * 1024);
+//   auto h = heap.allocate(sizeof(Sample) * 64);
+//   {
+//       stdpsram::pinned<Sample> samples(heap, h);
+//       samples[0].value = 42;
+//   }
+//   // in loop() / idle task:
+//   heap.compact_step(4096);
+
+#ifndef PAT_STDPSRAM_HEAP_H
+#define PAT_STDPSRAM_HEAP_H
+
+#include "PAT_stdpsram.h"
+#include "PAT_stdpsram_memory.h"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+namespace stdpsram
+{
+    ///////////////////////////////////////////////////
+    // compacting_heap: movable-object heap in a single PSRAM arena
+    class compacting_heap
+    {
+    public:
+        // Handle to a block; stays valid across compaction until the block is deallocated
+        struct handle
+        {
+            uint32_t index;
+            uint32_t generation;
+
+            bool valid() const noexcept
+            {
+                return index != invalid_index;
+            }
+        };
+
+        static constexpr uint32_t invalid_index = 0xFFFFFFFFu;
+        static constexpr std::size_t alignment = 8;
+
+        explicit compacting_heap(std::size_t capacity)
+            : arena(nullptr), arena_size(align_up(capacity)), cursor(0)
+        {
+            if (arena_size < header_size * 2)
+            {
+                throw std::invalid_argument("compacting_heap: capacity too small");
+            }
+            arena = PSRAMAllocator<uint8_t>().allocate(arena_size);
+            write_header(0, static_cast<uint32_t>(arena_size), free_slot);
+        }
+
+        ~compacting_heap()
+        {
+            PSRAMAllocator<uint8_t>().deallocate(arena, arena_size);
+        }
+
+        compacting_heap(const compacting_heap &) = delete;
+        compacting_heap &operator=(const compacting_heap &) = delete;
+
+        //--------------------------------
+        // Allocate a block of at least size bytes. Runs a full compaction before giving up.
+        handle allocate(std::size_t size)
+        {
+            if (size > arena_size)
+            {
+                throw std::bad_alloc();
+            }
+            uint32_t need = static_cast<uint32_t>(align_up(size + header_size));
+            uint32_t offset = find_fit(need);
+            if (offset == invalid_index)
+            {
+                compact();
+                offset = find_fit(need);
+                if (offset == invalid_index)
+                {
+                    throw std::bad_alloc();
+                }
+            }
+
+            uint32_t index;
+            if (!free_slots.empty())
+            {
+                index = free_slots.back();
+                free_slots.pop_back();
+            }
+            else
+            {
+                index = static_cast<uint32_t>(slots.size());
+                slots.push_back(slot{0, 0, 0, 0});
+            }
+            slot &s = slots[index];
+            s.offset = offset;
+            s.size = static_cast<uint32_t>(size);
+            s.pins = 0;
+            split_block(offset, need, index);
+            cursor = 0; // the block layout changed; the compactor's resume point may no longer be a header
+            return handle{index, s.generation};
+        }
+
+        //--------------------------------
+        // Release a block; the handle (and any copy of it) becomes stale
+        void deallocate(handle h)
+        {
+            slot &s = checked_slot(h);
+            if (s.pins != 0)
+            {
+                throw std::logic_error("compacting_heap: deallocating a pinned block");
+            }
+            header_at(s.offset).slot = free_slot;
+            merge_free(s.offset);
+            cursor = 0;
+            s.generation++;
+            free_slots.push_back(h.index);
+        }
+
+        //--------------------------------
+        // Pin a block and return its current address. The address is stable until the matching unpin().
+        void *pin(handle h)
+        {
+            slot &s = checked_slot(h);
+            s.pins++;
+            return arena + s.offset + header_size;
+        }
+
+        void unpin(handle h)
+        {
+            slot &s = checked_slot(h);
+            if (s.pins == 0)
+            {
+                throw std::logic_error("compacting_heap: unbalanced unpin");
+            }
+            s.pins--;
+        }
+
+        // Requested size of the block behind h
+        std::size_t size(handle h) const
+        {
+            return checked_slot(h).size;
+        }
+
+        //--------------------------------
+        // Incremental compaction: slides live, unpinned blocks towards the start of the arena, moving at most
+        // roughly max_bytes per call. Returns true while there is more work to do; call it from idle time.
+        // allocate() and deallocate() restart the walk from the start of the arena.
+        bool compact_step(std::size_t max_bytes)
+        {
+            std::size_t moved = 0;
+            while (true)
+            {
+                uint32_t hole = next_free(cursor);
+                if (hole == invalid_index)
+                {
+                    cursor = 0;
+                    return false;
+                }
+                merge_free(hole);
+                uint32_t hole_size = header_at(hole).size;
+                uint32_t next = hole + hole_size;
+                if (next >= arena_size)
+                {
+                    cursor = 0;
+                    return false;
+                }
+
+                block_header &blk = header_at(next);
+                slot &s = slots[blk.slot];
+                if (s.pins != 0)
+                {
+                    // Pinned blocks are barriers; the hole in front of them stays until they are unpinned
+                    cursor = next + blk.size;
+                    continue;
+                }
+
+                if (moved != 0 && moved + blk.size > max_bytes)
+                {
+                    cursor = hole;
+                    return true;
+                }
+
+                uint32_t block_size = blk.size;
+                uint32_t owner = blk.slot;
+                stdpsram::memmove(arena + hole, arena + next, block_size);
+                write_header(hole + block_size, hole_size, free_slot);
+                merge_free(hole + block_size);
+                slots[owner].offset = hole;
+                moved += block_size;
+                cursor = hole + block_size;
+            }
+        }
+
+        // Run compaction to completion
+        void compact()
+        {
+            cursor = 0;
+            while (compact_step(arena_size))
+            {
+            }
+        }
+
+        //--------------------------------
+        std::size_t capacity() const noexcept
+        {
+            return arena_size;
+        }
+
+        // Total free bytes, including block headers of free blocks
+        std::size_t free_bytes() const noexcept
+        {
+            std::size_t total = 0;
+            for (uint32_t offset = 0; offset < arena_size; offset += header_at(offset).size)
+            {
+                if (header_at(offset).slot == free_slot)
+                {
+                    total += header_at(offset).size;
+                }
+            }
+            return total;
+        }
+
+        // Largest payload that can currently be allocated without compaction
+        std::size_t largest_free_block() const noexcept
+        {
+            std::size_t best = 0;
+            std::size_t run = 0;
+            for (uint32_t offset = 0; offset < arena_size; offset += header_at(offset).size)
+            {
+                if (header_at(offset).slot == free_slot)
+                {
+                    run += header_at(offset).size;
+                    if (run > best)
+                    {
+                        best = run;
+                    }
+                }
+                else
+                {
+                    run = 0;
+                }
+            }
+            return best > header_size ? best - header_size : 0;
+        }
+
+    private:
+        struct block_header
+        {
+            uint32_t size; // total block size including this header
+            uint32_t slot; // owning slot index, or free_slot
+        };
+
+        struct slot
+        {
+            uint32_t offset;
+            uint32_t size;
+            uint32_t generation;
+            uint32_t pins;
+        };
+
+        static constexpr uint32_t free_slot = 0xFFFFFFFFu;
+        static constexpr uint32_t header_size = static_cast<uint32_t>(
+            (sizeof(block_header) + alignment - 1) & ~(alignment - 1));
+
+        uint8_t *arena;
+        std::size_t arena_size;
+        uint32_t cursor;
+        vector<slot> slots;
+        vector<uint32_t> free_slots;
+
+        static std::size_t align_up(std::size_t n) noexcept
+        {
+            return (n + alignment - 1) & ~(alignment - 1);
+        }
+
+        block_header &header_at(uint32_t offset) noexcept
+        {
+            return *reinterpret_cast<block_header *>(arena + offset);
+        }
+
+        const block_header &header_at(uint32_t offset) const noexcept
+        {
+            return *reinterpret_cast<const block_header *>(arena + offset);
+        }
+
+        void write_header(uint32_t offset, uint32_t size, uint32_t owner) noexcept
+        {
+            block_header &h = header_at(offset);
+            h.size = size;
+            h.slot = owner;
+        }
+
+        slot &checked_slot(handle h)
+        {
+            if (h.index >= slots.size() || slots[h.index].generation != h.generation)
+            {
+                throw std::invalid_argument("compacting_heap: stale or invalid handle");
+            }
+            return slots[h.index];
+        }
+
+        const slot &checked_slot(handle h) const
+        {
+            return const_cast<compacting_heap *>(this)->checked_slot(h);
+        }
+
+        // Absorb all free blocks directly following the free block at offset
+        void merge_free(uint32_t offset) noexcept
+        {
+            block_header &h = header_at(offset);
+            uint32_t next = offset + h.size;
+            while (next < arena_size && header_at(next).slot == free_slot)
+            {
+                h.size += header_at(next).size;
+                next = offset + h.size;
+            }
+        }
+
+        uint32_t next_free(uint32_t from) const noexcept
+        {
+            for (uint32_t offset = from; offset < arena_size; offset += header_at(offset).size)
+            {
+                if (header_at(offset).slot == free_slot)
+                {
+                    return offset;
+                }
+            }
+            return invalid_index;
+        }
+
+        // First fit, coalescing free neighbours on the way
+        uint32_t find_fit(uint32_t need) noexcept
+        {
+            for (uint32_t offset = 0; offset < arena_size; offset += header_at(offset).size)
+            {
+                if (header_at(offset).slot == free_slot)
+                {
+                    merge_free(offset);
+                    if (header_at(offset).size >= need)
+                    {
+                        return offset;
+                    }
+                }
+            }
+            return invalid_index;
+        }
+
+        void split_block(uint32_t offset, uint32_t need, uint32_t owner) noexcept
+        {
+            uint32_t total = header_at(offset).size;
+            if (total - need >= header_size + alignment)
+            {
+                write_header(offset, need, owner);
+                write_header(offset + need, total - need, free_slot);
+            }
+            else
+            {
+                write_header(offset, total, owner);
+            }
+        }
+    };
+
+    ///////////////////////////////////////////////////
+    // pinned: RAII pin of a compacting_heap block, typed as T (or an array of T)
+    template <typename T>
+    class pinned
+    {
+    private:
+        compacting_heap &heap;
+        compacting_heap::handle h;
+        T *object;
+
+    public:
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "compacting_heap relocates blocks with memmove; T must be trivially copyable");
+
+        pinned(compacting_heap &heap, compacting_heap::handle h)
+            : heap(heap), h(h), object(static_cast<T *>(heap.pin(h))) {}
+
+        ~pinned()
+        {
+            heap.unpin(h);
+        }
+
+        pinned(const pinned &) = delete;
+        pinned &operator=(const pinned &) = delete;
+
+        T &operator*() const { return *object; }
+        T *operator->() const { return object; }
+        T &operator[](std::size_t i) const { return object[i]; }
+        T *get() const { return object; }
+
+        // Number of T elements that fit in the block
+        std::size_t count() const { return heap.size(h) / sizeof(T); }
+    };
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_HEAP_H
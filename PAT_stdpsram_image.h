@@ -0,0 +1,417 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Tiled image container for camera and display frames:
+// A row-major frame in PSRAM is fine for scanning rows but every column step lands on a different cache line,
+// so rotation, 8x8 JPEG blocks and vertical filters thrash the PSRAM cache. stdpsram::image stores the frame as
+// TileW x TileH tiles, each contiguous in PSRAM (the default 32x8 RGB565 tile is 512 bytes, i.e. whole cache
+// lines), so any small 2D neighbourhood touches only a few lines.
+//
+//   stdpsram::image<uint16_t> frame(320, 240);          // 32x8 tiles
+//   frame.from_linear(fb->buf);                          // camera frame buffer (row-major)
+//   frame(10, 20) = 0xF800;
+//   for (uint16_t &p : frame.row(5)) { ... }             // row iterator steps across tiles
+//   frame.for_each_tile([](stdpsram::image<uint16_t>::tile t) { ... });
+//   stdpsram::image<uint16_t> turned = stdpsram::rotate90(frame);
+//   turned.to_linear(dma_buf, 0, 16);                    // 16-row strip, row-major, for the display DMA
+//   stdpsram::image<uint16_t> soft = stdpsram::box_blur_rgb565(frame, 2);   // 5x5 mean
+//
+// Tile sizes must be powers of two. Pixels outside width x height (padding of the edge tiles) exist but are
+// not part of the image.
+
+#ifndef PAT_STDPSRAM_IMAGE_H
+#define PAT_STDPSRAM_IMAGE_H
+
+#include "PAT_stdpsram.h"
+#include "PAT_stdpsram_memory.h"
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+#ifndef STDPSRAM_TILE_W
+#define STDPSRAM_TILE_W 32 // default tile width in pixels
+#endif
+
+#ifndef STDPSRAM_TILE_H
+#define STDPSRAM_TILE_H 8 // default tile height in pixels
+#endif
+
+namespace stdpsram
+{
+    ///////////////////////////////////////////////////
+    // image: 2D pixel container with a tiled PSRAM layout
+    template <typename Pixel, unsigned TileW = STDPSRAM_TILE_W, unsigned TileH = STDPSRAM_TILE_H>
+    class image
+    {
+    private:
+        static_assert(std::is_trivially_copyable<Pixel>::value, "image: Pixel must be trivially copyable");
+        static_assert(TileW && !(TileW & (TileW - 1)) && TileH && !(TileH & (TileH - 1)), "image: tile sizes must be powers of two");
+
+        static const std::size_t tile_pixels = std::size_t(TileW) * TileH;
+
+        std::size_t w;
+        std::size_t h;
+        std::size_t tiles_x;
+        std::size_t tiles_y;
+        vector<Pixel> pixels;
+
+        std::size_t index(std::size_t x, std::size_t y) const noexcept
+        {
+            return ((y / TileH) * tiles_x + x / TileW) * tile_pixels + (y % TileH) * TileW + x % TileW;
+        }
+
+    public:
+        typedef Pixel value_type;
+        static const unsigned tile_width = TileW;
+        static const unsigned tile_height = TileH;
+
+        // One tile: TileW x TileH contiguous pixels; w/h are the part inside the image
+        template <typename P>
+        struct basic_tile
+        {
+            std::size_t x0;
+            std::size_t y0;
+            std::size_t w;
+            std::size_t h;
+            P *data;
+
+            P &operator()(std::size_t x, std::size_t y) const { return data[y * TileW + x]; }
+        };
+
+        typedef basic_tile<Pixel> tile;
+        typedef basic_tile<const Pixel> const_tile;
+
+        //--------------------------------
+        // Pixels of one row: contiguous runs of TileW, one tile apart
+        class row_iterator
+        {
+        private:
+            Pixel *base;     // first pixel of the row
+            std::size_t off; // offset of the current pixel from base
+            std::size_t x;
+
+        public:
+            typedef std::forward_iterator_tag iterator_category;
+            typedef Pixel value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef Pixel *pointer;
+            typedef Pixel &reference;
+
+            row_iterator(Pixel *base, std::size_t x) : base(base), off(0), x(x) {}
+
+            Pixel &operator*() const { return base[off]; }
+            Pixel *operator->() const { return base + off; }
+
+            row_iterator &operator++()
+            {
+                ++x;
+                off += (x % TileW) ? 1 : tile_pixels - TileW + 1;
+                return *this;
+            }
+
+            row_iterator operator++(int)
+            {
+                row_iterator old = *this;
+                ++*this;
+                return old;
+            }
+
+            bool operator==(const row_iterator &o) const { return x == o.x; }
+            bool operator!=(const row_iterator &o) const { return x != o.x; }
+        };
+
+        class row_range
+        {
+        private:
+            row_iterator first;
+            row_iterator last;
+
+        public:
+            row_range(row_iterator first, row_iterator last) : first(first), last(last) {}
+            row_iterator begin() const { return first; }
+            row_iterator end() const { return last; }
+        };
+
+        //--------------------------------
+        image() : w(0), h(0), tiles_x(0), tiles_y(0) {}
+
+        image(std::size_t width, std::size_t height, const Pixel &fill = Pixel())
+            : w(width), h(height), tiles_x((width + TileW - 1) / TileW), tiles_y((height + TileH - 1) / TileH),
+              pixels(tiles_x * tiles_y * tile_pixels, fill)
+        {
+        }
+
+        std::size_t width() const noexcept { return w; }
+        std::size_t height() const noexcept { return h; }
+        std::size_t tiles_across() const noexcept { return tiles_x; }
+        std::size_t tiles_down() const noexcept { return tiles_y; }
+        std::size_t bytes() const noexcept { return pixels.size() * sizeof(Pixel); }
+
+        Pixel &operator()(std::size_t x, std::size_t y) { return pixels[index(x, y)]; }
+        const Pixel &operator()(std::size_t x, std::size_t y) const { return pixels[index(x, y)]; }
+
+        Pixel &at(std::size_t x, std::size_t y)
+        {
+            if (x >= w || y >= h)
+            {
+                throw std::out_of_range("image::at");
+            }
+            return pixels[index(x, y)];
+        }
+
+        const Pixel &at(std::size_t x, std::size_t y) const
+        {
+            return const_cast<image *>(this)->at(x, y);
+        }
+
+        void fill(const Pixel &value)
+        {
+            std::fill(pixels.begin(), pixels.end(), value);
+        }
+
+        //--------------------------------
+        row_range row(std::size_t y)
+        {
+            Pixel *first = pixels.data() + index(0, y);
+            return row_range(row_iterator(first, 0), row_iterator(nullptr, w));
+        }
+
+        tile tile_at(std::size_t tx, std::size_t ty)
+        {
+            std::size_t x0 = tx * TileW;
+            std::size_t y0 = ty * TileH;
+            return tile{x0, y0, std::min<std::size_t>(TileW, w - x0), std::min<std::size_t>(TileH, h - y0),
+                        pixels.data() + (ty * tiles_x + tx) * tile_pixels};
+        }
+
+        const_tile tile_at(std::size_t tx, std::size_t ty) const
+        {
+            tile t = const_cast<image *>(this)->tile_at(tx, ty);
+            return const_tile{t.x0, t.y0, t.w, t.h, t.data};
+        }
+
+        // f(tile) for every tile, in memory order
+        template <typename F>
+        void for_each_tile(F f)
+        {
+            for (std::size_t ty = 0; ty < tiles_y; ty++)
+            {
+                for (std::size_t tx = 0; tx < tiles_x; tx++)
+                {
+                    f(tile_at(tx, ty));
+                }
+            }
+        }
+
+        // f(const_tile) for every tile, in memory order
+        template <typename F>
+        void for_each_tile(F f) const
+        {
+            for (std::size_t ty = 0; ty < tiles_y; ty++)
+            {
+                for (std::size_t tx = 0; tx < tiles_x; tx++)
+                {
+                    f(tile_at(tx, ty));
+                }
+            }
+        }
+
+        //--------------------------------
+        // Rows y0 .. y0 + rows - 1 to a row-major buffer (stride in pixels, default: width)
+        void to_linear(Pixel *dst, std::size_t y0 = 0, std::size_t rows = std::size_t(-1), std::size_t stride = 0) const
+        {
+            stride = stride ? stride : w;
+            std::size_t y1 = rows > h - y0 ? h : y0 + rows;
+            for (std::size_t y = y0; y < y1; y++)
+            {
+                Pixel *out = dst + (y - y0) * stride;
+                const Pixel *in = pixels.data() + index(0, y);
+                for (std::size_t x = 0; x < w; x += TileW, in += tile_pixels)
+                {
+                    stdpsram::memcpy(out + x, in, std::min<std::size_t>(TileW, w - x) * sizeof(Pixel));
+                }
+            }
+        }
+
+        // Rows y0 .. y0 + rows - 1 from a row-major buffer
+        void from_linear(const Pixel *src, std::size_t y0 = 0, std::size_t rows = std::size_t(-1), std::size_t stride = 0)
+        {
+            stride = stride ? stride : w;
+            std::size_t y1 = rows > h - y0 ? h : y0 + rows;
+            for (std::size_t y = y0; y < y1; y++)
+            {
+                const Pixel *in = src + (y - y0) * stride;
+                Pixel *out = pixels.data() + index(0, y);
+                for (std::size_t x = 0; x < w; x += TileW, out += tile_pixels)
+                {
+                    stdpsram::memcpy(out, in + x, std::min<std::size_t>(TileW, w - x) * sizeof(Pixel));
+                }
+            }
+        }
+
+        Pixel *data() noexcept { return pixels.data(); }
+        const Pixel *data() const noexcept { return pixels.data(); }
+    };
+
+    ///////////////////////////////////////////////////
+    // Geometry: walk the source tile by tile so reads stay inside one tile and writes inside a few
+
+    // 90 degrees clockwise
+    template <typename Pixel, unsigned TileW, unsigned TileH>
+    image<Pixel, TileW, TileH> rotate90(const image<Pixel, TileW, TileH> &src)
+    {
+        image<Pixel, TileW, TileH> dst(src.height(), src.width());
+        std::size_t last = src.height() - 1;
+        src.for_each_tile([&](typename image<Pixel, TileW, TileH>::const_tile t)
+                          {
+            for (std::size_t y = 0; y < t.h; y++)
+                for (std::size_t x = 0; x < t.w; x++)
+                    dst(last - (t.y0 + y), t.x0 + x) = t(x, y); });
+        return dst;
+    }
+
+    template <typename Pixel, unsigned TileW, unsigned TileH>
+    image<Pixel, TileW, TileH> transpose(const image<Pixel, TileW, TileH> &src)
+    {
+        image<Pixel, TileW, TileH> dst(src.height(), src.width());
+        src.for_each_tile([&](typename image<Pixel, TileW, TileH>::const_tile t)
+                          {
+            for (std::size_t y = 0; y < t.h; y++)
+                for (std::size_t x = 0; x < t.w; x++)
+                    dst(t.y0 + y, t.x0 + x) = t(x, y); });
+        return dst;
+    }
+
+    ///////////////////////////////////////////////////
+    // Filters: each destination tile stages its neighbourhood into SRAM and is computed there
+
+    namespace detail
+    {
+        // Channel access for box_blur: split a pixel into channels and join them again
+        struct gray8_channels
+        {
+            static const unsigned count = 1;
+            static void split(uint8_t p, uint32_t *c) { c[0] = p; }
+            static uint8_t join(const uint32_t *c) { return uint8_t(c[0]); }
+        };
+
+        struct rgb565_channels
+        {
+            static const unsigned count = 3;
+            static void split(uint16_t p, uint32_t *c)
+            {
+                c[0] = p >> 11;
+                c[1] = (p >> 5) & 0x3F;
+                c[2] = p & 0x1F;
+            }
+            static uint16_t join(const uint32_t *c) { return uint16_t((c[0] << 11) | (c[1] << 5) | c[2]); }
+        };
+
+        template <typename Channels, typename Pixel, unsigned TileW, unsigned TileH>
+        image<Pixel, TileW, TileH> box_blur(const image<Pixel, TileW, TileH> &src, unsigned radius)
+        {
+            typedef image<Pixel, TileW, TileH> image_type;
+            const unsigned channels = Channels::count;
+            const std::size_t span = 2 * radius + 1;
+            const std::size_t staged_w = TileW + 2 * radius;
+            const uint32_t area = uint32_t(span * span);
+            image_type dst(src.width(), src.height());
+            if (src.width() == 0 || src.height() == 0)
+            {
+                return dst;
+            }
+            std::vector<Pixel, SRAMAllocator<Pixel>> staged(staged_w * (TileH + 2 * radius));
+            std::vector<uint32_t, SRAMAllocator<uint32_t>> row_sums((TileH + 2 * radius) * TileW * channels);
+            const std::ptrdiff_t x_max = std::ptrdiff_t(src.width() - 1);
+            const std::ptrdiff_t y_max = std::ptrdiff_t(src.height() - 1);
+
+            dst.for_each_tile([&](typename image_type::tile t)
+                              {
+                const std::size_t rows = t.h + 2 * radius;
+                const std::size_t cols = t.w + 2 * radius;
+
+                // Neighbourhood of the tile, edges replicated
+                for (std::size_t j = 0; j < rows; j++)
+                {
+                    std::ptrdiff_t y = std::min(std::max(std::ptrdiff_t(t.y0 + j) - std::ptrdiff_t(radius), std::ptrdiff_t(0)), y_max);
+                    Pixel *out = staged.data() + j * staged_w;
+                    for (std::size_t i = 0; i < cols; i++)
+                    {
+                        std::ptrdiff_t x = std::min(std::max(std::ptrdiff_t(t.x0 + i) - std::ptrdiff_t(radius), std::ptrdiff_t(0)), x_max);
+                        out[i] = src(std::size_t(x), std::size_t(y));
+                    }
+                }
+
+                // Horizontal running sums over span pixels
+                uint32_t sum[Channels::count];
+                uint32_t c[Channels::count];
+                for (std::size_t j = 0; j < rows; j++)
+                {
+                    const Pixel *in = staged.data() + j * staged_w;
+                    uint32_t *out = row_sums.data() + j * TileW * channels;
+                    std::fill(sum, sum + channels, 0);
+                    for (std::size_t i = 0; i < span; i++)
+                    {
+                        Channels::split(in[i], c);
+                        for (unsigned k = 0; k < channels; k++)
+                            sum[k] += c[k];
+                    }
+                    for (std::size_t x = 0; x < t.w; x++)
+                    {
+                        std::copy(sum, sum + channels, out + x * channels);
+                        if (x + 1 < t.w)
+                        {
+                            Channels::split(in[x + span], c);
+                            for (unsigned k = 0; k < channels; k++)
+                                sum[k] += c[k];
+                            Channels::split(in[x], c);
+                            for (unsigned k = 0; k < channels; k++)
+                                sum[k] -= c[k];
+                        }
+                    }
+                }
+
+                // Vertical running sums of the row sums, written straight into the destination tile
+                for (std::size_t x = 0; x < t.w; x++)
+                {
+                    const uint32_t *column = row_sums.data() + x * channels;
+                    const std::size_t pitch = TileW * channels;
+                    std::fill(sum, sum + channels, 0);
+                    for (std::size_t j = 0; j < span; j++)
+                        for (unsigned k = 0; k < channels; k++)
+                            sum[k] += column[j * pitch + k];
+                    for (std::size_t y = 0; y < t.h; y++)
+                    {
+                        for (unsigned k = 0; k < channels; k++)
+                            c[k] = (sum[k] + area / 2) / area;
+                        t(x, y) = Channels::join(c);
+                        if (y + 1 < t.h)
+                        {
+                            for (unsigned k = 0; k < channels; k++)
+                                sum[k] += column[(y + span) * pitch + k] - column[y * pitch + k];
+                        }
+                    }
+                } });
+            return dst;
+        }
+    }
+
+    // Mean over the (2 radius + 1)^2 neighbourhood of every pixel, edges replicated; 8-bit grayscale
+    template <unsigned TileW, unsigned TileH>
+    image<uint8_t, TileW, TileH> box_blur(const image<uint8_t, TileW, TileH> &src, unsigned radius)
+    {
+        return detail::box_blur<detail::gray8_channels>(src, radius);
+    }
+
+    // Same for RGB565 (native byte order), each of the three channels averaged separately
+    template <unsigned TileW, unsigned TileH>
+    image<uint16_t, TileW, TileH> box_blur_rgb565(const image<uint16_t, TileW, TileH> &src, unsigned radius)
+    {
+        return detail::box_blur<detail::rgb565_channels>(src, radius);
+    }
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_IMAGE_H
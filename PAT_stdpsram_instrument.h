@@ -0,0 +1,398 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Access-counting instrumentation for the stdpsram containers:
+// Build with -DSTDPSRAM_INSTRUMENT and the stdpsram::vector/list/map/string aliases become instrumented wrappers
+// that count element reads, writes, iterations and bytes touched. Containers are tagged by name; instances with
+// the same tag share one set of counters, so short-lived containers still show up in the report.
+//
+//   stdpsram::vector<float> samples;
+//   STDPSRAM_TAG(samples, "samples");
+//   ...
+//   stdpsram::print_access_ranking();
+//
+// Without STDPSRAM_INSTRUMENT, STDPSRAM_TAG compiles to nothing and the aliases are the plain std containers.
+//
+// Notes:
+// - Non-const element access (operator[], at, front, back) is counted as a write, const access as a read.
+// - begin() counts one iteration and assumes the whole container is traversed.
+// - Counters are not atomic; this is a debugging aid, not a profiler for concurrent code.
+//
+// This header is pulled in by PAT_stdpsram.h. Included on its own, it includes PAT_stdpsram.h first (outside the
+// guard, so that header's aliases still see the class below) for STDPSRAM_PRINTF.
+
+#include "PAT_stdpsram.h"
+
+#ifndef PAT_STDPSRAM_INSTRUMENT_H
+#define PAT_STDPSRAM_INSTRUMENT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <type_traits>
+#include <utility>
+
+#ifndef STDPSRAM_INSTRUMENT_SLOTS
+#define STDPSRAM_INSTRUMENT_SLOTS 32
+#endif
+
+namespace stdpsram
+{
+    ///////////////////////////////////////////////////
+    // Counters for one tag
+    struct access_stats
+    {
+        const char *name;
+        uint32_t reads;
+        uint32_t writes;
+        uint32_t iterations;
+        uint64_t bytes;
+    };
+
+    // Fixed table of tags; the last slot collects everything once the table is full
+    inline access_stats *access_table()
+    {
+        static access_stats table[STDPSRAM_INSTRUMENT_SLOTS + 1] = {};
+        return table;
+    }
+
+    inline access_stats *access_stats_for(const char *name)
+    {
+        access_stats *table = access_table();
+        for (std::size_t i = 0; i < STDPSRAM_INSTRUMENT_SLOTS; i++)
+        {
+            if (!table[i].name)
+            {
+                table[i].name = name;
+                return &table[i];
+            }
+            if (table[i].name == name || std::strcmp(table[i].name, name) == 0)
+            {
+                return &table[i];
+            }
+        }
+        table[STDPSRAM_INSTRUMENT_SLOTS].name = "(other)";
+        return &table[STDPSRAM_INSTRUMENT_SLOTS];
+    }
+
+    inline void reset_access_stats()
+    {
+        access_stats *table = access_table();
+        for (std::size_t i = 0; i <= STDPSRAM_INSTRUMENT_SLOTS; i++)
+        {
+            table[i].reads = table[i].writes = table[i].iterations = 0;
+            table[i].bytes = 0;
+        }
+    }
+
+    //--------------------------------
+    // Copy the tags, most bytes touched first, into out[0..max). Returns the number written.
+    inline std::size_t access_ranking(access_stats *out, std::size_t max)
+    {
+        access_stats *table = access_table();
+        std::size_t n = 0;
+        for (std::size_t i = 0; i <= STDPSRAM_INSTRUMENT_SLOTS; i++)
+        {
+            if (table[i].name)
+            {
+                if (n < max)
+                {
+                    out[n++] = table[i];
+                }
+                else if (n && table[i].bytes > out[n - 1].bytes)
+                {
+                    out[n - 1] = table[i];
+                }
+                else
+                {
+                    continue;
+                }
+                std::sort(out, out + n, [](const access_stats &a, const access_stats &b)
+                          { return a.bytes > b.bytes; });
+            }
+        }
+        return n;
+    }
+
+    // Print the ranking to the serial console
+    inline void print_access_ranking(std::size_t top = 10)
+    {
+        access_stats ranked[STDPSRAM_INSTRUMENT_SLOTS + 1];
+        std::size_t n = access_ranking(ranked, std::min<std::size_t>(top, STDPSRAM_INSTRUMENT_SLOTS + 1));
+        STDPSRAM_PRINTF("stdpsram access ranking (by bytes touched):\n");
+        for (std::size_t i = 0; i < n; i++)
+        {
+            STDPSRAM_PRINTF("%2u. %-24s bytes: %10llu reads: %8u writes: %8u iterations: %6u\n",
+                            unsigned(i + 1), ranked[i].name, (unsigned long long)ranked[i].bytes,
+                            unsigned(ranked[i].reads), unsigned(ranked[i].writes), unsigned(ranked[i].iterations));
+        }
+    }
+
+    namespace detail
+    {
+        // Result of c.insert(value) (pair<iterator, bool> for map, iterator for multimap), void where it does not exist
+        template <typename C, typename = void>
+        struct insert_value_result
+        {
+            typedef void type;
+        };
+
+        template <typename C>
+        struct insert_value_result<C, decltype(void(std::declval<C &>().insert(std::declval<typename C::value_type>())))>
+        {
+            typedef decltype(std::declval<C &>().insert(std::declval<typename C::value_type>())) type;
+        };
+    }
+
+    ///////////////////////////////////////////////////
+    // instrumented: a container that counts how it is used
+    template <typename Container>
+    class instrumented : public Container
+    {
+    private:
+        using element = typename Container::value_type;
+
+        access_stats *stats = access_stats_for("untagged");
+
+        void note_read(std::size_t n = 1) const
+        {
+            stats->reads++;
+            stats->bytes += n * sizeof(element);
+        }
+
+        void note_write(std::size_t n = 1) const
+        {
+            stats->writes++;
+            stats->bytes += n * sizeof(element);
+        }
+
+        void note_iteration() const
+        {
+            stats->iterations++;
+            stats->bytes += Container::size() * sizeof(element);
+        }
+
+    public:
+        using Container::Container;
+        using Container::operator=;
+
+        instrumented() = default;
+        instrumented(const Container &other) : Container(other) {}
+        instrumented(Container &&other) : Container(std::move(other)) {}
+
+        // Attach this instance to a named set of counters
+        void tag(const char *name)
+        {
+            stats = access_stats_for(name);
+        }
+
+        const access_stats &access() const
+        {
+            return *stats;
+        }
+
+        //--------------------------------
+        // Element access
+        template <typename K, typename C = Container>
+        auto operator[](K &&key) -> decltype(std::declval<C &>()[std::forward<K>(key)])
+        {
+            note_write();
+            return Container::operator[](std::forward<K>(key));
+        }
+
+        template <typename K, typename C = Container>
+        auto operator[](K &&key) const -> decltype(std::declval<const C &>()[std::forward<K>(key)])
+        {
+            note_read();
+            return Container::operator[](std::forward<K>(key));
+        }
+
+        template <typename K, typename C = Container>
+        auto at(K &&key) -> decltype(std::declval<C &>().at(std::forward<K>(key)))
+        {
+            note_write();
+            return Container::at(std::forward<K>(key));
+        }
+
+        template <typename K, typename C = Container>
+        auto at(K &&key) const -> decltype(std::declval<const C &>().at(std::forward<K>(key)))
+        {
+            note_read();
+            return Container::at(std::forward<K>(key));
+        }
+
+        template <typename C = Container>
+        auto front() -> decltype(std::declval<C &>().front())
+        {
+            note_write();
+            return Container::front();
+        }
+
+        template <typename C = Container>
+        auto front() const -> decltype(std::declval<const C &>().front())
+        {
+            note_read();
+            return Container::front();
+        }
+
+        template <typename C = Container>
+        auto back() -> decltype(std::declval<C &>().back())
+        {
+            note_write();
+            return Container::back();
+        }
+
+        template <typename C = Container>
+        auto back() const -> decltype(std::declval<const C &>().back())
+        {
+            note_read();
+            return Container::back();
+        }
+
+        template <typename K, typename C = Container>
+        auto find(const K &key) -> decltype(std::declval<C &>().find(key))
+        {
+            note_read();
+            return Container::find(key);
+        }
+
+        template <typename K, typename C = Container>
+        auto find(const K &key) const -> decltype(std::declval<const C &>().find(key))
+        {
+            note_read();
+            return Container::find(key);
+        }
+
+        //--------------------------------
+        // Iteration
+        typename Container::iterator begin()
+        {
+            note_iteration();
+            return Container::begin();
+        }
+
+        typename Container::const_iterator begin() const
+        {
+            note_iteration();
+            return Container::begin();
+        }
+
+        typename Container::const_iterator cbegin() const
+        {
+            note_iteration();
+            return Container::cbegin();
+        }
+
+        //--------------------------------
+        // Insertion. The forwarding templates cannot take a braced list ({1, 2} has no type to deduce), so the
+        // value_type / initializer_list overloads of the containers are repeated as plain members.
+        void push_back(const element &value)
+        {
+            note_write();
+            Container::push_back(value);
+        }
+
+        void push_back(element &&value)
+        {
+            note_write();
+            Container::push_back(std::move(value));
+        }
+
+        void push_front(const element &value)
+        {
+            note_write();
+            Container::push_front(value);
+        }
+
+        void push_front(element &&value)
+        {
+            note_write();
+            Container::push_front(std::move(value));
+        }
+
+        typename detail::insert_value_result<Container>::type insert(const element &value)
+        {
+            note_write();
+            return Container::insert(value);
+        }
+
+        typename detail::insert_value_result<Container>::type insert(element &&value)
+        {
+            note_write();
+            return Container::insert(std::move(value));
+        }
+
+        void insert(std::initializer_list<element> values)
+        {
+            note_write(values.size());
+            Container::insert(values);
+        }
+
+        typename Container::iterator insert(typename Container::const_iterator pos, const element &value)
+        {
+            note_write();
+            return Container::insert(pos, value);
+        }
+
+        typename Container::iterator insert(typename Container::const_iterator pos, element &&value)
+        {
+            note_write();
+            return Container::insert(pos, std::move(value));
+        }
+
+        typename Container::iterator insert(typename Container::const_iterator pos, std::initializer_list<element> values)
+        {
+            note_write(values.size());
+            return Container::insert(pos, values);
+        }
+
+        template <typename C = Container, typename... Args>
+        auto push_back(Args &&...args) -> decltype(std::declval<C &>().push_back(std::forward<Args>(args)...))
+        {
+            note_write();
+            return Container::push_back(std::forward<Args>(args)...);
+        }
+
+        template <typename C = Container, typename... Args>
+        auto push_front(Args &&...args) -> decltype(std::declval<C &>().push_front(std::forward<Args>(args)...))
+        {
+            note_write();
+            return Container::push_front(std::forward<Args>(args)...);
+        }
+
+        template <typename C = Container, typename... Args>
+        auto emplace_back(Args &&...args) -> decltype(std::declval<C &>().emplace_back(std::forward<Args>(args)...))
+        {
+            note_write();
+            return Container::emplace_back(std::forward<Args>(args)...);
+        }
+
+        template <typename C = Container, typename... Args>
+        auto emplace(Args &&...args) -> decltype(std::declval<C &>().emplace(std::forward<Args>(args)...))
+        {
+            note_write();
+            return Container::emplace(std::forward<Args>(args)...);
+        }
+
+        template <typename C = Container, typename... Args>
+        auto insert(Args &&...args) -> decltype(std::declval<C &>().insert(std::forward<Args>(args)...))
+        {
+            note_write();
+            return Container::insert(std::forward<Args>(args)...);
+        }
+    };
+
+    // Tag any container; a no-op for containers that are not instrumented
+    template <typename Container>
+    void tag(instrumented<Container> &container, const char *name)
+    {
+        container.tag(name);
+    }
+
+    template <typename Container>
+    void tag(Container &, const char *) {}
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_INSTRUMENT_H
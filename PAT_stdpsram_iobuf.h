@@ -0,0 +1,521 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Zero-copy I/O buffer chains:
+// stdpsram::iobuf is a chain of views into reference-counted PSRAM segments. Fragments are appended as they
+// arrive, chains are concatenated, split and trimmed by adjusting views, and clones share the segments - bytes
+// are written once and never flattened unless coalesce() is asked for. Segments keep headroom in front so
+// protocol headers can be prepended in place.
+//
+//   stdpsram::iobuf payload;
+//   payload.append(fragment, len);                  // from the socket, as many times as needed
+//   stdpsram::iobuf::cursor c(payload);
+//   uint16_t type = c.read<uint16_t>();             // reads across segment boundaries
+//   stdpsram::iobuf body = payload.split(c.position()); // header removed, body shared
+//   std::memcpy(body.prepend(4), "HDR!", 4);
+//   struct iovec iov[8];
+//   writev(sock, iov, body.fill_iovec(iov, 8));     // scatter-gather output
+//
+// Segments are shared between clones and are never modified once shared: writes (append into tailroom,
+// prepend into headroom) only happen in place when the segment has a single owner.
+
+#ifndef PAT_STDPSRAM_IOBUF_H
+#define PAT_STDPSRAM_IOBUF_H
+
+#include "PAT_stdpsram.h"
+#include "PAT_stdpsram_memory.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <sys/uio.h>
+#include <type_traits>
+
+#ifndef STDPSRAM_IOBUF_SEGMENT
+#define STDPSRAM_IOBUF_SEGMENT 2048 // minimum payload bytes of a new segment
+#endif
+
+#ifndef STDPSRAM_IOBUF_HEADROOM
+#define STDPSRAM_IOBUF_HEADROOM 64 // bytes reserved in front of a new chain's first segment
+#endif
+
+namespace stdpsram
+{
+    namespace detail
+    {
+        // Reference-counted storage; the bytes follow the header in the same PSRAM allocation
+        struct iobuf_segment
+        {
+            std::atomic<uint32_t> refs;
+            uint32_t capacity;
+
+            uint8_t *bytes() { return reinterpret_cast<uint8_t *>(this + 1); }
+
+            static iobuf_segment *create(std::size_t capacity)
+            {
+                void *p = PSRAMAllocator<uint8_t>().allocate(sizeof(iobuf_segment) + capacity);
+                iobuf_segment *s = new (p) iobuf_segment();
+                s->refs.store(1);
+                s->capacity = uint32_t(capacity);
+                return s;
+            }
+
+            void retain() { refs.fetch_add(1); }
+
+            void release()
+            {
+                if (refs.fetch_sub(1) == 1)
+                {
+                    std::size_t n = sizeof(iobuf_segment) + capacity;
+                    this->~iobuf_segment();
+                    PSRAMAllocator<uint8_t>().deallocate(reinterpret_cast<uint8_t *>(this), n);
+                }
+            }
+
+            bool unique() const { return refs.load() == 1; }
+        };
+
+        struct iobuf_slice
+        {
+            iobuf_segment *segment;
+            uint32_t offset;
+            uint32_t length;
+
+            uint8_t *data() const { return segment->bytes() + offset; }
+        };
+    }
+
+    ///////////////////////////////////////////////////
+    // iobuf: chain of shared PSRAM segments
+    class iobuf
+    {
+    private:
+        vector<detail::iobuf_slice> chain;
+        std::size_t total;
+
+        void release_all()
+        {
+            for (detail::iobuf_slice &s : chain)
+            {
+                s.segment->release();
+            }
+            chain.clear();
+            total = 0;
+        }
+
+        // Append a slice, merging it with the last one when they are adjacent in the same segment
+        void push(const detail::iobuf_slice &s)
+        {
+            if (!chain.empty())
+            {
+                detail::iobuf_slice &last = chain.back();
+                if (last.segment == s.segment && last.offset + last.length == s.offset)
+                {
+                    last.length += s.length;
+                    total += s.length;
+                    s.segment->release();
+                    return;
+                }
+            }
+            chain.push_back(s);
+            total += s.length;
+        }
+
+    public:
+        iobuf() : total(0) {}
+
+        // Empty chain whose first segment has the given headroom and room for capacity bytes
+        explicit iobuf(std::size_t capacity, std::size_t headroom = STDPSRAM_IOBUF_HEADROOM) : total(0)
+        {
+            detail::iobuf_segment *seg = detail::iobuf_segment::create(headroom + capacity);
+            chain.push_back(detail::iobuf_slice{seg, uint32_t(headroom), 0});
+        }
+
+        iobuf(const void *data, std::size_t n, std::size_t headroom = STDPSRAM_IOBUF_HEADROOM) : iobuf(n, headroom)
+        {
+            append(data, n);
+        }
+
+        iobuf(iobuf &&other) noexcept : chain(std::move(other.chain)), total(other.total)
+        {
+            other.chain.clear();
+            other.total = 0;
+        }
+
+        iobuf &operator=(iobuf &&other) noexcept
+        {
+            if (this != &other)
+            {
+                release_all();
+                chain.swap(other.chain);
+                total = other.total;
+                other.total = 0;
+            }
+            return *this;
+        }
+
+        iobuf(const iobuf &) = delete;
+        iobuf &operator=(const iobuf &) = delete;
+
+        ~iobuf()
+        {
+            release_all();
+        }
+
+        // Another chain over the same bytes (segments are shared, nothing is copied)
+        iobuf clone() const
+        {
+            iobuf copy;
+            copy.chain = chain;
+            for (const detail::iobuf_slice &s : chain)
+            {
+                s.segment->retain();
+            }
+            copy.total = total;
+            return copy;
+        }
+
+        //--------------------------------
+        // Copy bytes to the end, into the tailroom of the last segment when it is not shared
+        void append(const void *data, std::size_t n)
+        {
+            const uint8_t *p = static_cast<const uint8_t *>(data);
+            while (n)
+            {
+                if (!chain.empty())
+                {
+                    detail::iobuf_slice &last = chain.back();
+                    std::size_t end = last.offset + last.length;
+                    if (last.segment->unique() && end < last.segment->capacity)
+                    {
+                        std::size_t len = std::min<std::size_t>(n, last.segment->capacity - end);
+                        stdpsram::memcpy(last.segment->bytes() + end, p, len);
+                        last.length += uint32_t(len);
+                        total += len;
+                        p += len;
+                        n -= len;
+                        continue;
+                    }
+                }
+                std::size_t cap = n > STDPSRAM_IOBUF_SEGMENT ? n : STDPSRAM_IOBUF_SEGMENT;
+                chain.push_back(detail::iobuf_slice{detail::iobuf_segment::create(cap), 0, 0});
+            }
+        }
+
+        // Move another chain's segments to the end of this one
+        void append(iobuf &&other)
+        {
+            for (const detail::iobuf_slice &s : other.chain)
+            {
+                if (s.length)
+                    push(s);
+                else
+                    s.segment->release();
+            }
+            other.chain.clear();
+            other.total = 0;
+        }
+
+        // Room for n bytes in front of the data: headroom of the first segment if it is not shared,
+        // otherwise a new segment. Returns where to write them.
+        uint8_t *prepend(std::size_t n)
+        {
+            if (!chain.empty() && chain.front().segment->unique() && chain.front().offset >= n)
+            {
+                detail::iobuf_slice &first = chain.front();
+                first.offset -= uint32_t(n);
+                first.length += uint32_t(n);
+                total += n;
+                return first.data();
+            }
+            std::size_t headroom = STDPSRAM_IOBUF_HEADROOM;
+            detail::iobuf_segment *seg = detail::iobuf_segment::create(headroom + n);
+            chain.insert(chain.begin(), detail::iobuf_slice{seg, uint32_t(headroom), uint32_t(n)});
+            total += n;
+            return seg->bytes() + headroom;
+        }
+
+        //--------------------------------
+        // Detach the first n bytes and return them as a chain of their own
+        iobuf split(std::size_t n)
+        {
+            if (n > total)
+            {
+                throw std::out_of_range("iobuf::split");
+            }
+            iobuf head;
+            std::size_t i = 0;
+            while (n)
+            {
+                detail::iobuf_slice &s = chain[i];
+                if (s.length <= n)
+                {
+                    head.chain.push_back(s);
+                    n -= s.length;
+                    head.total += s.length;
+                    i++;
+                }
+                else
+                {
+                    s.segment->retain();
+                    head.chain.push_back(detail::iobuf_slice{s.segment, s.offset, uint32_t(n)});
+                    head.total += n;
+                    s.offset += uint32_t(n);
+                    s.length -= uint32_t(n);
+                    n = 0;
+                }
+            }
+            chain.erase(chain.begin(), chain.begin() + i);
+            total -= head.total;
+            return head;
+        }
+
+        void trim_front(std::size_t n)
+        {
+            split(n);
+        }
+
+        void trim_back(std::size_t n)
+        {
+            if (n > total)
+            {
+                throw std::out_of_range("iobuf::trim_back");
+            }
+            total -= n;
+            while (n)
+            {
+                detail::iobuf_slice &s = chain.back();
+                if (s.length <= n)
+                {
+                    n -= s.length;
+                    s.segment->release();
+                    chain.pop_back();
+                }
+                else
+                {
+                    s.length -= uint32_t(n);
+                    n = 0;
+                }
+            }
+        }
+
+        // Copy everything into one segment (keeping headroom); a no-op for a single slice
+        void coalesce(std::size_t headroom = STDPSRAM_IOBUF_HEADROOM)
+        {
+            if (chain.size() <= 1)
+            {
+                return;
+            }
+            detail::iobuf_segment *seg = detail::iobuf_segment::create(headroom + total);
+            std::size_t at = headroom;
+            for (const detail::iobuf_slice &s : chain)
+            {
+                stdpsram::memcpy(seg->bytes() + at, s.data(), s.length);
+                at += s.length;
+            }
+            std::size_t n = total;
+            release_all();
+            chain.push_back(detail::iobuf_slice{seg, uint32_t(headroom), uint32_t(n)});
+            total = n;
+        }
+
+        // Contiguous view of all bytes (coalesces first if needed)
+        const uint8_t *data()
+        {
+            coalesce();
+            return chain.empty() ? nullptr : chain.front().data();
+        }
+
+        //--------------------------------
+        // Scatter-gather output: f(const uint8_t *data, std::size_t length) for every non-empty slice
+        template <typename F>
+        void for_each_segment(F f) const
+        {
+            for (const detail::iobuf_slice &s : chain)
+            {
+                if (s.length)
+                {
+                    f(static_cast<const uint8_t *>(s.data()), std::size_t(s.length));
+                }
+            }
+        }
+
+        // Fill up to max iovec entries for writev()/sendmsg(); returns the number used
+        int fill_iovec(struct iovec *iov, int max) const
+        {
+            int n = 0;
+            for (const detail::iobuf_slice &s : chain)
+            {
+                if (n == max)
+                {
+                    break;
+                }
+                if (s.length)
+                {
+                    iov[n].iov_base = s.data();
+                    iov[n].iov_len = s.length;
+                    n++;
+                }
+            }
+            return n;
+        }
+
+        // Copy n bytes starting at offset into dst (for callers that do need a flat copy)
+        void copy_out(std::size_t offset, void *dst, std::size_t n) const
+        {
+            if (offset + n > total)
+            {
+                throw std::out_of_range("iobuf::copy_out");
+            }
+            uint8_t *out = static_cast<uint8_t *>(dst);
+            for (const detail::iobuf_slice &s : chain)
+            {
+                if (!n)
+                {
+                    break;
+                }
+                if (offset >= s.length)
+                {
+                    offset -= s.length;
+                    continue;
+                }
+                std::size_t len = std::min<std::size_t>(n, s.length - offset);
+                stdpsram::memcpy(out, s.data() + offset, len);
+                out += len;
+                n -= len;
+                offset = 0;
+            }
+        }
+
+        void clear() { release_all(); }
+        std::size_t size() const noexcept { return total; }
+        bool empty() const noexcept { return total == 0; }
+        std::size_t segments() const noexcept { return chain.size(); }
+
+        ///////////////////////////////////////////////////
+        // cursor: sequential reader across segment boundaries; invalidated by changes to the chain
+        class cursor
+        {
+        private:
+            const iobuf *buf;
+            std::size_t slice;
+            std::size_t offset; // within the slice
+            std::size_t pos;    // from the start of the chain
+
+            void settle()
+            {
+                while (slice < buf->chain.size() && offset == buf->chain[slice].length)
+                {
+                    slice++;
+                    offset = 0;
+                }
+            }
+
+        public:
+            explicit cursor(const iobuf &b) : buf(&b), slice(0), offset(0), pos(0)
+            {
+                settle();
+            }
+
+            std::size_t position() const noexcept { return pos; }
+            std::size_t remaining() const noexcept { return buf->total - pos; }
+            bool at_end() const noexcept { return pos == buf->total; }
+
+            // Bytes available contiguously at the cursor, without copying
+            std::size_t peek(const uint8_t *&data) const
+            {
+                if (slice == buf->chain.size())
+                {
+                    data = nullptr;
+                    return 0;
+                }
+                data = buf->chain[slice].data() + offset;
+                return buf->chain[slice].length - offset;
+            }
+
+            void skip(std::size_t n)
+            {
+                if (n > remaining())
+                {
+                    throw std::out_of_range("iobuf::cursor::skip");
+                }
+                pos += n;
+                while (n)
+                {
+                    std::size_t len = std::min(n, buf->chain[slice].length - offset);
+                    offset += len;
+                    n -= len;
+                    settle();
+                }
+            }
+
+            void pull(void *dst, std::size_t n)
+            {
+                if (n > remaining())
+                {
+                    throw std::out_of_range("iobuf::cursor::pull");
+                }
+                uint8_t *out = static_cast<uint8_t *>(dst);
+                pos += n;
+                while (n)
+                {
+                    std::size_t len = std::min(n, buf->chain[slice].length - offset);
+                    std::memcpy(out, buf->chain[slice].data() + offset, len);
+                    out += len;
+                    offset += len;
+                    n -= len;
+                    settle();
+                }
+            }
+
+            // Native byte order; use the _be variant for network order integers
+            template <typename T>
+            T read()
+            {
+                static_assert(std::is_trivially_copyable<T>::value, "iobuf::cursor::read needs a trivially copyable type");
+                T value;
+                pull(&value, sizeof(T));
+                return value;
+            }
+
+            template <typename T>
+            T read_be()
+            {
+                static_assert(std::is_integral<T>::value, "iobuf::cursor::read_be needs an integer type");
+                uint8_t bytes[sizeof(T)];
+                pull(bytes, sizeof(T));
+                typename std::make_unsigned<T>::type v = 0;
+                for (std::size_t i = 0; i < sizeof(T); i++)
+                {
+                    v = typename std::make_unsigned<T>::type((v << 8) | bytes[i]);
+                }
+                return T(v);
+            }
+
+            // Distance from the cursor to the next occurrence of byte, or npos
+            std::size_t find(uint8_t byte) const
+            {
+                std::size_t distance = 0;
+                std::size_t off = offset;
+                for (std::size_t i = slice; i < buf->chain.size(); i++, off = 0)
+                {
+                    const detail::iobuf_slice &s = buf->chain[i];
+                    const void *hit = std::memchr(s.data() + off, byte, s.length - off);
+                    if (hit)
+                    {
+                        return distance + std::size_t(static_cast<const uint8_t *>(hit) - (s.data() + off));
+                    }
+                    distance += s.length - off;
+                }
+                return npos;
+            }
+
+            static const std::size_t npos = std::size_t(-1);
+        };
+    };
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_IOBUF_H
@@ -0,0 +1,730 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Streaming JSON over PSRAM buffers:
+// - json_writer emits JSON straight into a target with an append(const char *, std::size_t) member
+//   (stdpsram::string, stdpsram::iobuf, std::string, ...) through a small SRAM batch buffer, inserting commas
+//   and escaping strings. json_to() runs the document builder twice - once counting, once writing - so a
+//   string target is reserved exactly once.
+// - json_parse is a SAX reader working in place on a buffer (e.g. a multi-MB document in PSRAM). Strings and
+//   keys are handed out as json_view (pointer + length into the buffer); nothing is copied unless the handler
+//   asks for the unescaped text. Nesting is tracked with an explicit stack, not recursion.
+//
+//   stdpsram::string doc;
+//   stdpsram::json_to(doc, [&](stdpsram::json_writer &w) {
+//       w.begin_object();
+//       w.member("id", 42);
+//       w.key("samples");
+//       w.begin_array();
+//       for (float s : samples) w.value(s);
+//       w.end_array();
+//       w.end_object();
+//   });
+//
+//   struct Handler : stdpsram::json_handler {
+//       void on_key(stdpsram::json_view k) { ... }
+//       void on_number(double v) { ... }
+//   } h;
+//   stdpsram::json_parse(doc.data(), doc.size(), h);     // throws stdpsram::json_parse_error
+
+#ifndef PAT_STDPSRAM_JSON_H
+#define PAT_STDPSRAM_JSON_H
+
+#include "PAT_stdpsram.h"
+#include "PAT_stdpsram_format.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#ifndef STDPSRAM_JSON_DEPTH
+#define STDPSRAM_JSON_DEPTH 64 // maximum nesting of objects and arrays
+#endif
+
+#ifndef STDPSRAM_JSON_BATCH
+#define STDPSRAM_JSON_BATCH 256 // bytes collected in SRAM before each append to the target
+#endif
+
+namespace stdpsram
+{
+    ///////////////////////////////////////////////////
+    // json_writer: streaming JSON emitter
+    class json_writer
+    {
+    private:
+        void *target;
+        void (*append_to)(void *, const char *, std::size_t);
+        char batch[STDPSRAM_JSON_BATCH];
+        std::size_t used;
+        std::size_t total;
+        int depth;
+        bool first[STDPSRAM_JSON_DEPTH + 1]; // no member/element written yet at this level
+        bool after_key;
+        int digits;
+
+        template <typename Target>
+        static void append_thunk(void *t, const char *data, std::size_t n)
+        {
+            static_cast<Target *>(t)->append(data, n);
+        }
+
+        void drain()
+        {
+            if (used && append_to)
+            {
+                append_to(target, batch, used);
+            }
+            used = 0;
+        }
+
+        void write(const char *s, std::size_t n)
+        {
+            total += n;
+            if (!append_to)
+            {
+                return; // counting only
+            }
+            if (used + n > sizeof(batch))
+            {
+                drain();
+                if (n > sizeof(batch))
+                {
+                    append_to(target, s, n);
+                    return;
+                }
+            }
+            std::memcpy(batch + used, s, n);
+            used += n;
+        }
+
+        void put(char c)
+        {
+            write(&c, 1);
+        }
+
+        // Comma before every element but the first; nothing after a key
+        void separator()
+        {
+            if (after_key)
+            {
+                after_key = false;
+                return;
+            }
+            if (!first[depth])
+            {
+                put(',');
+            }
+            first[depth] = false;
+        }
+
+        void quoted(const char *s, std::size_t n)
+        {
+            static const char hex[] = "0123456789abcdef";
+            put('"');
+            const char *run = s;
+            for (const char *p = s; p != s + n; p++)
+            {
+                unsigned char c = static_cast<unsigned char>(*p);
+                if (c >= 0x20 && c != '"' && c != '\\')
+                {
+                    continue;
+                }
+                write(run, std::size_t(p - run));
+                run = p + 1;
+                char esc[6] = {'\\', 0, 0, 0, 0, 0};
+                std::size_t len = 2;
+                switch (c)
+                {
+                case '"': esc[1] = '"'; break;
+                case '\\': esc[1] = '\\'; break;
+                case '\n': esc[1] = 'n'; break;
+                case '\r': esc[1] = 'r'; break;
+                case '\t': esc[1] = 't'; break;
+                case '\b': esc[1] = 'b'; break;
+                case '\f': esc[1] = 'f'; break;
+                default:
+                    esc[1] = 'u';
+                    esc[2] = '0';
+                    esc[3] = '0';
+                    esc[4] = hex[c >> 4];
+                    esc[5] = hex[c & 15];
+                    len = 6;
+                }
+                write(esc, len);
+            }
+            write(run, std::size_t(s + n - run));
+            put('"');
+        }
+
+        void open(char c)
+        {
+            if (depth == STDPSRAM_JSON_DEPTH)
+            {
+                throw std::length_error("json_writer: nesting too deep");
+            }
+            separator();
+            put(c);
+            first[++depth] = true;
+        }
+
+        void close(char c)
+        {
+            if (depth == 0)
+            {
+                throw std::logic_error("json_writer: unbalanced end");
+            }
+            put(c);
+            depth--;
+        }
+
+        void number(double v, bool single)
+        {
+            if (!std::isfinite(v))
+            {
+                null();
+                return;
+            }
+            separator();
+            char buf[64];
+            if (digits <= 0)
+            {
+                write(buf, detail::shortest_chars(buf, v, single));
+                return;
+            }
+            detail::buffer_sink out{buf, sizeof(buf), 0};
+            detail::format_spec spec;
+            spec.precision = digits;
+            detail::format_float(out, spec, v);
+            write(buf, out.count < sizeof(buf) ? out.count : sizeof(buf));
+        }
+
+    public:
+        // Counting writer: measures the output without storing it
+        json_writer() : target(nullptr), append_to(nullptr), used(0), total(0), depth(0), after_key(false), digits(0)
+        {
+            first[0] = true;
+        }
+
+        // Writes into any target with append(const char *, std::size_t)
+        template <typename Target>
+        explicit json_writer(Target &t)
+            : target(&t), append_to(&append_thunk<Target>), used(0), total(0), depth(0), after_key(false), digits(0)
+        {
+            first[0] = true;
+        }
+
+        ~json_writer()
+        {
+            drain();
+        }
+
+        json_writer(const json_writer &) = delete;
+        json_writer &operator=(const json_writer &) = delete;
+
+        //--------------------------------
+        void begin_object() { open('{'); }
+        void end_object() { close('}'); }
+        void begin_array() { open('['); }
+        void end_array() { close(']'); }
+
+        void key(const char *k, std::size_t n)
+        {
+            separator();
+            quoted(k, n);
+            put(':');
+            after_key = true;
+        }
+
+        void key(const char *k) { key(k, std::strlen(k)); }
+
+        void value(const char *s, std::size_t n)
+        {
+            separator();
+            quoted(s, n);
+        }
+
+        void value(const char *s) { value(s, std::strlen(s)); }
+        void value(const string &s) { value(s.data(), s.size()); }
+
+        void value(bool b)
+        {
+            separator();
+            b ? write("true", 4) : write("false", 5);
+        }
+
+        void null()
+        {
+            separator();
+            write("null", 4);
+        }
+
+        void value(long long v)
+        {
+            separator();
+            char buf[24];
+            char *first_digit = detail::to_digits(buf + sizeof(buf), v < 0 ? 0 - uint64_t(v) : uint64_t(v), 10, false);
+            if (v < 0)
+            {
+                *--first_digit = '-';
+            }
+            write(first_digit, std::size_t(buf + sizeof(buf) - first_digit));
+        }
+
+        void value(unsigned long long v)
+        {
+            separator();
+            char buf[24];
+            char *first_digit = detail::to_digits(buf + sizeof(buf), v, 10, false);
+            write(first_digit, std::size_t(buf + sizeof(buf) - first_digit));
+        }
+
+        void value(int v) { value((long long)v); }
+        void value(long v) { value((long long)v); }
+        void value(unsigned v) { value((unsigned long long)v); }
+        void value(unsigned long v) { value((unsigned long long)v); }
+
+        // Non-finite numbers have no JSON form and are written as null
+        void value(double v) { number(v, false); }
+
+        // Shortest text that reads back as the same float (not the same double)
+        void value(float v) { number(v, true); }
+
+        template <typename T>
+        void member(const char *k, const T &v)
+        {
+            key(k);
+            value(v);
+        }
+
+        // Significant digits for floating point values; 0 (the default) writes the shortest text that reads back
+        // as exactly the same value
+        void precision(int significant) { digits = significant; }
+
+        // Bytes produced so far
+        std::size_t size() const noexcept { return total; }
+
+        // Push buffered output to the target (also done by the destructor)
+        void flush() { drain(); }
+    };
+
+    // Build a document into target: builder(json_writer &) runs twice, first counting, then writing after
+    // target.reserve(). builder must produce the same output both times.
+    template <typename Target, typename Builder>
+    void json_to(Target &target, Builder builder)
+    {
+        std::size_t bytes;
+        {
+            json_writer count;
+            builder(count);
+            bytes = count.size();
+        }
+        target.reserve(target.size() + bytes);
+        json_writer w(target);
+        builder(w);
+    }
+
+    ///////////////////////////////////////////////////
+    // json_view: a string or key inside the parsed buffer (still escaped if `escaped`)
+    struct json_view
+    {
+        const char *data;
+        std::size_t size;
+        bool escaped;
+
+        bool operator==(const char *s) const
+        {
+            return !escaped && std::strlen(s) == size && std::memcmp(s, data, size) == 0;
+        }
+
+        bool operator!=(const char *s) const { return !(*this == s); }
+
+        // Unescaped text written to out (at most size bytes are needed); returns its length
+        std::size_t decode(char *out) const
+        {
+            if (!escaped)
+            {
+                std::memcpy(out, data, size);
+                return size;
+            }
+            char *o = out;
+            const char *p = data;
+            const char *end = data + size;
+            while (p < end)
+            {
+                if (*p != '\\')
+                {
+                    *o++ = *p++;
+                    continue;
+                }
+                char c = p[1];
+                p += 2;
+                switch (c)
+                {
+                case 'n': *o++ = '\n'; break;
+                case 'r': *o++ = '\r'; break;
+                case 't': *o++ = '\t'; break;
+                case 'b': *o++ = '\b'; break;
+                case 'f': *o++ = '\f'; break;
+                case 'u':
+                {
+                    uint32_t cp = hex4(p);
+                    p += 4;
+                    if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                    {
+                        uint32_t low = hex4(p + 2);
+                        if (low >= 0xDC00 && low < 0xE000)
+                        {
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                            p += 6;
+                        }
+                    }
+                    o = utf8(o, cp);
+                    break;
+                }
+                default: *o++ = c; // " \ /
+                }
+            }
+            return std::size_t(o - out);
+        }
+
+        string str() const
+        {
+            string s(size, '\0');
+            s.resize(decode(size ? &s[0] : nullptr));
+            return s;
+        }
+
+    private:
+        static uint32_t hex4(const char *p)
+        {
+            uint32_t v = 0;
+            for (int i = 0; i < 4; i++)
+            {
+                char c = p[i];
+                v = (v << 4) | uint32_t(c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10);
+            }
+            return v;
+        }
+
+        static char *utf8(char *o, uint32_t cp)
+        {
+            if (cp < 0x80)
+            {
+                *o++ = char(cp);
+            }
+            else if (cp < 0x800)
+            {
+                *o++ = char(0xC0 | (cp >> 6));
+                *o++ = char(0x80 | (cp & 0x3F));
+            }
+            else if (cp < 0x10000)
+            {
+                *o++ = char(0xE0 | (cp >> 12));
+                *o++ = char(0x80 | ((cp >> 6) & 0x3F));
+                *o++ = char(0x80 | (cp & 0x3F));
+            }
+            else
+            {
+                *o++ = char(0xF0 | (cp >> 18));
+                *o++ = char(0x80 | ((cp >> 12) & 0x3F));
+                *o++ = char(0x80 | ((cp >> 6) & 0x3F));
+                *o++ = char(0x80 | (cp & 0x3F));
+            }
+            return o;
+        }
+    };
+
+    // Default (empty) callbacks; derive and hide the ones you need
+    struct json_handler
+    {
+        void on_object_begin() {}
+        void on_object_end() {}
+        void on_array_begin() {}
+        void on_array_end() {}
+        void on_key(json_view) {}
+        void on_string(json_view) {}
+        void on_integer(int64_t v) { static_cast<void>(v); }
+        void on_number(double) {}
+        void on_bool(bool) {}
+        void on_null() {}
+    };
+
+    class json_parse_error : public std::runtime_error
+    {
+    public:
+        std::size_t offset; // position of the error in the input
+
+        json_parse_error(const char *what, std::size_t offset) : std::runtime_error(what), offset(offset) {}
+    };
+
+    namespace detail
+    {
+        template <typename Handler>
+        class json_parser
+        {
+        private:
+            const char *begin;
+            const char *p;
+            const char *end;
+            Handler &h;
+
+            void fail(const char *what)
+            {
+                throw json_parse_error(what, std::size_t(p - begin));
+            }
+
+            void skip_ws()
+            {
+                while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
+                {
+                    p++;
+                }
+            }
+
+            json_view string_token()
+            {
+                p++; // opening quote
+                const char *start = p;
+                bool escaped = false;
+                for (;;)
+                {
+                    const char *q = p;
+                    while (q < end && *q != '"' && *q != '\\' && static_cast<unsigned char>(*q) >= 0x20)
+                    {
+                        q++;
+                    }
+                    p = q;
+                    if (p >= end)
+                        fail("json: unterminated string");
+                    if (*p == '"')
+                        break;
+                    if (*p != '\\')
+                        fail("json: control character in string");
+                    escaped = true;
+                    if (end - p < 2)
+                        fail("json: unterminated string");
+                    if (p[1] == 'u')
+                    {
+                        if (end - p < 6)
+                            fail("json: bad unicode escape");
+                        for (int i = 2; i < 6; i++)
+                        {
+                            char c = p[i];
+                            if (!((c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')))
+                                fail("json: bad unicode escape");
+                        }
+                        p += 6;
+                    }
+                    else if (std::strchr("\"\\/bfnrt", p[1]) && p[1])
+                    {
+                        p += 2;
+                    }
+                    else
+                    {
+                        fail("json: bad escape");
+                    }
+                }
+                json_view v = {start, std::size_t(p - start), escaped};
+                p++; // closing quote
+                return v;
+            }
+
+            void number()
+            {
+                const char *start = p;
+                bool integer = true;
+                if (p < end && *p == '-')
+                    p++;
+                if (p >= end || *p < '0' || *p > '9')
+                    fail("json: bad number");
+                if (*p == '0')
+                    p++;
+                else
+                    while (p < end && *p >= '0' && *p <= '9')
+                        p++;
+                if (p < end && *p == '.')
+                {
+                    integer = false;
+                    p++;
+                    if (p >= end || *p < '0' || *p > '9')
+                        fail("json: bad number");
+                    while (p < end && *p >= '0' && *p <= '9')
+                        p++;
+                }
+                if (p < end && (*p == 'e' || *p == 'E'))
+                {
+                    integer = false;
+                    p++;
+                    if (p < end && (*p == '+' || *p == '-'))
+                        p++;
+                    if (p >= end || *p < '0' || *p > '9')
+                        fail("json: bad number");
+                    while (p < end && *p >= '0' && *p <= '9')
+                        p++;
+                }
+                std::size_t len = std::size_t(p - start);
+                if (integer && len <= 18)
+                {
+                    int64_t v = 0;
+                    for (const char *d = *start == '-' ? start + 1 : start; d < p; d++)
+                        v = v * 10 + (*d - '0');
+                    h.on_integer(*start == '-' ? -v : v);
+                    return;
+                }
+                // strtod needs a terminated copy: the buffer is not terminated and may not be writable
+                char text[64];
+                if (len >= sizeof(text))
+                    fail("json: number too long");
+                std::memcpy(text, start, len);
+                text[len] = '\0';
+                h.on_number(std::strtod(text, nullptr));
+            }
+
+            void literal(const char *word, std::size_t n)
+            {
+                if (std::size_t(end - p) < n || std::memcmp(p, word, n) != 0)
+                    fail("json: unexpected character");
+                p += n;
+            }
+
+        public:
+            json_parser(const char *data, std::size_t size, Handler &h) : begin(data), p(data), end(data + size), h(h) {}
+
+            void run()
+            {
+                enum
+                {
+                    want_value,
+                    want_value_or_end,
+                    want_key,
+                    want_key_or_end,
+                    after_value
+                } state = want_value;
+                char stack[STDPSRAM_JSON_DEPTH];
+                int depth = 0;
+
+                for (;;)
+                {
+                    skip_ws();
+                    if (state == after_value)
+                    {
+                        if (depth == 0)
+                        {
+                            if (p != end)
+                                fail("json: trailing characters");
+                            return;
+                        }
+                        if (p >= end)
+                            fail("json: unexpected end");
+                        char c = *p++;
+                        if (c == ',')
+                            state = stack[depth - 1] == '{' ? want_key : want_value;
+                        else if (c == '}' && stack[depth - 1] == '{')
+                        {
+                            depth--;
+                            h.on_object_end();
+                        }
+                        else if (c == ']' && stack[depth - 1] == '[')
+                        {
+                            depth--;
+                            h.on_array_end();
+                        }
+                        else
+                        {
+                            p--;
+                            fail("json: expected ',' or end of container");
+                        }
+                        continue;
+                    }
+                    if (p >= end)
+                        fail("json: unexpected end");
+
+                    if (state == want_key || state == want_key_or_end)
+                    {
+                        if (*p == '}' && state == want_key_or_end)
+                        {
+                            p++;
+                            depth--;
+                            h.on_object_end();
+                            state = after_value;
+                            continue;
+                        }
+                        if (*p != '"')
+                            fail("json: expected key");
+                        h.on_key(string_token());
+                        skip_ws();
+                        if (p >= end || *p != ':')
+                            fail("json: expected ':'");
+                        p++;
+                        state = want_value;
+                        continue;
+                    }
+
+                    if (state == want_value_or_end && *p == ']')
+                    {
+                        p++;
+                        depth--;
+                        h.on_array_end();
+                        state = after_value;
+                        continue;
+                    }
+
+                    state = after_value;
+                    switch (*p)
+                    {
+                    case '{':
+                    case '[':
+                        if (depth == STDPSRAM_JSON_DEPTH)
+                            fail("json: nesting too deep");
+                        stack[depth++] = *p;
+                        if (*p++ == '{')
+                        {
+                            h.on_object_begin();
+                            state = want_key_or_end;
+                        }
+                        else
+                        {
+                            h.on_array_begin();
+                            state = want_value_or_end;
+                        }
+                        break;
+                    case '"':
+                        h.on_string(string_token());
+                        break;
+                    case 't':
+                        literal("true", 4);
+                        h.on_bool(true);
+                        break;
+                    case 'f':
+                        literal("false", 5);
+                        h.on_bool(false);
+                        break;
+                    case 'n':
+                        literal("null", 4);
+                        h.on_null();
+                        break;
+                    default:
+                        number();
+                    }
+                }
+            }
+        };
+    }
+
+    // SAX parse of [data, data + size); throws json_parse_error on malformed input
+    template <typename Handler>
+    void json_parse(const char *data, std::size_t size, Handler &handler)
+    {
+        detail::json_parser<Handler>(data, size, handler).run();
+    }
+
+    template <typename Handler>
+    void json_parse(const string &text, Handler &handler)
+    {
+        json_parse(text.data(), text.size(), handler);
+    }
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_JSON_H
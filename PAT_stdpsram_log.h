@@ -0,0 +1,482 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Deferred logging through a PSRAM ring:
+// stdpsram::log() does not format anything. It claims a fixed-size slot in a lock-free ring in PSRAM and stores
+// the format string pointer (the "format id"), a timestamp and the raw arguments - a few hundred cycles, no
+// locks, no UART. A background flusher (a FreeRTOS task pinned to STDPSRAM_LOG_CORE on ESP32, a std::thread on
+// host) drains the ring, renders the records with the format_to machinery and writes them to Serial (stdout on
+// host) in large batches. When the ring is full, new records are dropped and counted instead of blocking.
+//
+//   stdpsram::log(STDPSRAM_FMT("adc ch{}={} t={:.1f}"), ch, raw, temp);
+//   ...
+//   stdpsram::default_log().flush();      // e.g. before deep sleep
+//
+// Arguments are captured by value: integers, floating point, bool, char, pointers and C strings. A C string
+// is stored as a pointer, so it must outlive the record (string literals and static tables do). Producers may
+// run on any task, not in ISRs.
+//
+// STDPSRAM_FMT checks the number of placeholders at compile time, not whether each spec suits its argument. A
+// record whose spec does not (e.g. {:.2f} for an integer) is written as a "[log] bad format" line with the
+// format string instead of stopping the flusher.
+
+#ifndef PAT_STDPSRAM_LOG_H
+#define PAT_STDPSRAM_LOG_H
+
+#include "PAT_stdpsram.h"
+#include "PAT_stdpsram_format.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+
+#if defined(ARDUINO)
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#else
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#endif
+
+#ifndef STDPSRAM_LOG_RECORDS
+#define STDPSRAM_LOG_RECORDS 4096 // ring slots of the default log (power of two)
+#endif
+
+#ifndef STDPSRAM_LOG_ARGS
+#define STDPSRAM_LOG_ARGS 6 // arguments per record
+#endif
+
+#ifndef STDPSRAM_LOG_FLUSH_MS
+#define STDPSRAM_LOG_FLUSH_MS 50 // flusher period
+#endif
+
+#ifndef STDPSRAM_LOG_BATCH
+#define STDPSRAM_LOG_BATCH 1024 // bytes rendered before each write to the output
+#endif
+
+#ifndef STDPSRAM_LOG_CORE
+#define STDPSRAM_LOG_CORE 0
+#endif
+
+#ifndef STDPSRAM_LOG_STACK
+#define STDPSRAM_LOG_STACK 8192 // stack of the flusher task on ESP32 (float rendering alone takes ~3 KB)
+#endif
+
+#ifndef STDPSRAM_LOG_OUTPUT
+#if defined(ARDUINO)
+#define STDPSRAM_LOG_OUTPUT(data, size) Serial.write(reinterpret_cast<const uint8_t *>(data), size)
+#else
+#define STDPSRAM_LOG_OUTPUT(data, size) (std::fwrite(data, 1, size, stdout), std::fflush(stdout))
+#endif
+#endif
+
+namespace stdpsram
+{
+    namespace detail
+    {
+        enum log_type : uint8_t
+        {
+            log_signed,
+            log_unsigned,
+            log_double,
+            log_bool,
+            log_char,
+            log_text,
+            log_pointer,
+        };
+
+        struct log_record
+        {
+            std::atomic<uint32_t> seq; // ring protocol: pos when free, pos + 1 when filled
+            uint8_t count;
+            uint8_t types[STDPSRAM_LOG_ARGS];
+            const char *format;
+            uint64_t time_us;
+            union
+            {
+                int64_t i;
+                uint64_t u;
+                double d;
+                const void *p;
+            } args[STDPSRAM_LOG_ARGS];
+        };
+
+        inline uint64_t log_timestamp()
+        {
+#if defined(ARDUINO)
+            return uint64_t(esp_timer_get_time());
+#else
+            return uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now().time_since_epoch())
+                                .count());
+#endif
+        }
+
+        //--------------------------------
+        // Argument capture
+        template <typename T>
+        typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value && !std::is_same<T, char>::value>::type
+        log_capture(log_record &r, std::size_t i, T v)
+        {
+            r.types[i] = log_signed;
+            r.args[i].i = v;
+        }
+
+        template <typename T>
+        typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value && !std::is_same<T, bool>::value &&
+                                !std::is_same<T, char>::value>::type
+        log_capture(log_record &r, std::size_t i, T v)
+        {
+            r.types[i] = log_unsigned;
+            r.args[i].u = v;
+        }
+
+        template <typename T>
+        typename std::enable_if<std::is_floating_point<T>::value>::type log_capture(log_record &r, std::size_t i, T v)
+        {
+            r.types[i] = log_double;
+            r.args[i].d = double(v);
+        }
+
+        inline void log_capture(log_record &r, std::size_t i, bool v)
+        {
+            r.types[i] = log_bool;
+            r.args[i].u = v;
+        }
+
+        inline void log_capture(log_record &r, std::size_t i, char v)
+        {
+            r.types[i] = log_char;
+            r.args[i].u = uint8_t(v);
+        }
+
+        inline void log_capture(log_record &r, std::size_t i, const char *v)
+        {
+            r.types[i] = log_text;
+            r.args[i].p = v;
+        }
+
+        inline void log_capture(log_record &r, std::size_t i, const void *v)
+        {
+            r.types[i] = log_pointer;
+            r.args[i].p = v;
+        }
+
+        inline void log_capture_all(log_record &, std::size_t) {}
+
+        template <typename T, typename... Rest>
+        void log_capture_all(log_record &r, std::size_t i, const T &first, const Rest &...rest)
+        {
+            log_capture(r, i, first);
+            log_capture_all(r, i + 1, rest...);
+        }
+
+        //--------------------------------
+        // Render one record (format string plus captured arguments) into a sink
+        template <typename Sink>
+        void log_render(Sink &out, const log_record &r)
+        {
+            const char *f = r.format;
+            for (std::size_t i = 0; i < r.count; i++)
+            {
+                f = next_placeholder(out, f);
+                format_spec spec;
+                f = parse_spec(f, spec);
+                switch (r.types[i])
+                {
+                case log_signed:
+                    format_value(out, spec, r.args[i].i);
+                    break;
+                case log_unsigned:
+                    format_value(out, spec, r.args[i].u);
+                    break;
+                case log_double:
+                    format_value(out, spec, r.args[i].d);
+                    break;
+                case log_bool:
+                    format_value(out, spec, r.args[i].u != 0);
+                    break;
+                case log_char:
+                    format_value(out, spec, char(r.args[i].u));
+                    break;
+                case log_text:
+                    format_value(out, spec, static_cast<const char *>(r.args[i].p));
+                    break;
+                default:
+                    format_value(out, spec, r.args[i].p);
+                    break;
+                }
+            }
+            format_args(out, f);
+        }
+    }
+
+    ///////////////////////////////////////////////////
+    // log_ring: bounded multi-producer ring of binary log records with a background flusher
+    class log_ring
+    {
+    private:
+        vector<detail::log_record> slots;
+        uint32_t mask;
+        std::atomic<uint32_t> head; // next slot to claim
+        uint32_t tail;              // next slot to render (consumer side, under the drain lock)
+        std::atomic<uint32_t> lost;
+
+#if defined(ARDUINO)
+        SemaphoreHandle_t drain_lock;
+        SemaphoreHandle_t exited; // given by the flusher when it leaves its loop
+        std::atomic<bool> stopping;
+        TaskHandle_t flusher;
+
+        // The flusher deletes itself: deleting it from outside could stop it while it holds drain_lock
+        static void run(void *arg)
+        {
+            log_ring *self = static_cast<log_ring *>(arg);
+            while (!self->stopping.load())
+            {
+                ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STDPSRAM_LOG_FLUSH_MS));
+                self->flush();
+            }
+            xSemaphoreGive(self->exited);
+            vTaskDelete(nullptr);
+        }
+
+        void wake()
+        {
+            if (flusher)
+            {
+                xTaskNotifyGive(flusher);
+            }
+        }
+#else
+        std::mutex drain_lock;
+        std::mutex wake_lock;
+        std::condition_variable wake_cv;
+        bool stopping;
+        std::thread flusher;
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(wake_lock);
+            while (!stopping)
+            {
+                wake_cv.wait_for(lock, std::chrono::milliseconds(STDPSRAM_LOG_FLUSH_MS));
+                lock.unlock();
+                flush();
+                lock.lock();
+            }
+        }
+
+        void wake()
+        {
+            wake_cv.notify_one();
+        }
+#endif
+
+        void write_lost(char *batch, std::size_t &used)
+        {
+            uint32_t n = lost.exchange(0);
+            if (n)
+            {
+                detail::buffer_sink line{batch + used, STDPSRAM_LOG_BATCH - used, 0};
+                detail::format(line, "[log] {} records dropped\n", n);
+                used += line.count < STDPSRAM_LOG_BATCH - used ? line.count : STDPSRAM_LOG_BATCH - used;
+            }
+        }
+
+    public:
+        // records: ring slots, rounded up to a power of two
+        explicit log_ring(std::size_t records = STDPSRAM_LOG_RECORDS) : head(0), tail(0), lost(0)
+        {
+            std::size_t n = 2;
+            while (n < records)
+            {
+                n *= 2;
+            }
+            slots = vector<detail::log_record>(n);
+            mask = uint32_t(n - 1);
+            for (std::size_t i = 0; i < n; i++)
+            {
+                slots[i].seq.store(uint32_t(i), std::memory_order_relaxed);
+            }
+#if defined(ARDUINO)
+            drain_lock = xSemaphoreCreateMutex();
+            exited = xSemaphoreCreateBinary();
+            stopping = false;
+            flusher = nullptr;
+            if (!drain_lock || !exited)
+            {
+                if (drain_lock)
+                {
+                    vSemaphoreDelete(drain_lock);
+                }
+                if (exited)
+                {
+                    vSemaphoreDelete(exited);
+                }
+                throw std::bad_alloc();
+            }
+            xTaskCreatePinnedToCore(run, "stdpsram_log", STDPSRAM_LOG_STACK, this, tskIDLE_PRIORITY + 1, &flusher, STDPSRAM_LOG_CORE);
+#else
+            stopping = false;
+            flusher = std::thread([this]
+                                  { run(); });
+#endif
+        }
+
+        ~log_ring()
+        {
+#if defined(ARDUINO)
+            if (flusher)
+            {
+                stopping = true;
+                xTaskNotifyGive(flusher);
+                xSemaphoreTake(exited, portMAX_DELAY);
+            }
+            flush();
+            vSemaphoreDelete(exited);
+            vSemaphoreDelete(drain_lock);
+#else
+            {
+                std::lock_guard<std::mutex> lock(wake_lock);
+                stopping = true;
+            }
+            wake_cv.notify_one();
+            flusher.join();
+            flush();
+#endif
+        }
+
+        log_ring(const log_ring &) = delete;
+        log_ring &operator=(const log_ring &) = delete;
+
+        //--------------------------------
+        // Store a record; returns false (and counts it as dropped) when the ring is full
+        template <typename Fmt, typename... Args>
+        bool push(Fmt fmt, const Args &...args)
+        {
+            static_assert(sizeof...(Args) <= STDPSRAM_LOG_ARGS, "too many log arguments (STDPSRAM_LOG_ARGS)");
+            const char *f = detail::format_string<Fmt, sizeof...(Args)>::get(fmt);
+            uint32_t pos = head.load(std::memory_order_relaxed);
+            detail::log_record *r;
+            for (;;)
+            {
+                r = &slots[pos & mask];
+                int32_t diff = int32_t(r->seq.load(std::memory_order_acquire) - pos);
+                if (diff == 0)
+                {
+                    if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    lost.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                else
+                {
+                    pos = head.load(std::memory_order_relaxed);
+                }
+            }
+            r->format = f;
+            r->time_us = detail::log_timestamp();
+            r->count = uint8_t(sizeof...(Args));
+            detail::log_capture_all(*r, 0, args...);
+            r->seq.store(pos + 1, std::memory_order_release);
+            if (((pos + 1) & (mask >> 1)) == 0)
+            {
+                wake(); // half a ring since the last nudge: do not wait for the period
+            }
+            return true;
+        }
+
+        // Render and write every record stored so far (also called by the flusher)
+        void flush()
+        {
+#if defined(ARDUINO)
+            xSemaphoreTake(drain_lock, portMAX_DELAY);
+#else
+            std::lock_guard<std::mutex> guard(drain_lock);
+#endif
+            char batch[STDPSRAM_LOG_BATCH];
+            std::size_t used = 0;
+            write_lost(batch, used);
+            for (;;)
+            {
+                detail::log_record &r = slots[tail & mask];
+                if (r.seq.load(std::memory_order_acquire) != tail + 1)
+                {
+                    break;
+                }
+                char line[256];
+                detail::buffer_sink out{line, sizeof(line) - 1, 0};
+                detail::format(out, "[{}.{:03}] ", r.time_us / 1000000, r.time_us / 1000 % 1000);
+                std::size_t stamp = out.count;
+                try
+                {
+                    detail::log_render(out, r);
+                }
+                catch (const std::exception &)
+                {
+                    // Spec does not fit the captured argument: report the record and move past it
+                    out.count = stamp;
+                    detail::format(out, "[log] bad format \"{}\"", r.format);
+                }
+                std::size_t len = out.count < sizeof(line) - 1 ? out.count : sizeof(line) - 1;
+                line[len++] = '\n';
+                r.seq.store(tail + mask + 1, std::memory_order_release);
+                tail++;
+
+                if (used + len > sizeof(batch))
+                {
+                    STDPSRAM_LOG_OUTPUT(batch, used);
+                    used = 0;
+                }
+                std::memcpy(batch + used, line, len);
+                used += len;
+            }
+            if (used)
+            {
+                STDPSRAM_LOG_OUTPUT(batch, used);
+            }
+#if defined(ARDUINO)
+            xSemaphoreGive(drain_lock);
+#endif
+        }
+
+        // Records dropped because the ring was full and not yet reported
+        std::size_t dropped() const noexcept
+        {
+            return lost.load(std::memory_order_relaxed);
+        }
+
+        std::size_t capacity() const noexcept
+        {
+            return std::size_t(mask) + 1;
+        }
+    };
+
+    // Process-wide ring used by stdpsram::log (created with STDPSRAM_LOG_RECORDS slots on first use)
+    inline log_ring &default_log()
+    {
+        static log_ring ring;
+        return ring;
+    }
+
+    template <typename Fmt, typename... Args>
+    bool log(Fmt fmt, const Args &...args)
+    {
+        return default_log().push(fmt, args...);
+    }
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_LOG_H
@@ -0,0 +1,279 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Dense matrices in PSRAM with blocked kernels:
+// stdpsram::matrix<T> is row-major with every row padded to a whole number of cache lines and aligned to one, so
+// row segments never straddle a line more than necessary. gemm() and gemv() do not walk the PSRAM operands
+// element by element: they copy tiles of A, B and C (gemm) or chunks of x (gemv) into internal SRAM and run the
+// inner loops there, reusing each staged tile many times before it is written back. Float inner loops go
+// through stdpsram::simd: AVX/SSE on host; on ESP32-S3 gemv uses the ESP-DSP dot product, while gemm's axpy
+// inner loop is unrolled scalar code (ESP-DSP has no axpy).
+//
+//   stdpsram::matrix<float> a(512, 512), b(512, 512), c(512, 512);
+//   a(3, 4) = 1.0f;
+//   stdpsram::gemm(a, b, c);                     // c = a * b
+//   stdpsram::gemm(a, b, c, 0.5f, 1.0f);         // c = 0.5 * a * b + c
+//   stdpsram::gemv(a, x.data(), y.data());       // y = a * x
+//
+// SRAM used by gemm: 3 * STDPSRAM_GEMM_BLOCK^2 elements (12 KB for float at the default of 32).
+
+#ifndef PAT_STDPSRAM_MATRIX_H
+#define PAT_STDPSRAM_MATRIX_H
+
+#include "PAT_stdpsram.h"
+#include "PAT_stdpsram_memory.h"
+#include "PAT_stdpsram_simd.h"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+#ifndef STDPSRAM_GEMM_BLOCK
+#define STDPSRAM_GEMM_BLOCK 32 // tile edge (elements) staged into SRAM by gemm
+#endif
+
+#ifndef STDPSRAM_GEMV_CHUNK
+#define STDPSRAM_GEMV_CHUNK 1024 // elements of x staged into SRAM per gemv pass
+#endif
+
+namespace stdpsram
+{
+    ///////////////////////////////////////////////////
+    // matrix: row-major, rows padded and aligned to STDPSRAM_CACHE_LINE
+    template <typename T>
+    class matrix
+    {
+    private:
+        static_assert(std::is_trivially_copyable<T>::value, "matrix: T must be trivially copyable");
+
+        static const std::size_t line = STDPSRAM_CACHE_LINE / sizeof(T) ? STDPSRAM_CACHE_LINE / sizeof(T) : 1;
+
+        std::size_t n_rows;
+        std::size_t n_cols;
+        std::size_t pitch;
+        vector<T> storage;
+        T *base;
+
+        void place()
+        {
+            uintptr_t p = reinterpret_cast<uintptr_t>(storage.data());
+            uintptr_t aligned = (p + STDPSRAM_CACHE_LINE - 1) & ~uintptr_t(STDPSRAM_CACHE_LINE - 1);
+            base = storage.data() + (aligned - p) / sizeof(T);
+        }
+
+    public:
+        typedef T value_type;
+
+        matrix() : n_rows(0), n_cols(0), pitch(0), base(nullptr) {}
+
+        matrix(std::size_t rows, std::size_t cols, const T &fill = T())
+            : n_rows(rows), n_cols(cols), pitch((cols + line - 1) / line * line),
+              storage(rows * pitch + line, T())
+        {
+            place();
+            for (std::size_t r = 0; r < rows; r++)
+            {
+                std::fill(base + r * pitch, base + r * pitch + cols, fill);
+            }
+        }
+
+        matrix(const matrix &o) : n_rows(o.n_rows), n_cols(o.n_cols), pitch(o.pitch), storage(o.storage.size())
+        {
+            place();
+            if (n_rows)
+            {
+                stdpsram::memcpy(base, o.base, n_rows * pitch * sizeof(T));
+            }
+        }
+
+        matrix &operator=(const matrix &o)
+        {
+            if (this != &o)
+            {
+                matrix copy(o);
+                swap(copy);
+            }
+            return *this;
+        }
+
+        // Moving a vector keeps its buffer, so base stays valid
+        matrix(matrix &&o) noexcept : n_rows(o.n_rows), n_cols(o.n_cols), pitch(o.pitch), storage(std::move(o.storage)), base(o.base)
+        {
+            o.n_rows = o.n_cols = o.pitch = 0;
+            o.base = nullptr;
+        }
+
+        matrix &operator=(matrix &&o) noexcept
+        {
+            swap(o);
+            return *this;
+        }
+
+        void swap(matrix &o) noexcept
+        {
+            std::swap(n_rows, o.n_rows);
+            std::swap(n_cols, o.n_cols);
+            std::swap(pitch, o.pitch);
+            storage.swap(o.storage);
+            std::swap(base, o.base);
+        }
+
+        //--------------------------------
+        std::size_t rows() const noexcept { return n_rows; }
+        std::size_t cols() const noexcept { return n_cols; }
+        std::size_t stride() const noexcept { return pitch; } // elements between row starts
+        std::size_t bytes() const noexcept { return storage.size() * sizeof(T); }
+
+        T &operator()(std::size_t r, std::size_t c) { return base[r * pitch + c]; }
+        const T &operator()(std::size_t r, std::size_t c) const { return base[r * pitch + c]; }
+
+        T &at(std::size_t r, std::size_t c)
+        {
+            if (r >= n_rows || c >= n_cols)
+            {
+                throw std::out_of_range("matrix::at");
+            }
+            return base[r * pitch + c];
+        }
+
+        T *row(std::size_t r) noexcept { return base + r * pitch; }
+        const T *row(std::size_t r) const noexcept { return base + r * pitch; }
+        T *data() noexcept { return base; }
+        const T *data() const noexcept { return base; }
+    };
+
+    namespace detail
+    {
+        template <typename T>
+        using sram_buffer = std::vector<T, SRAMAllocator<T>>;
+
+        // y[0..n) += a * x[0..n)
+        template <typename T>
+        inline void axpy(T *y, const T *x, std::size_t n, T a)
+        {
+            for (std::size_t i = 0; i < n; i++)
+                y[i] += a * x[i];
+        }
+
+        inline void axpy(float *y, const float *x, std::size_t n, float a)
+        {
+            simd::axpy(y, x, n, a);
+        }
+
+        template <typename T>
+        inline T dot(const T *a, const T *b, std::size_t n)
+        {
+            T total = T();
+            for (std::size_t i = 0; i < n; i++)
+                total += a[i] * b[i];
+            return total;
+        }
+
+        inline float dot(const float *a, const float *b, std::size_t n)
+        {
+            return simd::dot(a, b, n);
+        }
+
+        // rows x cols block at src (pitch src_pitch) <-> dense SRAM tile (pitch STDPSRAM_GEMM_BLOCK)
+        template <typename T>
+        void load_tile(T *tile, const T *src, std::size_t src_pitch, std::size_t rows, std::size_t cols)
+        {
+            for (std::size_t r = 0; r < rows; r++)
+                stdpsram::memcpy(tile + r * STDPSRAM_GEMM_BLOCK, src + r * src_pitch, cols * sizeof(T));
+        }
+
+        template <typename T>
+        void store_tile(T *dst, std::size_t dst_pitch, const T *tile, std::size_t rows, std::size_t cols)
+        {
+            for (std::size_t r = 0; r < rows; r++)
+                stdpsram::memcpy(dst + r * dst_pitch, tile + r * STDPSRAM_GEMM_BLOCK, cols * sizeof(T));
+        }
+    }
+
+    ///////////////////////////////////////////////////
+    // c = alpha * a * b + beta * c   (c must not be a or b)
+    template <typename T>
+    void gemm(const matrix<T> &a, const matrix<T> &b, matrix<T> &c, T alpha = T(1), T beta = T(0))
+    {
+        if (a.cols() != b.rows() || c.rows() != a.rows() || c.cols() != b.cols())
+        {
+            throw std::invalid_argument("gemm: shape mismatch");
+        }
+        const std::size_t nb = STDPSRAM_GEMM_BLOCK;
+        detail::sram_buffer<T> ta(nb * nb), tb(nb * nb), tc(nb * nb);
+        const std::size_t m = a.rows(), n = b.cols(), k = a.cols();
+
+        for (std::size_t i0 = 0; i0 < m; i0 += nb)
+        {
+            std::size_t mi = std::min(nb, m - i0);
+            for (std::size_t j0 = 0; j0 < n; j0 += nb)
+            {
+                std::size_t nj = std::min(nb, n - j0);
+                T *ct = tc.data();
+                if (beta == T(0))
+                {
+                    std::fill(tc.begin(), tc.end(), T());
+                }
+                else
+                {
+                    detail::load_tile(ct, c.row(i0) + j0, c.stride(), mi, nj);
+                    for (std::size_t r = 0; r < mi; r++)
+                        for (std::size_t j = 0; j < nj; j++)
+                            ct[r * nb + j] *= beta;
+                }
+
+                for (std::size_t k0 = 0; k0 < k; k0 += nb)
+                {
+                    std::size_t nk = std::min(nb, k - k0);
+                    detail::load_tile(ta.data(), a.row(i0) + k0, a.stride(), mi, nk);
+                    detail::load_tile(tb.data(), b.row(k0) + j0, b.stride(), nk, nj);
+                    // Row of C += a(r, kk) * row kk of the B tile: unit stride everywhere
+                    for (std::size_t r = 0; r < mi; r++)
+                    {
+                        const T *ar = ta.data() + r * nb;
+                        T *cr = ct + r * nb;
+                        for (std::size_t kk = 0; kk < nk; kk++)
+                            detail::axpy(cr, tb.data() + kk * nb, nj, alpha * ar[kk]);
+                    }
+                }
+                detail::store_tile(c.row(i0) + j0, c.stride(), ct, mi, nj);
+            }
+        }
+    }
+
+    // y = alpha * a * x + beta * y   (x has a.cols() elements, y has a.rows())
+    template <typename T>
+    void gemv(const matrix<T> &a, const T *x, T *y, T alpha = T(1), T beta = T(0))
+    {
+        const std::size_t m = a.rows(), k = a.cols();
+        detail::sram_buffer<T> xs(std::min<std::size_t>(k, STDPSRAM_GEMV_CHUNK));
+        for (std::size_t r = 0; r < m; r++)
+        {
+            y[r] = beta == T(0) ? T() : beta * y[r];
+        }
+        // One pass over A per chunk of x; rows of A stream sequentially
+        for (std::size_t k0 = 0; k0 < k; k0 += xs.size())
+        {
+            std::size_t nk = std::min(xs.size(), k - k0);
+            stdpsram::memcpy(xs.data(), x + k0, nk * sizeof(T));
+            for (std::size_t r = 0; r < m; r++)
+            {
+                y[r] += alpha * detail::dot(a.row(r) + k0, xs.data(), nk);
+            }
+        }
+    }
+
+    template <typename T>
+    void gemv(const matrix<T> &a, const vector<T> &x, vector<T> &y, T alpha = T(1), T beta = T(0))
+    {
+        if (x.size() != a.cols())
+        {
+            throw std::invalid_argument("gemv: shape mismatch");
+        }
+        y.resize(a.rows());
+        gemv(a, x.data(), y.data(), alpha, beta);
+    }
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_MATRIX_H
@@ -0,0 +1,213 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Block transfers tuned for PSRAM:
+// stdpsram::memcpy / memmove / memset move data in whole cache-line bursts. The destination is aligned to a
+// cache line, then each line is read completely into registers before it is written, so the external-memory
+// cache sees one sequential burst per line on both sides instead of interleaved read/write traffic.
+//
+// Configuration:
+//   STDPSRAM_CACHE_LINE   line size in bytes (default: the data cache line of the target, 32 on ESP32)
+//   STDPSRAM_WIDE_LOADS   move 64-bit words instead of 32-bit ones
+//   STDPSRAM_BURST_COPY   1 to use the burst routines, 0 to forward to libc (default: 1 on ESP32, 0 on host,
+//                         where libc is already tuned for the cache hierarchy)
+//
+// Small or mutually misaligned transfers always go to libc.
+
+#ifndef PAT_STDPSRAM_MEMORY_H
+#define PAT_STDPSRAM_MEMORY_H
+
+#include "PAT_stdpsram.h"
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#ifndef STDPSRAM_CACHE_LINE
+#if defined(CONFIG_ESP32S3_DATA_CACHE_LINE_SIZE)
+#define STDPSRAM_CACHE_LINE CONFIG_ESP32S3_DATA_CACHE_LINE_SIZE
+#else
+#define STDPSRAM_CACHE_LINE 32
+#endif
+#endif
+
+#ifndef STDPSRAM_BURST_COPY
+#if defined(ARDUINO)
+#define STDPSRAM_BURST_COPY 1
+#else
+#define STDPSRAM_BURST_COPY 0
+#endif
+#endif
+
+namespace stdpsram
+{
+    namespace detail
+    {
+#if defined(STDPSRAM_WIDE_LOADS)
+        typedef uint64_t __attribute__((__may_alias__)) burst_word;
+#else
+        typedef uint32_t __attribute__((__may_alias__)) burst_word;
+#endif
+        static const std::size_t cache_line = STDPSRAM_CACHE_LINE;
+        static const std::size_t line_words = cache_line / sizeof(burst_word);
+
+        static_assert(cache_line % sizeof(burst_word) == 0, "STDPSRAM_CACHE_LINE must be a multiple of the word size");
+
+        // Bytes from p up to the next line boundary
+        inline std::size_t to_line(const void *p)
+        {
+            return (cache_line - (reinterpret_cast<uintptr_t>(p) & (cache_line - 1))) & (cache_line - 1);
+        }
+
+        inline bool burst_ok(const void *dst, const void *src, std::size_t n)
+        {
+            return n >= 2 * cache_line &&
+                   ((reinterpret_cast<uintptr_t>(dst) ^ reinterpret_cast<uintptr_t>(src)) & (sizeof(burst_word) - 1)) == 0;
+        }
+
+        // Copy whole lines, lowest address first. Each line is loaded completely before it is stored,
+        // which also makes this safe for overlapping ranges with dst < src.
+        inline void copy_lines_forward(uint8_t *dst, const uint8_t *src, std::size_t lines)
+        {
+            burst_word *d = reinterpret_cast<burst_word *>(dst);
+            const burst_word *s = reinterpret_cast<const burst_word *>(src);
+            while (lines--)
+            {
+                burst_word buf[line_words];
+                for (std::size_t k = 0; k < line_words; k++)
+                    buf[k] = s[k];
+                for (std::size_t k = 0; k < line_words; k++)
+                    d[k] = buf[k];
+                d += line_words;
+                s += line_words;
+            }
+        }
+
+        // Same, highest line first; safe for overlapping ranges with dst > src
+        inline void copy_lines_backward(uint8_t *dst, const uint8_t *src, std::size_t lines)
+        {
+            burst_word *d = reinterpret_cast<burst_word *>(dst) + lines * line_words;
+            const burst_word *s = reinterpret_cast<const burst_word *>(src) + lines * line_words;
+            while (lines--)
+            {
+                d -= line_words;
+                s -= line_words;
+                burst_word buf[line_words];
+                for (std::size_t k = 0; k < line_words; k++)
+                    buf[k] = s[k];
+                for (std::size_t k = 0; k < line_words; k++)
+                    d[k] = buf[k];
+            }
+        }
+
+        inline void copy_forward(uint8_t *dst, const uint8_t *src, std::size_t n)
+        {
+            std::size_t head = to_line(dst);
+            std::memmove(dst, src, head);
+            dst += head;
+            src += head;
+            n -= head;
+            std::size_t lines = n / cache_line;
+            copy_lines_forward(dst, src, lines);
+            std::memmove(dst + lines * cache_line, src + lines * cache_line, n - lines * cache_line);
+        }
+
+        inline void copy_backward(uint8_t *dst, const uint8_t *src, std::size_t n)
+        {
+            std::size_t head = to_line(dst);
+            std::size_t lines = (n - head) / cache_line;
+            std::size_t body = lines * cache_line;
+            std::memmove(dst + head + body, src + head + body, n - head - body);
+            copy_lines_backward(dst + head, src + head, lines);
+            std::memmove(dst, src, head);
+        }
+    }
+
+    ///////////////////////////////////////////////////
+    // memcpy: non-overlapping copy between any mix of PSRAM and SRAM
+    inline void *memcpy(void *dst, const void *src, std::size_t n)
+    {
+#if STDPSRAM_BURST_COPY
+        if (detail::burst_ok(dst, src, n))
+        {
+            detail::copy_forward(static_cast<uint8_t *>(dst), static_cast<const uint8_t *>(src), n);
+            return dst;
+        }
+#endif
+        return std::memcpy(dst, src, n);
+    }
+
+    // memmove: copy that tolerates overlapping ranges
+    inline void *memmove(void *dst, const void *src, std::size_t n)
+    {
+#if STDPSRAM_BURST_COPY
+        if (detail::burst_ok(dst, src, n))
+        {
+            uint8_t *d = static_cast<uint8_t *>(dst);
+            const uint8_t *s = static_cast<const uint8_t *>(src);
+            if (d <= s || d >= s + n)
+                detail::copy_forward(d, s, n);
+            else
+                detail::copy_backward(d, s, n);
+            return dst;
+        }
+#endif
+        return std::memmove(dst, src, n);
+    }
+
+    // memset: fills whole lines with word stores
+    inline void *memset(void *dst, int value, std::size_t n)
+    {
+#if STDPSRAM_BURST_COPY
+        if (n >= 2 * detail::cache_line)
+        {
+            uint8_t *d = static_cast<uint8_t *>(dst);
+            std::size_t head = detail::to_line(d);
+            std::memset(d, value, head);
+            d += head;
+            n -= head;
+
+            detail::burst_word pattern;
+            std::memset(&pattern, value, sizeof(pattern));
+            detail::burst_word *w = reinterpret_cast<detail::burst_word *>(d);
+            std::size_t lines = n / detail::cache_line;
+            for (std::size_t l = 0; l < lines; l++)
+            {
+                for (std::size_t k = 0; k < detail::line_words; k++)
+                    w[k] = pattern;
+                w += detail::line_words;
+            }
+            std::memset(d + lines * detail::cache_line, value, n - lines * detail::cache_line);
+            return dst;
+        }
+#endif
+        return std::memset(dst, value, n);
+    }
+
+    ///////////////////////////////////////////////////
+    // Bulk helpers for stdpsram::vector of trivially copyable T.
+    // std::vector's own growth and copy paths cannot be redirected through an allocator, so use these for
+    // large copies and clears of PSRAM vectors.
+
+    // dst becomes a copy of src; dst is only reallocated when the sizes differ
+    template <typename T>
+    void copy(const vector<T> &src, vector<T> &dst)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "stdpsram::copy requires a trivially copyable T");
+        if (dst.size() != src.size())
+        {
+            dst.resize(src.size());
+        }
+        stdpsram::memcpy(dst.data(), src.data(), src.size() * sizeof(T));
+    }
+
+    // Set every element's bytes to zero
+    template <typename T>
+    void zero(vector<T> &v)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "stdpsram::zero requires a trivially copyable T");
+        stdpsram::memset(v.data(), 0, v.size() * sizeof(T));
+    }
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_MEMORY_H
@@ -0,0 +1,375 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Flash/file-backed paged vector:
+// stdpsram::paged_vector keeps a fixed working set of pages in PSRAM and swaps cold pages out to a backing store,
+// so a container can grow past free PSRAM at the cost of latency on cold data only. A page table maps every
+// page to its PSRAM frame (if resident); frames carry referenced/dirty bits and are recycled with the clock
+// (second chance) policy. Clean pages are dropped without I/O; dirty pages are written back before reuse.
+//
+// Backing stores:
+// - file_page_store: a regular file through stdio (host, or a VFS path such as "/littlefs/swap.bin" on ESP32)
+// - partition_page_store (ESP32): a raw data partition; every write-back erases one flash sector, so keep the
+//   working set large enough that hot pages stay resident - flash endurance is limited.
+//
+//   stdpsram::paged_vector<Record> log("/littlefs/swap.bin", 64);   // 64 resident pages (256 KB)
+//   log.push_back(r);
+//   Record x = log[123456];
+//   log.set(7, x);
+//
+// Elements are returned by value: a page can be evicted by any later access, so no references are handed out.
+
+#ifndef PAT_STDPSRAM_PAGED_H
+#define PAT_STDPSRAM_PAGED_H
+
+#include "PAT_stdpsram.h"
+#include "PAT_stdpsram_memory.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#if defined(ARDUINO)
+#include <esp_partition.h>
+#endif
+
+#ifndef STDPSRAM_PAGE_SIZE
+#define STDPSRAM_PAGE_SIZE 4096 // bytes per page; one flash sector
+#endif
+
+namespace stdpsram
+{
+    ///////////////////////////////////////////////////
+    // file_page_store: pages at page * STDPSRAM_PAGE_SIZE in a file (created or truncated on open)
+    class file_page_store
+    {
+    private:
+        FILE *file;
+        const char *path;
+
+    public:
+        explicit file_page_store(const char *path) : file(std::fopen(path, "w+b")), path(path)
+        {
+            if (!file)
+            {
+                throw std::runtime_error("file_page_store: cannot open file");
+            }
+        }
+
+        ~file_page_store()
+        {
+            std::fclose(file);
+            std::remove(path);
+        }
+
+        file_page_store(const file_page_store &) = delete;
+        file_page_store &operator=(const file_page_store &) = delete;
+
+        void read(std::size_t page, void *dst)
+        {
+            if (std::fseek(file, long(page * STDPSRAM_PAGE_SIZE), SEEK_SET) != 0 ||
+                std::fread(dst, 1, STDPSRAM_PAGE_SIZE, file) != STDPSRAM_PAGE_SIZE)
+            {
+                throw std::runtime_error("file_page_store: read failed");
+            }
+        }
+
+        void write(std::size_t page, const void *src)
+        {
+            if (std::fseek(file, long(page * STDPSRAM_PAGE_SIZE), SEEK_SET) != 0 ||
+                std::fwrite(src, 1, STDPSRAM_PAGE_SIZE, file) != STDPSRAM_PAGE_SIZE)
+            {
+                throw std::runtime_error("file_page_store: write failed");
+            }
+        }
+
+        void sync()
+        {
+            std::fflush(file);
+        }
+    };
+
+#if defined(ARDUINO)
+    ///////////////////////////////////////////////////
+    // partition_page_store: pages in a raw flash data partition (found by label)
+    class partition_page_store
+    {
+    private:
+        const esp_partition_t *part;
+
+    public:
+        explicit partition_page_store(const char *label)
+            : part(esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label))
+        {
+            if (!part)
+            {
+                throw std::runtime_error("partition_page_store: partition not found");
+            }
+        }
+
+        void read(std::size_t page, void *dst)
+        {
+            std::size_t offset = page * STDPSRAM_PAGE_SIZE;
+            if (offset + STDPSRAM_PAGE_SIZE > part->size || esp_partition_read(part, offset, dst, STDPSRAM_PAGE_SIZE) != ESP_OK)
+            {
+                throw std::runtime_error("partition_page_store: read failed");
+            }
+        }
+
+        void write(std::size_t page, const void *src)
+        {
+            std::size_t offset = page * STDPSRAM_PAGE_SIZE;
+            if (offset + STDPSRAM_PAGE_SIZE > part->size ||
+                esp_partition_erase_range(part, offset, STDPSRAM_PAGE_SIZE) != ESP_OK ||
+                esp_partition_write(part, offset, src, STDPSRAM_PAGE_SIZE) != ESP_OK)
+            {
+                throw std::runtime_error("partition_page_store: write failed");
+            }
+        }
+
+        void sync() {}
+    };
+#endif
+
+    ///////////////////////////////////////////////////
+    // paged_vector: vector-like container over a clock-managed PSRAM page cache
+    template <typename T, typename Store = file_page_store>
+    class paged_vector
+    {
+    private:
+        static_assert(std::is_trivially_copyable<T>::value, "paged_vector moves raw pages; T must be trivially copyable");
+        static_assert(sizeof(T) <= STDPSRAM_PAGE_SIZE, "paged_vector: element larger than a page");
+
+        static const std::size_t per_page = STDPSRAM_PAGE_SIZE / sizeof(T);
+        static const uint32_t no_frame = 0xFFFFFFFFu;
+
+        struct page_entry
+        {
+            uint32_t frame; // resident frame or no_frame
+            bool stored;    // has been written to the store
+        };
+
+        struct frame_entry
+        {
+            std::size_t page;
+            bool used;
+            bool referenced;
+            bool dirty;
+        };
+
+    public:
+        struct statistics
+        {
+            std::size_t hits;
+            std::size_t faults;     // accesses that had to bring a page into PSRAM
+            std::size_t reads;      // pages read back from the store
+            std::size_t writebacks; // dirty pages written to the store
+        };
+
+    private:
+        Store store;
+        vector<uint8_t> frames; // resident pages, frame_count * STDPSRAM_PAGE_SIZE
+        vector<frame_entry> frame_table;
+        vector<page_entry> page_table;
+        std::size_t hand;
+        std::size_t count;
+        statistics counters;
+
+        uint8_t *frame_data(std::size_t f)
+        {
+            return frames.data() + f * STDPSRAM_PAGE_SIZE;
+        }
+
+        void write_back(std::size_t f)
+        {
+            frame_entry &fe = frame_table[f];
+            store.write(fe.page, frame_data(f));
+            page_table[fe.page].stored = true;
+            fe.dirty = false;
+            counters.writebacks++;
+        }
+
+        // Clock: skip (and clear) referenced frames until an unreferenced one comes round
+        std::size_t pick_victim()
+        {
+            for (;;)
+            {
+                frame_entry &fe = frame_table[hand];
+                std::size_t f = hand;
+                hand = (hand + 1) % frame_table.size();
+                if (!fe.used || !fe.referenced)
+                {
+                    return f;
+                }
+                fe.referenced = false;
+            }
+        }
+
+        // PSRAM address of page p, faulting it in if needed
+        uint8_t *page(std::size_t p, bool writing)
+        {
+            page_entry &pe = page_table[p];
+            std::size_t f;
+            if (pe.frame != no_frame)
+            {
+                f = pe.frame;
+                counters.hits++;
+            }
+            else
+            {
+                counters.faults++;
+                f = pick_victim();
+                frame_entry &fe = frame_table[f];
+                if (fe.used)
+                {
+                    if (fe.dirty)
+                    {
+                        write_back(f);
+                    }
+                    page_table[fe.page].frame = no_frame;
+                }
+                if (pe.stored)
+                {
+                    store.read(p, frame_data(f));
+                    counters.reads++;
+                }
+                else
+                {
+                    std::memset(frame_data(f), 0, STDPSRAM_PAGE_SIZE);
+                }
+                fe.page = p;
+                fe.used = true;
+                fe.dirty = false;
+                pe.frame = uint32_t(f);
+            }
+            frame_table[f].referenced = true;
+            frame_table[f].dirty = frame_table[f].dirty || writing;
+            return frame_data(f);
+        }
+
+        void put(std::size_t i, const T &value)
+        {
+            std::memcpy(page(i / per_page, true) + (i % per_page) * sizeof(T), &value, sizeof(T));
+        }
+
+    public:
+        typedef T value_type;
+
+        // store_arg: passed to the Store constructor (file path or partition label)
+        // resident_pages: PSRAM working set, in pages of STDPSRAM_PAGE_SIZE bytes
+        template <typename Arg>
+        paged_vector(Arg store_arg, std::size_t resident_pages)
+            : store(store_arg), frames((resident_pages ? resident_pages : 1) * STDPSRAM_PAGE_SIZE),
+              frame_table(resident_pages ? resident_pages : 1, frame_entry{0, false, false, false}),
+              hand(0), count(0), counters()
+        {
+        }
+
+        paged_vector(const paged_vector &) = delete;
+        paged_vector &operator=(const paged_vector &) = delete;
+
+        //--------------------------------
+        T get(std::size_t i)
+        {
+            T value;
+            std::memcpy(&value, page(i / per_page, false) + (i % per_page) * sizeof(T), sizeof(T));
+            return value;
+        }
+
+        T operator[](std::size_t i)
+        {
+            return get(i);
+        }
+
+        T at(std::size_t i)
+        {
+            if (i >= count)
+            {
+                throw std::out_of_range("paged_vector::at");
+            }
+            return get(i);
+        }
+
+        // Checked like at(): an index past the end has no page table entry to mark dirty
+        void set(std::size_t i, const T &value)
+        {
+            if (i >= count)
+            {
+                throw std::out_of_range("paged_vector::set");
+            }
+            put(i, value);
+        }
+
+        void push_back(const T &value)
+        {
+            if (count % per_page == 0)
+            {
+                page_table.push_back(page_entry{no_frame, false});
+            }
+            put(count++, value);
+        }
+
+        void pop_back()
+        {
+            if (!count)
+            {
+                throw std::out_of_range("paged_vector::pop_back");
+            }
+            resize(count - 1);
+        }
+
+        // New elements are zero-initialised; pages beyond the new end are discarded
+        void resize(std::size_t n)
+        {
+            std::size_t pages = (n + per_page - 1) / per_page;
+            while (page_table.size() > pages)
+            {
+                page_entry &pe = page_table.back();
+                if (pe.frame != no_frame)
+                {
+                    frame_table[pe.frame] = frame_entry{0, false, false, false};
+                }
+                page_table.pop_back();
+            }
+            // Zero the tail of a partly used last page so that growing again yields zeros
+            if (n < count && n % per_page)
+            {
+                uint8_t *p = page(n / per_page, true);
+                std::memset(p + (n % per_page) * sizeof(T), 0, (per_page - n % per_page) * sizeof(T));
+            }
+            while (page_table.size() < pages)
+            {
+                page_table.push_back(page_entry{no_frame, false});
+            }
+            count = n;
+        }
+
+        void clear()
+        {
+            resize(0);
+        }
+
+        // Write all dirty pages to the store
+        void flush()
+        {
+            for (std::size_t f = 0; f < frame_table.size(); f++)
+            {
+                if (frame_table[f].used && frame_table[f].dirty)
+                {
+                    write_back(f);
+                }
+            }
+            store.sync();
+        }
+
+        std::size_t size() const noexcept { return count; }
+        bool empty() const noexcept { return count == 0; }
+        std::size_t resident_pages() const noexcept { return frame_table.size(); }
+        std::size_t pages() const noexcept { return page_table.size(); }
+        const statistics &stats() const noexcept { return counters; }
+    };
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_PAGED_H
@@ -0,0 +1,300 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Parallel algorithms over contiguous PSRAM ranges:
+// stdpsram::parallel::for_each / transform / reduce / sort split the work across the available cores: FreeRTOS
+// tasks pinned to the other core(s) on ESP32, std::thread on host builds. The calling task always takes part.
+//
+// Work is handed out dynamically in chunks of STDPSRAM_PARALLEL_CHUNK bytes (a multiple of the cache line).
+// Both cores therefore stream through neighbouring blocks of the same region and share the lines the PSRAM
+// cache fetches, instead of each sweeping its own half and evicting the other's lines.
+//
+//   stdpsram::parallel::for_each(samples, [](float &x) { x *= 0.5f; });
+//   float total = stdpsram::parallel::reduce(samples, 0.0f, std::plus<float>());
+//
+// Callables run concurrently on several cores and must not throw.
+
+#ifndef PAT_STDPSRAM_PARALLEL_H
+#define PAT_STDPSRAM_PARALLEL_H
+
+#include "PAT_stdpsram.h"
+#include "PAT_stdpsram_memory.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+
+#if defined(ARDUINO)
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#else
+#include <thread>
+#endif
+
+#ifndef STDPSRAM_PARALLEL_CHUNK
+#define STDPSRAM_PARALLEL_CHUNK 4096 // bytes per work item
+#endif
+
+#ifndef STDPSRAM_PARALLEL_STACK
+#define STDPSRAM_PARALLEL_STACK 4096 // stack of each helper task on ESP32
+#endif
+
+#ifndef STDPSRAM_PARALLEL_MAX_WORKERS
+#define STDPSRAM_PARALLEL_MAX_WORKERS 8
+#endif
+
+namespace stdpsram
+{
+    namespace parallel
+    {
+        // Number of workers (including the caller) used by the algorithms
+        inline std::size_t workers()
+        {
+#if defined(ARDUINO)
+            std::size_t n = portNUM_PROCESSORS;
+#else
+            std::size_t n = std::thread::hardware_concurrency();
+#endif
+            n = n ? n : 1;
+            return n < STDPSRAM_PARALLEL_MAX_WORKERS ? n : STDPSRAM_PARALLEL_MAX_WORKERS;
+        }
+
+        namespace detail
+        {
+#if defined(ARDUINO)
+            template <typename Body>
+            struct task_args
+            {
+                Body *body;
+                std::size_t index;
+                SemaphoreHandle_t done;
+            };
+
+            template <typename Body>
+            void task_entry(void *arg)
+            {
+                task_args<Body> *a = static_cast<task_args<Body> *>(arg);
+                (*a->body)(a->index);
+                xSemaphoreGive(a->done);
+                vTaskDelete(nullptr);
+            }
+#endif
+
+            // Run body(0..count) concurrently; body(0) runs on the calling task
+            template <typename Body>
+            void run(std::size_t count, Body &&body)
+            {
+                if (count <= 1)
+                {
+                    body(0);
+                    return;
+                }
+#if defined(ARDUINO)
+                typedef typename std::remove_reference<Body>::type body_type;
+                SemaphoreHandle_t done = xSemaphoreCreateCounting(count, 0);
+                if (!done)
+                {
+                    throw std::bad_alloc();
+                }
+                task_args<body_type> args[STDPSRAM_PARALLEL_MAX_WORKERS];
+                std::size_t started = 0;
+                BaseType_t core = xPortGetCoreID();
+                for (std::size_t i = 1; i < count; i++)
+                {
+                    args[i] = task_args<body_type>{&body, i, done};
+                    if (xTaskCreatePinnedToCore(task_entry<body_type>, "stdpsram_par", STDPSRAM_PARALLEL_STACK, &args[i],
+                                                uxTaskPriorityGet(nullptr), nullptr,
+                                                (core + i) % portNUM_PROCESSORS) == pdPASS)
+                    {
+                        started++;
+                    }
+                    else
+                    {
+                        body(i); // no memory for a task: do its share here
+                    }
+                }
+                body(0);
+                for (std::size_t i = 0; i < started; i++)
+                {
+                    xSemaphoreTake(done, portMAX_DELAY);
+                }
+                vSemaphoreDelete(done);
+#else
+                std::thread threads[STDPSRAM_PARALLEL_MAX_WORKERS];
+                for (std::size_t i = 1; i < count; i++)
+                {
+                    try
+                    {
+                        threads[i] = std::thread([&body, i]
+                                                 { body(i); });
+                    }
+                    catch (...)
+                    {
+                        // The running workers reference body: let them finish before the exception unwinds it
+                        for (std::size_t j = 1; j < i; j++)
+                        {
+                            threads[j].join();
+                        }
+                        throw;
+                    }
+                }
+                body(0);
+                for (std::size_t i = 1; i < count; i++)
+                {
+                    threads[i].join();
+                }
+#endif
+            }
+
+            template <typename T>
+            std::size_t chunk_elements()
+            {
+                std::size_t n = STDPSRAM_PARALLEL_CHUNK / sizeof(T);
+                return n ? n : 1;
+            }
+
+            // Workers pull chunk indices from a shared counter until the range is exhausted
+            template <typename T, typename Chunk>
+            void for_chunks(std::size_t n, Chunk &&chunk)
+            {
+                const std::size_t step = chunk_elements<T>();
+                const std::size_t chunks = (n + step - 1) / step;
+                std::size_t count = workers();
+                count = chunks < count ? chunks : count;
+                std::atomic<std::size_t> next(0);
+                run(count, [&](std::size_t worker)
+                    {
+                        std::size_t c;
+                        while ((c = next.fetch_add(1)) < chunks)
+                        {
+                            std::size_t first = c * step;
+                            std::size_t last = first + step < n ? first + step : n;
+                            chunk(worker, first, last);
+                        } });
+            }
+        }
+
+        ///////////////////////////////////////////////////
+        // for_each: f(element) for every element
+        template <typename T, typename F>
+        void for_each(T *first, T *last, F f)
+        {
+            detail::for_chunks<T>(std::size_t(last - first), [first, &f](std::size_t, std::size_t a, std::size_t b)
+                                  { std::for_each(first + a, first + b, f); });
+        }
+
+        template <typename T, typename F>
+        void for_each(vector<T> &v, F f)
+        {
+            for_each(v.data(), v.data() + v.size(), f);
+        }
+
+        ///////////////////////////////////////////////////
+        // transform: out[i] = f(in[i])
+        template <typename T, typename U, typename F>
+        void transform(const T *first, const T *last, U *out, F f)
+        {
+            detail::for_chunks<T>(std::size_t(last - first), [first, out, &f](std::size_t, std::size_t a, std::size_t b)
+                                  { std::transform(first + a, first + b, out + a, f); });
+        }
+
+        // out is resized to in.size()
+        template <typename T, typename U, typename F>
+        void transform(const vector<T> &in, vector<U> &out, F f)
+        {
+            out.resize(in.size());
+            transform(in.data(), in.data() + in.size(), out.data(), f);
+        }
+
+        ///////////////////////////////////////////////////
+        // reduce: op must be associative and commutative (chunks are combined in no particular order)
+        template <typename T, typename R, typename Op>
+        R reduce(const T *first, const T *last, R init, Op op)
+        {
+            const std::size_t n = std::size_t(last - first);
+            R partial[STDPSRAM_PARALLEL_MAX_WORKERS];
+            bool used[STDPSRAM_PARALLEL_MAX_WORKERS] = {};
+            detail::for_chunks<T>(n, [&](std::size_t worker, std::size_t a, std::size_t b)
+                                  {
+                                      R acc = used[worker] ? partial[worker] : R(first[a]);
+                                      for (std::size_t i = used[worker] ? a : a + 1; i < b; i++)
+                                          acc = op(acc, first[i]);
+                                      partial[worker] = acc;
+                                      used[worker] = true; });
+            for (std::size_t w = 0; w < STDPSRAM_PARALLEL_MAX_WORKERS; w++)
+            {
+                if (used[w])
+                {
+                    init = op(init, partial[w]);
+                }
+            }
+            return init;
+        }
+
+        template <typename T, typename R, typename Op>
+        R reduce(const vector<T> &v, R init, Op op)
+        {
+            return reduce(v.data(), v.data() + v.size(), init, op);
+        }
+
+        template <typename T>
+        T reduce(const vector<T> &v)
+        {
+            return reduce(v.data(), v.data() + v.size(), T(), std::plus<T>());
+        }
+
+        ///////////////////////////////////////////////////
+        // sort: one contiguous slice per worker is sorted concurrently, then slices are merged pairwise
+        // (pairs of a pass in parallel) through a PSRAM scratch vector
+        template <typename T, typename Compare>
+        void sort(vector<T> &v, Compare comp)
+        {
+            const std::size_t n = v.size();
+            std::size_t parts = workers();
+            if (n < parts * 1024)
+            {
+                std::sort(v.begin(), v.end(), comp);
+                return;
+            }
+            std::size_t bounds[STDPSRAM_PARALLEL_MAX_WORKERS + 1];
+            for (std::size_t p = 0; p <= parts; p++)
+            {
+                bounds[p] = n * p / parts;
+            }
+            detail::run(parts, [&](std::size_t p)
+                        { std::sort(v.begin() + bounds[p], v.begin() + bounds[p + 1], comp); });
+
+            vector<T> scratch(v.size());
+            vector<T> *src = &v;
+            vector<T> *dst = &scratch;
+            for (std::size_t width = 1; width < parts; width *= 2)
+            {
+                std::size_t pairs = (parts + 2 * width - 1) / (2 * width);
+                detail::run(pairs, [&](std::size_t pair)
+                            {
+                                std::size_t a = bounds[pair * 2 * width];
+                                std::size_t m = bounds[std::min(parts, pair * 2 * width + width)];
+                                std::size_t b = bounds[std::min(parts, pair * 2 * width + 2 * width)];
+                                std::merge(std::make_move_iterator(src->begin() + a), std::make_move_iterator(src->begin() + m),
+                                           std::make_move_iterator(src->begin() + m), std::make_move_iterator(src->begin() + b),
+                                           dst->begin() + a, comp); });
+                std::swap(src, dst);
+            }
+            if (src != &v)
+            {
+                v.swap(*src);
+            }
+        }
+
+        template <typename T>
+        void sort(vector<T> &v)
+        {
+            parallel::sort(v, std::less<T>());
+        }
+    }
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_PARALLEL_H
@@ -0,0 +1,777 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Relocatable PSRAM heaps:
+// Everything inside a relocatable::arena refers to other objects through offset_ptr (an offset from the
+// pointer's own address) and the arena's bookkeeping uses offsets from its base. The whole arena image can
+// therefore be written to a file and brought back at a different address - read into PSRAM with a single
+// fread, or mmap'ed on host - and used immediately, without any deserialisation pass.
+//
+//   typedef stdpsram::relocatable::map<uint32_t, float> table_t;
+//   stdpsram::relocatable::arena a = stdpsram::relocatable::arena::create(256 * 1024);
+//   table_t *table = a.construct<table_t>(a);
+//   (*table)[42] = 1.5f;
+//   a.set_root(table);
+//   a.save("/littlefs/tables.img");
+//   ...
+//   stdpsram::relocatable::arena b = stdpsram::relocatable::arena::load("/littlefs/tables.img");
+//   table_t *same = b.root<table_t>();
+//
+// Rules: containers (and anything reachable from the root) must be constructed inside the arena; element types
+// may hold offset_ptr but not raw pointers; the image is native byte order and alignment is at most 8 bytes.
+// relocatable::map is a sorted flat map: O(log n) lookup and compact storage, O(n) insertion - made for lookup
+// tables that are built once and loaded many times.
+
+#ifndef PAT_STDPSRAM_RELOCATABLE_H
+#define PAT_STDPSRAM_RELOCATABLE_H
+
+#include "PAT_stdpsram.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#if !defined(ARDUINO)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace stdpsram
+{
+    ///////////////////////////////////////////////////
+    // offset_ptr: self-relative pointer; an offset of 0 means null
+    template <typename T>
+    class offset_ptr
+    {
+    private:
+        std::ptrdiff_t off;
+
+        void set(const T *p) noexcept
+        {
+            off = p ? reinterpret_cast<const char *>(p) - reinterpret_cast<const char *>(this) : 0;
+        }
+
+    public:
+        offset_ptr() noexcept : off(0) {}
+        offset_ptr(T *p) noexcept { set(p); }
+        offset_ptr(const offset_ptr &other) noexcept { set(other.get()); }
+
+        offset_ptr &operator=(const offset_ptr &other) noexcept
+        {
+            set(other.get());
+            return *this;
+        }
+
+        offset_ptr &operator=(T *p) noexcept
+        {
+            set(p);
+            return *this;
+        }
+
+        T *get() const noexcept
+        {
+            return off ? reinterpret_cast<T *>(const_cast<char *>(reinterpret_cast<const char *>(this)) + off) : nullptr;
+        }
+
+        T &operator*() const noexcept { return *get(); }
+        T *operator->() const noexcept { return get(); }
+        T &operator[](std::size_t i) const noexcept { return get()[i]; }
+        explicit operator bool() const noexcept { return off != 0; }
+    };
+
+    namespace relocatable
+    {
+        namespace detail
+        {
+            static const uint32_t arena_magic = 0x52525350u; // "PSRR"
+            static const uint32_t arena_format = 1;
+            static const uint32_t granule = 8;
+            static const uint32_t small_classes = 128; // blocks up to 1 KB are recycled by exact size
+
+            // Lives at offset 0 of the image; every link is an offset from the image base (0 = none)
+            struct arena_header
+            {
+                uint32_t magic;
+                uint32_t format;
+                uint32_t capacity;
+                uint32_t used;
+                uint32_t root;
+                uint32_t large_free;
+                uint32_t small_free[small_classes];
+            };
+
+            struct block_header
+            {
+                uint32_t size; // total block size including this header
+                uint32_t next; // free-list link while free
+            };
+
+            static const uint32_t first_block = (sizeof(arena_header) + granule - 1) & ~(granule - 1);
+
+            inline char *base(arena_header *h)
+            {
+                return reinterpret_cast<char *>(h);
+            }
+
+            inline block_header *block_at(arena_header *h, uint32_t offset)
+            {
+                return reinterpret_cast<block_header *>(base(h) + offset);
+            }
+
+            inline void *allocate(arena_header *h, std::size_t n)
+            {
+                if (n > h->capacity)
+                {
+                    throw std::bad_alloc();
+                }
+                uint32_t total = uint32_t((n + granule - 1) & ~std::size_t(granule - 1)) + sizeof(block_header);
+                uint32_t offset = 0;
+                if (total / granule - 1 < small_classes && h->small_free[total / granule - 1])
+                {
+                    uint32_t &head = h->small_free[total / granule - 1];
+                    offset = head;
+                    head = block_at(h, offset)->next;
+                }
+                else
+                {
+                    // First fit over the large free list
+                    uint32_t *link = &h->large_free;
+                    while (*link && block_at(h, *link)->size < total)
+                    {
+                        link = &block_at(h, *link)->next;
+                    }
+                    if (*link)
+                    {
+                        offset = *link;
+                        *link = block_at(h, offset)->next;
+                    }
+                    else
+                    {
+                        if (h->capacity - h->used < total)
+                        {
+                            throw std::bad_alloc();
+                        }
+                        offset = h->used;
+                        h->used += total;
+                        block_at(h, offset)->size = total;
+                    }
+                }
+                block_at(h, offset)->next = 0;
+                return base(h) + offset + sizeof(block_header);
+            }
+
+            inline void deallocate(arena_header *h, void *p)
+            {
+                if (!p)
+                {
+                    return;
+                }
+                uint32_t offset = uint32_t(static_cast<char *>(p) - base(h)) - sizeof(block_header);
+                block_header *b = block_at(h, offset);
+                uint32_t *head = b->size / granule - 1 < small_classes ? &h->small_free[b->size / granule - 1] : &h->large_free;
+                b->next = *head;
+                *head = offset;
+            }
+        }
+
+        ///////////////////////////////////////////////////
+        // arena: owner of one relocatable image (PSRAM buffer or, on host, a file mapping)
+        class arena
+        {
+        private:
+            detail::arena_header *header;
+            std::size_t mapped; // non-zero when the image is an mmap'ed file
+
+            arena(detail::arena_header *h, std::size_t mapped_size) : header(h), mapped(mapped_size) {}
+
+            // The header must describe an image of at most size bytes whose used part covers the header itself
+            static void check(const detail::arena_header *h, std::size_t size)
+            {
+                if (size < detail::first_block || h->magic != detail::arena_magic || h->format != detail::arena_format ||
+                    h->used < detail::first_block || h->used > size || h->root >= h->used)
+                {
+                    throw std::runtime_error("relocatable::arena: not a valid arena image");
+                }
+            }
+
+            void release()
+            {
+                if (!header)
+                {
+                    return;
+                }
+#if !defined(ARDUINO)
+                if (mapped)
+                {
+                    munmap(header, mapped);
+                    header = nullptr;
+                    return;
+                }
+#endif
+                PSRAMAllocator<char>().deallocate(reinterpret_cast<char *>(header), header->capacity);
+                header = nullptr;
+            }
+
+        public:
+            // Fresh, empty arena of the given size in PSRAM
+            static arena create(std::size_t capacity)
+            {
+                if (capacity < detail::first_block || capacity > 0xFFFFFFFFu)
+                {
+                    throw std::invalid_argument("relocatable::arena: bad capacity");
+                }
+                detail::arena_header *h = reinterpret_cast<detail::arena_header *>(PSRAMAllocator<char>().allocate(capacity));
+                std::memset(h, 0, sizeof(*h));
+                h->magic = detail::arena_magic;
+                h->format = detail::arena_format;
+                h->capacity = uint32_t(capacity);
+                h->used = detail::first_block;
+                return arena(h, 0);
+            }
+
+            // Read a saved image into a new PSRAM buffer of its original capacity: one fread, no fix-ups
+            static arena load(const char *path)
+            {
+                FILE *f = std::fopen(path, "rb");
+                if (!f)
+                {
+                    throw std::runtime_error("relocatable::arena: cannot open image");
+                }
+                detail::arena_header probe;
+                if (std::fread(&probe, sizeof(probe), 1, f) != 1)
+                {
+                    std::fclose(f);
+                    throw std::runtime_error("relocatable::arena: truncated image");
+                }
+                try
+                {
+                    check(&probe, probe.capacity);
+                }
+                catch (...)
+                {
+                    std::fclose(f);
+                    throw;
+                }
+                char *image = PSRAMAllocator<char>().allocate(probe.capacity);
+                std::memcpy(image, &probe, sizeof(probe));
+                std::size_t rest = probe.used - sizeof(probe);
+                bool ok = std::fread(image + sizeof(probe), 1, rest, f) == rest;
+                std::fclose(f);
+                if (!ok)
+                {
+                    PSRAMAllocator<char>().deallocate(image, probe.capacity);
+                    throw std::runtime_error("relocatable::arena: truncated image");
+                }
+                return arena(reinterpret_cast<detail::arena_header *>(image), 0);
+            }
+
+#if !defined(ARDUINO)
+            // Host only: map a saved image copy-on-write. Allocation is limited to the size of the file.
+            static arena map(const char *path)
+            {
+                int fd = ::open(path, O_RDONLY);
+                if (fd < 0)
+                {
+                    throw std::runtime_error("relocatable::arena: cannot open image");
+                }
+                struct stat st;
+                void *p = MAP_FAILED;
+                if (::fstat(fd, &st) == 0 && st.st_size > 0)
+                {
+                    p = ::mmap(nullptr, std::size_t(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+                }
+                ::close(fd);
+                if (p == MAP_FAILED)
+                {
+                    throw std::runtime_error("relocatable::arena: cannot map image");
+                }
+                detail::arena_header *h = static_cast<detail::arena_header *>(p);
+                try
+                {
+                    check(h, std::size_t(st.st_size));
+                }
+                catch (...)
+                {
+                    ::munmap(p, std::size_t(st.st_size));
+                    throw;
+                }
+                h->capacity = uint32_t(st.st_size);
+                return arena(h, std::size_t(st.st_size));
+            }
+#endif
+
+            arena(arena &&other) noexcept : header(other.header), mapped(other.mapped)
+            {
+                other.header = nullptr;
+            }
+
+            arena &operator=(arena &&other) noexcept
+            {
+                if (this != &other)
+                {
+                    release();
+                    header = other.header;
+                    mapped = other.mapped;
+                    other.header = nullptr;
+                }
+                return *this;
+            }
+
+            arena(const arena &) = delete;
+            arena &operator=(const arena &) = delete;
+
+            // Frees the image; objects inside are not destroyed
+            ~arena()
+            {
+                release();
+            }
+
+            //--------------------------------
+            // Write the used part of the image; it can be restored with load() (or map() on host)
+            void save(const char *path) const
+            {
+                FILE *f = std::fopen(path, "wb");
+                if (!f)
+                {
+                    throw std::runtime_error("relocatable::arena: cannot create image");
+                }
+                bool ok = std::fwrite(header, 1, header->used, f) == header->used;
+                ok = std::fclose(f) == 0 && ok;
+                if (!ok)
+                {
+                    throw std::runtime_error("relocatable::arena: write failed");
+                }
+            }
+
+            void *allocate(std::size_t n)
+            {
+                return detail::allocate(header, n);
+            }
+
+            void deallocate(void *p)
+            {
+                detail::deallocate(header, p);
+            }
+
+            template <typename T, typename... Args>
+            T *construct(Args &&...args)
+            {
+                static_assert(alignof(T) <= detail::granule, "relocatable::arena aligns to 8 bytes");
+                void *p = allocate(sizeof(T));
+                try
+                {
+                    return new (p) T(std::forward<Args>(args)...);
+                }
+                catch (...)
+                {
+                    deallocate(p);
+                    throw;
+                }
+            }
+
+            template <typename T>
+            void destroy(T *p)
+            {
+                if (p)
+                {
+                    p->~T();
+                    deallocate(p);
+                }
+            }
+
+            // Entry point of the data stored in the arena
+            template <typename T>
+            void set_root(T *p)
+            {
+                header->root = p ? uint32_t(reinterpret_cast<char *>(p) - detail::base(header)) : 0;
+            }
+
+            template <typename T>
+            T *root() const
+            {
+                return header->root ? reinterpret_cast<T *>(detail::base(header) + header->root) : nullptr;
+            }
+
+            std::size_t capacity() const noexcept { return header->capacity; }
+            std::size_t used() const noexcept { return header->used; }
+
+            detail::arena_header *image() const noexcept { return header; }
+        };
+
+        ///////////////////////////////////////////////////
+        // vector: growable array in an arena
+        template <typename T>
+        class vector
+        {
+        private:
+            offset_ptr<detail::arena_header> home;
+            offset_ptr<T> items;
+            uint32_t count;
+            uint32_t cap;
+
+            void grow(std::size_t wanted)
+            {
+                std::size_t n = cap ? cap : 4;
+                while (n < wanted)
+                {
+                    n *= 2;
+                }
+                T *fresh = static_cast<T *>(detail::allocate(home.get(), n * sizeof(T)));
+                T *old = items.get();
+                for (uint32_t i = 0; i < count; i++)
+                {
+                    new (fresh + i) T(std::move(old[i]));
+                    old[i].~T();
+                }
+                detail::deallocate(home.get(), old);
+                items = fresh;
+                cap = uint32_t(n);
+            }
+
+        public:
+            typedef T value_type;
+            typedef T *iterator;
+            typedef const T *const_iterator;
+
+            static_assert(alignof(T) <= detail::granule, "relocatable containers align to 8 bytes");
+
+            explicit vector(arena &a) : home(a.image()), count(0), cap(0) {}
+
+            ~vector()
+            {
+                clear();
+                detail::deallocate(home.get(), items.get());
+            }
+
+            vector(const vector &) = delete;
+            vector &operator=(const vector &) = delete;
+
+            void reserve(std::size_t n)
+            {
+                if (n > cap)
+                {
+                    grow(n);
+                }
+            }
+
+            template <typename... Args>
+            T &emplace_back(Args &&...args)
+            {
+                if (count == cap)
+                {
+                    grow(count + 1);
+                }
+                T *slot = new (items.get() + count) T(std::forward<Args>(args)...);
+                count++;
+                return *slot;
+            }
+
+            void push_back(const T &value) { emplace_back(value); }
+
+            void pop_back()
+            {
+                items[--count].~T();
+            }
+
+            void resize(std::size_t n)
+            {
+                while (count > n)
+                {
+                    pop_back();
+                }
+                reserve(n);
+                while (count < n)
+                {
+                    emplace_back();
+                }
+            }
+
+            // Insert before pos, shifting later elements up
+            iterator insert(const_iterator pos, const T &value)
+            {
+                std::size_t at = std::size_t(pos - begin());
+                emplace_back(value);
+                std::rotate(begin() + at, end() - 1, end());
+                return begin() + at;
+            }
+
+            iterator erase(const_iterator pos)
+            {
+                std::size_t at = std::size_t(pos - begin());
+                std::move(begin() + at + 1, end(), begin() + at);
+                pop_back();
+                return begin() + at;
+            }
+
+            void clear()
+            {
+                while (count)
+                {
+                    pop_back();
+                }
+            }
+
+            T &operator[](std::size_t i) { return items[i]; }
+            const T &operator[](std::size_t i) const { return items[i]; }
+            T *data() { return items.get(); }
+            const T *data() const { return items.get(); }
+            iterator begin() { return items.get(); }
+            iterator end() { return items.get() + count; }
+            const_iterator begin() const { return items.get(); }
+            const_iterator end() const { return items.get() + count; }
+            std::size_t size() const noexcept { return count; }
+            std::size_t capacity() const noexcept { return cap; }
+            bool empty() const noexcept { return count == 0; }
+        };
+
+        ///////////////////////////////////////////////////
+        // list: doubly linked list in an arena
+        template <typename T>
+        class list
+        {
+        private:
+            struct node
+            {
+                offset_ptr<node> prev;
+                offset_ptr<node> next;
+                T value;
+
+                template <typename... Args>
+                explicit node(Args &&...args) : value(std::forward<Args>(args)...) {}
+            };
+
+            offset_ptr<detail::arena_header> home;
+            offset_ptr<node> head;
+            offset_ptr<node> tail;
+            uint32_t count;
+
+            template <typename... Args>
+            node *make(Args &&...args)
+            {
+                void *p = detail::allocate(home.get(), sizeof(node));
+                return new (p) node(std::forward<Args>(args)...);
+            }
+
+        public:
+            typedef T value_type;
+
+            template <typename V, typename N>
+            class basic_iterator
+            {
+            private:
+                N *at;
+                friend class list;
+
+            public:
+                typedef std::bidirectional_iterator_tag iterator_category;
+                typedef T value_type;
+                typedef std::ptrdiff_t difference_type;
+                typedef V *pointer;
+                typedef V &reference;
+
+                explicit basic_iterator(N *n = nullptr) : at(n) {}
+                V &operator*() const { return at->value; }
+                V *operator->() const { return &at->value; }
+                basic_iterator &operator++()
+                {
+                    at = at->next.get();
+                    return *this;
+                }
+                basic_iterator operator++(int)
+                {
+                    basic_iterator old = *this;
+                    ++*this;
+                    return old;
+                }
+                bool operator==(const basic_iterator &o) const { return at == o.at; }
+                bool operator!=(const basic_iterator &o) const { return at != o.at; }
+            };
+
+            typedef basic_iterator<T, node> iterator;
+            typedef basic_iterator<const T, const node> const_iterator;
+
+            static_assert(alignof(T) <= detail::granule, "relocatable containers align to 8 bytes");
+
+            explicit list(arena &a) : home(a.image()), count(0) {}
+
+            ~list()
+            {
+                clear();
+            }
+
+            list(const list &) = delete;
+            list &operator=(const list &) = delete;
+
+            template <typename... Args>
+            T &emplace_back(Args &&...args)
+            {
+                node *n = make(std::forward<Args>(args)...);
+                n->prev = tail.get();
+                if (tail)
+                    tail->next = n;
+                else
+                    head = n;
+                tail = n;
+                count++;
+                return n->value;
+            }
+
+            template <typename... Args>
+            T &emplace_front(Args &&...args)
+            {
+                node *n = make(std::forward<Args>(args)...);
+                n->next = head.get();
+                if (head)
+                    head->prev = n;
+                else
+                    tail = n;
+                head = n;
+                count++;
+                return n->value;
+            }
+
+            void push_back(const T &value) { emplace_back(value); }
+            void push_front(const T &value) { emplace_front(value); }
+
+            iterator erase(iterator pos)
+            {
+                node *n = pos.at;
+                node *after = n->next.get();
+                if (n->prev)
+                    n->prev->next = after;
+                else
+                    head = after;
+                if (after)
+                    after->prev = n->prev.get();
+                else
+                    tail = n->prev.get();
+                n->~node();
+                detail::deallocate(home.get(), n);
+                count--;
+                return iterator(after);
+            }
+
+            void clear()
+            {
+                while (head)
+                {
+                    erase(iterator(head.get()));
+                }
+            }
+
+            T &front() { return head->value; }
+            T &back() { return tail->value; }
+            iterator begin() { return iterator(head.get()); }
+            iterator end() { return iterator(); }
+            const_iterator begin() const { return const_iterator(head.get()); }
+            const_iterator end() const { return const_iterator(); }
+            std::size_t size() const noexcept { return count; }
+            bool empty() const noexcept { return count == 0; }
+        };
+
+        ///////////////////////////////////////////////////
+        // map: sorted flat map in an arena
+        template <typename Key, typename Value>
+        class map
+        {
+        public:
+            struct value_type
+            {
+                Key first;
+                Value second;
+
+                value_type(const Key &k, const Value &v) : first(k), second(v) {}
+            };
+
+        private:
+            vector<value_type> entries;
+
+            struct key_less
+            {
+                bool operator()(const value_type &e, const Key &k) const { return e.first < k; }
+            };
+
+        public:
+            typedef typename vector<value_type>::iterator iterator;
+            typedef typename vector<value_type>::const_iterator const_iterator;
+
+            explicit map(arena &a) : entries(a) {}
+
+            iterator find(const Key &k)
+            {
+                iterator it = std::lower_bound(entries.begin(), entries.end(), k, key_less());
+                return it != entries.end() && !(k < it->first) ? it : entries.end();
+            }
+
+            const_iterator find(const Key &k) const
+            {
+                const_iterator it = std::lower_bound(entries.begin(), entries.end(), k, key_less());
+                return it != entries.end() && !(k < it->first) ? it : entries.end();
+            }
+
+            std::size_t count(const Key &k) const { return find(k) != end() ? 1 : 0; }
+
+            // Inserts or overwrites; returns the stored value
+            Value &insert_or_assign(const Key &k, const Value &v)
+            {
+                iterator it = std::lower_bound(entries.begin(), entries.end(), k, key_less());
+                if (it != entries.end() && !(k < it->first))
+                {
+                    it->second = v;
+                    return it->second;
+                }
+                return entries.insert(it, value_type(k, v))->second;
+            }
+
+            Value &operator[](const Key &k)
+            {
+                iterator it = std::lower_bound(entries.begin(), entries.end(), k, key_less());
+                if (it != entries.end() && !(k < it->first))
+                {
+                    return it->second;
+                }
+                return entries.insert(it, value_type(k, Value()))->second;
+            }
+
+            Value &at(const Key &k)
+            {
+                iterator it = find(k);
+                if (it == end())
+                {
+                    throw std::out_of_range("relocatable::map::at");
+                }
+                return it->second;
+            }
+
+            std::size_t erase(const Key &k)
+            {
+                iterator it = find(k);
+                if (it == end())
+                {
+                    return 0;
+                }
+                entries.erase(it);
+                return 1;
+            }
+
+            void reserve(std::size_t n) { entries.reserve(n); }
+            void clear() { entries.clear(); }
+            iterator begin() { return entries.begin(); }
+            iterator end() { return entries.end(); }
+            const_iterator begin() const { return entries.begin(); }
+            const_iterator end() const { return entries.end(); }
+            std::size_t size() const noexcept { return entries.size(); }
+            bool empty() const noexcept { return entries.empty(); }
+        };
+    }
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_RELOCATABLE_H
@@ -0,0 +1,554 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Bulk kernels over contiguous PSRAM data:
+// sum, min_max, dot, scale, axpy, clamp and convert for float and int16_t spans (and stdpsram::vector overloads).
+// One pass per call with wide loads and several independent accumulators, so the PSRAM cache streams
+// sequentially instead of stalling on a dependency chain per element.
+//
+// The backend is selected at compile time:
+// - AVX / AVX2 or SSE2 on host builds (x86)
+// - ESP32-S3: float dot/scale go through ESP-DSP (PIE-optimised) when the esp-dsp component is available;
+//   ESP-DSP has no fused y += a * x, so axpy (and everything else) uses the scalar code there
+// - everything else: portable, 4-way unrolled scalar code
+// stdpsram::simd::backend() reports which one was built.
+
+#ifndef PAT_STDPSRAM_SIMD_H
+#define PAT_STDPSRAM_SIMD_H
+
+#include "PAT_stdpsram.h"
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__AVX2__)
+#define STDPSRAM_SIMD_AVX2 1
+#endif
+#if defined(__AVX__)
+#define STDPSRAM_SIMD_AVX 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#define STDPSRAM_SIMD_SSE2 1
+#include <immintrin.h>
+#endif
+#if defined(CONFIG_IDF_TARGET_ESP32S3) && defined(__has_include)
+#if __has_include(<esp_dsp.h>)
+#define STDPSRAM_SIMD_ESP_DSP 1
+#include <esp_dsp.h>
+#endif
+#endif
+
+namespace stdpsram
+{
+    namespace simd
+    {
+        inline const char *backend()
+        {
+#if defined(STDPSRAM_SIMD_AVX2)
+            return "avx2";
+#elif defined(STDPSRAM_SIMD_AVX)
+            return "avx";
+#elif defined(STDPSRAM_SIMD_SSE2)
+            return "sse2";
+#elif defined(STDPSRAM_SIMD_ESP_DSP)
+            return "esp32s3-pie";
+#else
+            return "scalar";
+#endif
+        }
+
+        namespace detail
+        {
+            // Round to nearest (ties to even, like the SSE conversion) and saturate; NaN maps to -32768 as in
+            // the vector paths, whose max(x, -32768) yields -32768 for NaN
+            inline int16_t saturate_s16(float x)
+            {
+                if (!(x > -32768.0f))
+                    return -32768;
+                if (x >= 32767.0f)
+                    return 32767;
+                return static_cast<int16_t>(std::nearbyint(x));
+            }
+
+#if defined(STDPSRAM_SIMD_SSE2)
+            // Clamp to the int16 range before converting: out-of-range floats would otherwise convert to INT_MIN
+            inline __m128i saturate_epi32(__m128 v)
+            {
+                return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-32768.0f)), _mm_set1_ps(32767.0f)));
+            }
+
+            inline float hsum(__m128 v)
+            {
+                __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+                __m128 sums = _mm_add_ps(v, shuf);
+                shuf = _mm_movehl_ps(shuf, sums);
+                return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+            }
+
+            // Add the four int32 lanes into a 64-bit total
+            inline int64_t hsum_epi32(__m128i v)
+            {
+                alignas(16) int32_t lanes[4];
+                _mm_store_si128(reinterpret_cast<__m128i *>(lanes), v);
+                return int64_t(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+            }
+#endif
+#if defined(STDPSRAM_SIMD_AVX)
+            inline float hsum(__m256 v)
+            {
+                return hsum(_mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1)));
+            }
+#endif
+        }
+
+        ///////////////////////////////////////////////////
+        // sum
+        inline float sum(const float *data, std::size_t n)
+        {
+            std::size_t i = 0;
+            float total = 0.0f;
+#if defined(STDPSRAM_SIMD_AVX)
+            __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+            for (; i + 16 <= n; i += 16)
+            {
+                a0 = _mm256_add_ps(a0, _mm256_loadu_ps(data + i));
+                a1 = _mm256_add_ps(a1, _mm256_loadu_ps(data + i + 8));
+            }
+            total = detail::hsum(_mm256_add_ps(a0, a1));
+#elif defined(STDPSRAM_SIMD_SSE2)
+            __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+            for (; i + 8 <= n; i += 8)
+            {
+                a0 = _mm_add_ps(a0, _mm_loadu_ps(data + i));
+                a1 = _mm_add_ps(a1, _mm_loadu_ps(data + i + 4));
+            }
+            total = detail::hsum(_mm_add_ps(a0, a1));
+#else
+            float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+            for (; i + 4 <= n; i += 4)
+            {
+                s0 += data[i];
+                s1 += data[i + 1];
+                s2 += data[i + 2];
+                s3 += data[i + 3];
+            }
+            total = (s0 + s1) + (s2 + s3);
+#endif
+            for (; i < n; i++)
+                total += data[i];
+            return total;
+        }
+
+        inline int64_t sum(const int16_t *data, std::size_t n)
+        {
+            std::size_t i = 0;
+            int64_t total = 0;
+#if defined(STDPSRAM_SIMD_AVX2)
+            const __m256i ones = _mm256_set1_epi16(1);
+            while (i + 16 <= n)
+            {
+                // Each madd adds at most 2 * 32768 to a lane; flush before int32 lanes can overflow
+                __m256i acc = _mm256_setzero_si256();
+                std::size_t stop = (n - i) / 16 > 16384 ? i + 16 * 16384 : n - (n - i) % 16;
+                for (; i < stop; i += 16)
+                    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)), ones));
+                total += detail::hsum_epi32(_mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+            }
+#elif defined(STDPSRAM_SIMD_SSE2)
+            const __m128i ones = _mm_set1_epi16(1);
+            while (i + 8 <= n)
+            {
+                __m128i acc = _mm_setzero_si128();
+                std::size_t stop = (n - i) / 8 > 16384 ? i + 8 * 16384 : n - (n - i) % 8;
+                for (; i < stop; i += 8)
+                    acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)), ones));
+                total += detail::hsum_epi32(acc);
+            }
+#else
+            int32_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+            while (i + 4 <= n)
+            {
+                // 4 * 16384 elements per flush keeps the int32 partial sums in range
+                std::size_t stop = (n - i) / 4 > 16384 ? i + 4 * 16384 : n - (n - i) % 4;
+                for (; i < stop; i += 4)
+                {
+                    s0 += data[i];
+                    s1 += data[i + 1];
+                    s2 += data[i + 2];
+                    s3 += data[i + 3];
+                }
+                total += int64_t(s0) + s1 + s2 + s3;
+                s0 = s1 = s2 = s3 = 0;
+            }
+#endif
+            for (; i < n; i++)
+                total += data[i];
+            return total;
+        }
+
+        ///////////////////////////////////////////////////
+        // min_max: lo/hi are left untouched when n == 0
+        inline void min_max(const float *data, std::size_t n, float &lo, float &hi)
+        {
+            if (n == 0)
+                return;
+            std::size_t i = 0;
+            float mn = data[0], mx = data[0];
+#if defined(STDPSRAM_SIMD_SSE2)
+            if (n >= 4)
+            {
+                __m128 vmin = _mm_loadu_ps(data), vmax = vmin;
+                for (i = 4; i + 4 <= n; i += 4)
+                {
+                    __m128 v = _mm_loadu_ps(data + i);
+                    vmin = _mm_min_ps(vmin, v);
+                    vmax = _mm_max_ps(vmax, v);
+                }
+                alignas(16) float a[4], b[4];
+                _mm_store_ps(a, vmin);
+                _mm_store_ps(b, vmax);
+                for (int k = 0; k < 4; k++)
+                {
+                    mn = a[k] < mn ? a[k] : mn;
+                    mx = b[k] > mx ? b[k] : mx;
+                }
+            }
+#endif
+            for (; i < n; i++)
+            {
+                mn = data[i] < mn ? data[i] : mn;
+                mx = data[i] > mx ? data[i] : mx;
+            }
+            lo = mn;
+            hi = mx;
+        }
+
+        inline void min_max(const int16_t *data, std::size_t n, int16_t &lo, int16_t &hi)
+        {
+            if (n == 0)
+                return;
+            std::size_t i = 0;
+            int16_t mn = data[0], mx = data[0];
+#if defined(STDPSRAM_SIMD_SSE2)
+            if (n >= 8)
+            {
+                __m128i vmin = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data)), vmax = vmin;
+                for (i = 8; i + 8 <= n; i += 8)
+                {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+                    vmin = _mm_min_epi16(vmin, v);
+                    vmax = _mm_max_epi16(vmax, v);
+                }
+                alignas(16) int16_t a[8], b[8];
+                _mm_store_si128(reinterpret_cast<__m128i *>(a), vmin);
+                _mm_store_si128(reinterpret_cast<__m128i *>(b), vmax);
+                for (int k = 0; k < 8; k++)
+                {
+                    mn = a[k] < mn ? a[k] : mn;
+                    mx = b[k] > mx ? b[k] : mx;
+                }
+            }
+#endif
+            for (; i < n; i++)
+            {
+                mn = data[i] < mn ? data[i] : mn;
+                mx = data[i] > mx ? data[i] : mx;
+            }
+            lo = mn;
+            hi = mx;
+        }
+
+        ///////////////////////////////////////////////////
+        // dot
+        inline float dot(const float *a, const float *b, std::size_t n)
+        {
+#if defined(STDPSRAM_SIMD_ESP_DSP)
+            float result = 0.0f;
+            dsps_dotprod_f32(a, b, &result, static_cast<int>(n));
+            return result;
+#else
+            std::size_t i = 0;
+            float total = 0.0f;
+#if defined(STDPSRAM_SIMD_AVX)
+            __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+            for (; i + 16 <= n; i += 16)
+            {
+                a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+                a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+            }
+            total = detail::hsum(_mm256_add_ps(a0, a1));
+#elif defined(STDPSRAM_SIMD_SSE2)
+            __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+            for (; i + 8 <= n; i += 8)
+            {
+                a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+                a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+            }
+            total = detail::hsum(_mm_add_ps(a0, a1));
+#else
+            float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+            for (; i + 4 <= n; i += 4)
+            {
+                s0 += a[i] * b[i];
+                s1 += a[i + 1] * b[i + 1];
+                s2 += a[i + 2] * b[i + 2];
+                s3 += a[i + 3] * b[i + 3];
+            }
+            total = (s0 + s1) + (s2 + s3);
+#endif
+            for (; i < n; i++)
+                total += a[i] * b[i];
+            return total;
+#endif
+        }
+
+        // Products are widened to 32 bits before any addition: madd would add two products in int32, which
+        // wraps for (-32768 * -32768) * 2
+        inline int64_t dot(const int16_t *a, const int16_t *b, std::size_t n)
+        {
+            std::size_t i = 0;
+            int64_t total = 0;
+#if defined(STDPSRAM_SIMD_AVX2)
+            __m256i acc = _mm256_setzero_si256();
+            for (; i + 16 <= n; i += 16)
+            {
+                __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+                __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+                __m256i lo = _mm256_mullo_epi16(va, vb);
+                __m256i hi = _mm256_mulhi_epi16(va, vb);
+                __m256i p0 = _mm256_unpacklo_epi16(lo, hi); // 8 full int32 products
+                __m256i p1 = _mm256_unpackhi_epi16(lo, hi);
+                acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(p0)));
+                acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(p0, 1)));
+                acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(p1)));
+                acc = _mm256_add_epi64(acc, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(p1, 1)));
+            }
+            alignas(32) int64_t lanes[4];
+            _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), acc);
+            total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(STDPSRAM_SIMD_SSE2)
+            __m128i acc = _mm_setzero_si128();
+            for (; i + 8 <= n; i += 8)
+            {
+                __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+                __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+                __m128i lo = _mm_mullo_epi16(va, vb);
+                __m128i hi = _mm_mulhi_epi16(va, vb);
+                __m128i p0 = _mm_unpacklo_epi16(lo, hi); // 4 full int32 products
+                __m128i p1 = _mm_unpackhi_epi16(lo, hi);
+                // Sign-extend to int64 (SSE2 has no cvtepi32_epi64)
+                __m128i s0 = _mm_srai_epi32(p0, 31), s1 = _mm_srai_epi32(p1, 31);
+                acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(p0, s0));
+                acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(p0, s0));
+                acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(p1, s1));
+                acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(p1, s1));
+            }
+            alignas(16) int64_t lanes[2];
+            _mm_store_si128(reinterpret_cast<__m128i *>(lanes), acc);
+            total = lanes[0] + lanes[1];
+#else
+            int64_t s0 = 0, s1 = 0;
+            for (; i + 4 <= n; i += 4)
+            {
+                s0 += int64_t(int32_t(a[i]) * b[i]) + int32_t(a[i + 1]) * b[i + 1];
+                s1 += int64_t(int32_t(a[i + 2]) * b[i + 2]) + int32_t(a[i + 3]) * b[i + 3];
+            }
+            total = s0 + s1;
+#endif
+            for (; i < n; i++)
+                total += int32_t(a[i]) * b[i];
+            return total;
+        }
+
+        ///////////////////////////////////////////////////
+        // scale: data[i] *= factor (int16_t results are rounded and saturated)
+        inline void scale(float *data, std::size_t n, float factor)
+        {
+#if defined(STDPSRAM_SIMD_ESP_DSP)
+            dsps_mulc_f32(data, data, static_cast<int>(n), factor, 1, 1);
+#else
+            std::size_t i = 0;
+#if defined(STDPSRAM_SIMD_AVX)
+            const __m256 f = _mm256_set1_ps(factor);
+            for (; i + 8 <= n; i += 8)
+                _mm256_storeu_ps(data + i, _mm256_mul_ps(_mm256_loadu_ps(data + i), f));
+#elif defined(STDPSRAM_SIMD_SSE2)
+            const __m128 f = _mm_set1_ps(factor);
+            for (; i + 4 <= n; i += 4)
+                _mm_storeu_ps(data + i, _mm_mul_ps(_mm_loadu_ps(data + i), f));
+#endif
+            for (; i < n; i++)
+                data[i] *= factor;
+#endif
+        }
+
+        inline void scale(int16_t *data, std::size_t n, float factor)
+        {
+            std::size_t i = 0;
+#if defined(STDPSRAM_SIMD_SSE2)
+            const __m128 f = _mm_set1_ps(factor);
+            for (; i + 8 <= n; i += 8)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+                __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+                __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+                lo = detail::saturate_epi32(_mm_mul_ps(_mm_cvtepi32_ps(lo), f));
+                hi = detail::saturate_epi32(_mm_mul_ps(_mm_cvtepi32_ps(hi), f));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), _mm_packs_epi32(lo, hi));
+            }
+#endif
+            for (; i < n; i++)
+                data[i] = detail::saturate_s16(data[i] * factor);
+        }
+
+        ///////////////////////////////////////////////////
+        // axpy: y[i] += a * x[i] (scalar on ESP32-S3, see above)
+        inline void axpy(float *y, const float *x, std::size_t n, float a)
+        {
+            std::size_t i = 0;
+#if defined(STDPSRAM_SIMD_AVX)
+            const __m256 f = _mm256_set1_ps(a);
+            for (; i + 16 <= n; i += 16)
+            {
+                _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(_mm256_loadu_ps(x + i), f)));
+                _mm256_storeu_ps(y + i + 8, _mm256_add_ps(_mm256_loadu_ps(y + i + 8), _mm256_mul_ps(_mm256_loadu_ps(x + i + 8), f)));
+            }
+#elif defined(STDPSRAM_SIMD_SSE2)
+            const __m128 f = _mm_set1_ps(a);
+            for (; i + 8 <= n; i += 8)
+            {
+                _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(_mm_loadu_ps(x + i), f)));
+                _mm_storeu_ps(y + i + 4, _mm_add_ps(_mm_loadu_ps(y + i + 4), _mm_mul_ps(_mm_loadu_ps(x + i + 4), f)));
+            }
+#else
+            for (; i + 4 <= n; i += 4)
+            {
+                y[i] += a * x[i];
+                y[i + 1] += a * x[i + 1];
+                y[i + 2] += a * x[i + 2];
+                y[i + 3] += a * x[i + 3];
+            }
+#endif
+            for (; i < n; i++)
+                y[i] += a * x[i];
+        }
+
+        ///////////////////////////////////////////////////
+        // clamp: data[i] = min(max(data[i], lo), hi)
+        inline void clamp(float *data, std::size_t n, float lo, float hi)
+        {
+            std::size_t i = 0;
+#if defined(STDPSRAM_SIMD_AVX)
+            const __m256 vlo = _mm256_set1_ps(lo), vhi = _mm256_set1_ps(hi);
+            for (; i + 8 <= n; i += 8)
+                _mm256_storeu_ps(data + i, _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(data + i), vlo), vhi));
+#elif defined(STDPSRAM_SIMD_SSE2)
+            const __m128 vlo = _mm_set1_ps(lo), vhi = _mm_set1_ps(hi);
+            for (; i + 4 <= n; i += 4)
+                _mm_storeu_ps(data + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(data + i), vlo), vhi));
+#endif
+            for (; i < n; i++)
+            {
+                float v = data[i] < lo ? lo : data[i];
+                data[i] = v > hi ? hi : v;
+            }
+        }
+
+        inline void clamp(int16_t *data, std::size_t n, int16_t lo, int16_t hi)
+        {
+            std::size_t i = 0;
+#if defined(STDPSRAM_SIMD_SSE2)
+            const __m128i vlo = _mm_set1_epi16(lo), vhi = _mm_set1_epi16(hi);
+            for (; i + 8 <= n; i += 8)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), _mm_min_epi16(_mm_max_epi16(v, vlo), vhi));
+            }
+#endif
+            for (; i < n; i++)
+            {
+                int16_t v = data[i] < lo ? lo : data[i];
+                data[i] = v > hi ? hi : v;
+            }
+        }
+
+        ///////////////////////////////////////////////////
+        // convert: out[i] = in[i] * factor (float -> int16_t is rounded and saturated)
+        inline void convert(const int16_t *in, float *out, std::size_t n, float factor = 1.0f)
+        {
+            std::size_t i = 0;
+#if defined(STDPSRAM_SIMD_SSE2)
+            const __m128 f = _mm_set1_ps(factor);
+            for (; i + 8 <= n; i += 8)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in + i));
+                __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+                __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+                _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), f));
+                _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), f));
+            }
+#endif
+            for (; i < n; i++)
+                out[i] = in[i] * factor;
+        }
+
+        inline void convert(const float *in, int16_t *out, std::size_t n, float factor = 1.0f)
+        {
+            std::size_t i = 0;
+#if defined(STDPSRAM_SIMD_SSE2)
+            const __m128 f = _mm_set1_ps(factor);
+            for (; i + 8 <= n; i += 8)
+            {
+                __m128i lo = detail::saturate_epi32(_mm_mul_ps(_mm_loadu_ps(in + i), f));
+                __m128i hi = detail::saturate_epi32(_mm_mul_ps(_mm_loadu_ps(in + i + 4), f));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packs_epi32(lo, hi));
+            }
+#endif
+            for (; i < n; i++)
+                out[i] = detail::saturate_s16(in[i] * factor);
+        }
+
+        ///////////////////////////////////////////////////
+        // stdpsram::vector overloads
+        template <typename T>
+        auto sum(const vector<T> &v) -> decltype(sum(v.data(), v.size()))
+        {
+            return sum(v.data(), v.size());
+        }
+
+        template <typename T>
+        void min_max(const vector<T> &v, T &lo, T &hi)
+        {
+            min_max(v.data(), v.size(), lo, hi);
+        }
+
+        template <typename T>
+        auto dot(const vector<T> &a, const vector<T> &b) -> decltype(dot(a.data(), b.data(), a.size()))
+        {
+            return dot(a.data(), b.data(), a.size() < b.size() ? a.size() : b.size());
+        }
+
+        template <typename T>
+        void scale(vector<T> &v, float factor)
+        {
+            scale(v.data(), v.size(), factor);
+        }
+
+        template <typename T>
+        void clamp(vector<T> &v, T lo, T hi)
+        {
+            clamp(v.data(), v.size(), lo, hi);
+        }
+
+        // out is resized to in.size()
+        template <typename From, typename To>
+        void convert(const vector<From> &in, vector<To> &out, float factor = 1.0f)
+        {
+            out.resize(in.size());
+            convert(in.data(), out.data(), in.size(), factor);
+        }
+    }
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_SIMD_H
@@ -0,0 +1,369 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Binary snapshots of stdpsram containers:
+// snapshot_writer streams container contents straight from PSRAM to a file in large blocks; snapshot_reader
+// rebuilds them, sizing vectors and strings exactly before reading into them. No intermediate serialised copy
+// is built in memory.
+//
+// File layout (native byte order, so snapshots are meant to be reloaded by the same firmware/architecture):
+//   file header : magic "PSNP", format version, application version
+//   per section : kind, key size, value size, element count, payload, CRC-32 of the payload
+//
+// Files go through stdio; on ESP32 use a path on a mounted VFS partition, e.g. "/littlefs/state.bin".
+//
+//   {
+//       stdpsram::snapshot_writer out("/littlefs/state.bin", 3);
+//       out.write(samples);   // stdpsram::vector<float>
+//       out.write(registry);  // stdpsram::map<uint32_t, Device>
+//   }
+//   stdpsram::snapshot_reader in("/littlefs/state.bin");
+//   if (in.version() == 3) { in.read(samples); in.read(registry); }
+
+#ifndef PAT_STDPSRAM_SNAPSHOT_H
+#define PAT_STDPSRAM_SNAPSHOT_H
+
+#include "PAT_stdpsram.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#ifndef STDPSRAM_SNAPSHOT_BLOCK
+#define STDPSRAM_SNAPSHOT_BLOCK 16384 // bytes per write/read call
+#endif
+
+namespace stdpsram
+{
+    namespace detail
+    {
+        // CRC-32 (IEEE 802.3), table driven
+        inline uint32_t crc32(uint32_t crc, const void *data, std::size_t n)
+        {
+            static uint32_t table[256];
+            static bool ready = false;
+            if (!ready)
+            {
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; k++)
+                    {
+                        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    }
+                    table[i] = c;
+                }
+                ready = true;
+            }
+            const uint8_t *p = static_cast<const uint8_t *>(data);
+            crc = ~crc;
+            while (n--)
+            {
+                crc = table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+            }
+            return ~crc;
+        }
+
+        struct snapshot_file_header
+        {
+            uint32_t magic;
+            uint16_t format;
+            uint16_t reserved;
+            uint32_t version;
+        };
+
+        struct snapshot_section
+        {
+            uint16_t kind;
+            uint16_t key_size;
+            uint32_t value_size;
+            uint64_t count;
+        };
+
+        static const uint32_t snapshot_magic = 0x504E5350u; // "PSNP"
+        static const uint16_t snapshot_format = 1;
+
+        enum snapshot_kind : uint16_t
+        {
+            snapshot_array = 1, // vector or string
+            snapshot_map = 2,
+        };
+    }
+
+    ///////////////////////////////////////////////////
+    // snapshot_writer: appends container sections to a snapshot file
+    class snapshot_writer
+    {
+    private:
+        FILE *file;
+        uint32_t crc;
+
+        void put(const void *data, std::size_t n)
+        {
+            if (n && std::fwrite(data, 1, n, file) != n)
+            {
+                throw std::runtime_error("snapshot: write failed");
+            }
+        }
+
+        // Payload bytes are written in STDPSRAM_SNAPSHOT_BLOCK pieces directly from the container's storage
+        void put_payload(const void *data, std::size_t n)
+        {
+            const uint8_t *p = static_cast<const uint8_t *>(data);
+            while (n)
+            {
+                std::size_t len = n < STDPSRAM_SNAPSHOT_BLOCK ? n : STDPSRAM_SNAPSHOT_BLOCK;
+                crc = detail::crc32(crc, p, len);
+                put(p, len);
+                p += len;
+                n -= len;
+            }
+        }
+
+        void begin_section(uint16_t kind, std::size_t key_size, std::size_t value_size, std::size_t count)
+        {
+            detail::snapshot_section s = {kind, uint16_t(key_size), uint32_t(value_size), uint64_t(count)};
+            put(&s, sizeof(s));
+            crc = 0;
+        }
+
+        void end_section()
+        {
+            put(&crc, sizeof(crc));
+        }
+
+        template <typename T>
+        void write_array(const T *data, std::size_t count)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "snapshot: element type must be trivially copyable");
+            begin_section(detail::snapshot_array, 0, sizeof(T), count);
+            put_payload(data, count * sizeof(T));
+            end_section();
+        }
+
+    public:
+        // version: application-defined schema version, returned by snapshot_reader::version()
+        explicit snapshot_writer(const char *path, uint32_t version = 0) : file(std::fopen(path, "wb")), crc(0)
+        {
+            if (!file)
+            {
+                throw std::runtime_error("snapshot: cannot create file");
+            }
+            detail::snapshot_file_header h = {detail::snapshot_magic, detail::snapshot_format, 0, version};
+            put(&h, sizeof(h));
+        }
+
+        ~snapshot_writer()
+        {
+            if (file)
+            {
+                std::fclose(file);
+            }
+        }
+
+        snapshot_writer(const snapshot_writer &) = delete;
+        snapshot_writer &operator=(const snapshot_writer &) = delete;
+
+        //--------------------------------
+        template <typename T>
+        void write(const vector<T> &v)
+        {
+            write_array(v.data(), v.size());
+        }
+
+        void write(const string &s)
+        {
+            write_array(s.data(), s.size());
+        }
+
+        // Map entries are packed key|value into an SRAM block and written a block at a time
+        template <typename Key, typename Value>
+        void write(const map<Key, Value> &m)
+        {
+            static_assert(std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value,
+                          "snapshot: map key and value types must be trivially copyable");
+            const std::size_t record = sizeof(Key) + sizeof(Value);
+            const std::size_t per_block = STDPSRAM_SNAPSHOT_BLOCK / record ? STDPSRAM_SNAPSHOT_BLOCK / record : 1;
+            std::vector<uint8_t, SRAMAllocator<uint8_t>> block(per_block * record);
+
+            begin_section(detail::snapshot_map, sizeof(Key), sizeof(Value), m.size());
+            std::size_t used = 0;
+            for (typename map<Key, Value>::const_iterator it = m.cbegin(); it != m.cend(); ++it)
+            {
+                std::memcpy(&block[used], &it->first, sizeof(Key));
+                std::memcpy(&block[used + sizeof(Key)], &it->second, sizeof(Value));
+                used += record;
+                if (used == block.size())
+                {
+                    put_payload(block.data(), used);
+                    used = 0;
+                }
+            }
+            put_payload(block.data(), used);
+            end_section();
+        }
+
+        // Flush and close; also done by the destructor (which cannot report errors)
+        void close()
+        {
+            if (file)
+            {
+                FILE *f = file;
+                file = nullptr;
+                if (std::fclose(f) != 0)
+                {
+                    throw std::runtime_error("snapshot: close failed");
+                }
+            }
+        }
+    };
+
+    ///////////////////////////////////////////////////
+    // snapshot_reader: reads sections back in the order they were written
+    class snapshot_reader
+    {
+    private:
+        FILE *file;
+        uint32_t app_version;
+
+        void get(void *data, std::size_t n)
+        {
+            if (n && std::fread(data, 1, n, file) != n)
+            {
+                throw std::runtime_error("snapshot: unexpected end of file");
+            }
+        }
+
+        uint32_t get_payload(void *data, std::size_t n, uint32_t crc)
+        {
+            uint8_t *p = static_cast<uint8_t *>(data);
+            while (n)
+            {
+                std::size_t len = n < STDPSRAM_SNAPSHOT_BLOCK ? n : STDPSRAM_SNAPSHOT_BLOCK;
+                get(p, len);
+                crc = detail::crc32(crc, p, len);
+                p += len;
+                n -= len;
+            }
+            return crc;
+        }
+
+        std::size_t begin_section(uint16_t kind, std::size_t key_size, std::size_t value_size)
+        {
+            detail::snapshot_section s;
+            get(&s, sizeof(s));
+            if (s.kind != kind || s.key_size != key_size || s.value_size != value_size)
+            {
+                throw std::runtime_error("snapshot: section does not match the container type");
+            }
+            return std::size_t(s.count);
+        }
+
+        void end_section(uint32_t crc)
+        {
+            uint32_t stored;
+            get(&stored, sizeof(stored));
+            if (stored != crc)
+            {
+                throw std::runtime_error("snapshot: checksum mismatch");
+            }
+        }
+
+        template <typename Array>
+        void read_array(Array &a)
+        {
+            typedef typename Array::value_type T;
+            static_assert(std::is_trivially_copyable<T>::value, "snapshot: element type must be trivially copyable");
+            std::size_t count = begin_section(detail::snapshot_array, 0, sizeof(T));
+            Array loaded;
+            loaded.reserve(count);
+            loaded.resize(count);
+            end_section(get_payload(count ? &loaded[0] : nullptr, count * sizeof(T), 0));
+            a.swap(loaded);
+        }
+
+    public:
+        explicit snapshot_reader(const char *path) : file(std::fopen(path, "rb")), app_version(0)
+        {
+            if (!file)
+            {
+                throw std::runtime_error("snapshot: cannot open file");
+            }
+            detail::snapshot_file_header h;
+            try
+            {
+                get(&h, sizeof(h));
+            }
+            catch (...)
+            {
+                std::fclose(file);
+                throw;
+            }
+            if (h.magic != detail::snapshot_magic || h.format != detail::snapshot_format)
+            {
+                std::fclose(file);
+                throw std::runtime_error("snapshot: not a snapshot file or unsupported format");
+            }
+            app_version = h.version;
+        }
+
+        ~snapshot_reader()
+        {
+            std::fclose(file);
+        }
+
+        snapshot_reader(const snapshot_reader &) = delete;
+        snapshot_reader &operator=(const snapshot_reader &) = delete;
+
+        // Application version passed to snapshot_writer
+        uint32_t version() const noexcept
+        {
+            return app_version;
+        }
+
+        //--------------------------------
+        // The container is replaced only after its section has been read and verified
+        template <typename T>
+        void read(vector<T> &v)
+        {
+            read_array(v);
+        }
+
+        void read(string &s)
+        {
+            read_array(s);
+        }
+
+        template <typename Key, typename Value>
+        void read(map<Key, Value> &m)
+        {
+            const std::size_t record = sizeof(Key) + sizeof(Value);
+            const std::size_t per_block = STDPSRAM_SNAPSHOT_BLOCK / record ? STDPSRAM_SNAPSHOT_BLOCK / record : 1;
+            std::vector<uint8_t, SRAMAllocator<uint8_t>> block(per_block * record);
+
+            std::size_t count = begin_section(detail::snapshot_map, sizeof(Key), sizeof(Value));
+            map<Key, Value> loaded;
+            uint32_t crc = 0;
+            while (count)
+            {
+                std::size_t n = count < per_block ? count : per_block;
+                crc = get_payload(block.data(), n * record, crc);
+                for (std::size_t i = 0; i < n; i++)
+                {
+                    Key k;
+                    Value v;
+                    std::memcpy(&k, &block[i * record], sizeof(Key));
+                    std::memcpy(&v, &block[i * record + sizeof(Key)], sizeof(Value));
+                    loaded.emplace_hint(loaded.end(), k, v); // entries were written in key order
+                }
+                count -= n;
+            }
+            end_section(crc);
+            m.swap(loaded);
+        }
+    };
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_SNAPSHOT_H
@@ -0,0 +1,252 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Sorting for large PSRAM vectors:
+// - radix_sort: LSD radix sort (8-bit digits) for integer and floating point keys. Histograms live in SRAM and
+//   every pass reads PSRAM sequentially; scattered writes go through per-bucket SRAM write-combining buffers
+//   so PSRAM is written one cache line at a time. Passes in which all keys share the digit are skipped.
+// - merge_sort: for any type/comparator. Runs that fit in an SRAM buffer (STDPSRAM_SORT_RUN bytes) are sorted
+//   in SRAM, then merged pairwise in sequential passes between the vector and a PSRAM scratch buffer.
+// - sort: picks radix_sort for arithmetic element types with the default ordering, merge_sort otherwise.
+//
+// Both need a scratch buffer as large as the input in PSRAM. radix_sort is stable; merge_sort is not, because
+// the SRAM-sized runs are sorted with std::sort.
+
+#ifndef PAT_STDPSRAM_SORT_H
+#define PAT_STDPSRAM_SORT_H
+
+#include "PAT_stdpsram.h"
+#include "PAT_stdpsram_memory.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+
+#ifndef STDPSRAM_SORT_RUN
+#define STDPSRAM_SORT_RUN 16384 // bytes of SRAM used to sort one run
+#endif
+
+namespace stdpsram
+{
+    namespace detail
+    {
+        template <std::size_t Bytes>
+        struct unsigned_of;
+        template <>
+        struct unsigned_of<1> { typedef uint8_t type; };
+        template <>
+        struct unsigned_of<2> { typedef uint16_t type; };
+        template <>
+        struct unsigned_of<4> { typedef uint32_t type; };
+        template <>
+        struct unsigned_of<8> { typedef uint64_t type; };
+
+        // Order-preserving mapping of a key to an unsigned integer
+        template <typename T, typename Enable = void>
+        struct radix_key;
+
+        template <typename T>
+        struct radix_key<T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type>
+        {
+            typedef typename unsigned_of<sizeof(T)>::type type;
+            static type get(T x) { return type(x); }
+        };
+
+        template <typename T>
+        struct radix_key<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type>
+        {
+            typedef typename unsigned_of<sizeof(T)>::type type;
+            static type get(T x) { return type(type(x) ^ (type(1) << (sizeof(T) * 8 - 1))); }
+        };
+
+        template <typename T>
+        struct radix_key<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+        {
+            typedef typename unsigned_of<sizeof(T)>::type type;
+            static type get(T x)
+            {
+                type bits;
+                std::memcpy(&bits, &x, sizeof(bits));
+                const type sign = type(1) << (sizeof(T) * 8 - 1);
+                return (bits & sign) ? type(~bits) : type(bits | sign);
+            }
+        };
+
+        template <typename T>
+        struct radix_sortable
+            : std::integral_constant<bool, std::is_arithmetic<T>::value && !std::is_same<T, bool>::value &&
+                                               (sizeof(T) == 1 || sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8)>
+        {
+        };
+    }
+
+    ///////////////////////////////////////////////////
+    // radix_sort: sorts [data, data + n) using scratch[0..n) as the second buffer
+    template <typename T>
+    void radix_sort(T *data, std::size_t n, T *scratch)
+    {
+        static_assert(detail::radix_sortable<T>::value, "radix_sort needs an integer or floating point key");
+        typedef detail::radix_key<T> key;
+        const std::size_t passes = sizeof(T);
+        const std::size_t combine = STDPSRAM_CACHE_LINE / sizeof(T) ? STDPSRAM_CACHE_LINE / sizeof(T) : 1;
+        if (n < 2)
+        {
+            return;
+        }
+
+        // counts[pass][digit], then reused as write positions
+        std::vector<std::size_t, SRAMAllocator<std::size_t>> counts(passes * 256, 0);
+        for (std::size_t i = 0; i < n; i++)
+        {
+            typename key::type k = key::get(data[i]);
+            for (std::size_t p = 0; p < passes; p++)
+            {
+                counts[p * 256 + ((k >> (p * 8)) & 0xFF)]++;
+            }
+        }
+
+        std::vector<T, SRAMAllocator<T>> combining(256 * combine);
+        std::vector<uint16_t, SRAMAllocator<uint16_t>> filled(256);
+
+        T *src = data;
+        T *dst = scratch;
+        for (std::size_t p = 0; p < passes; p++)
+        {
+            std::size_t *pos = &counts[p * 256];
+            if (pos[(key::get(src[0]) >> (p * 8)) & 0xFF] == n)
+            {
+                continue; // every key has the same digit here
+            }
+            std::size_t total = 0;
+            for (std::size_t d = 0; d < 256; d++)
+            {
+                std::size_t c = pos[d];
+                pos[d] = total;
+                total += c;
+            }
+
+            std::fill(filled.begin(), filled.end(), 0);
+            for (std::size_t i = 0; i < n; i++)
+            {
+                std::size_t d = (key::get(src[i]) >> (p * 8)) & 0xFF;
+                T *slot = &combining[d * combine];
+                slot[filled[d]++] = src[i];
+                if (filled[d] == combine)
+                {
+                    stdpsram::memcpy(dst + pos[d], slot, combine * sizeof(T));
+                    pos[d] += combine;
+                    filled[d] = 0;
+                }
+            }
+            for (std::size_t d = 0; d < 256; d++)
+            {
+                stdpsram::memcpy(dst + pos[d], &combining[d * combine], filled[d] * sizeof(T));
+            }
+            std::swap(src, dst);
+        }
+        if (src != data)
+        {
+            stdpsram::memcpy(data, src, n * sizeof(T));
+        }
+    }
+
+    template <typename T>
+    void radix_sort(vector<T> &v)
+    {
+        vector<T> scratch(v.size());
+        radix_sort(v.data(), v.size(), scratch.data());
+    }
+
+    ///////////////////////////////////////////////////
+    // merge_sort: SRAM-sized runs, then sequential pairwise merges through PSRAM
+    template <typename T, typename Compare>
+    void merge_sort(vector<T> &v, Compare comp)
+    {
+        const std::size_t n = v.size();
+        const std::size_t run = STDPSRAM_SORT_RUN / sizeof(T) > 1 ? STDPSRAM_SORT_RUN / sizeof(T) : 2;
+        if (n < 2)
+        {
+            return;
+        }
+
+        // Sort each run in SRAM
+        {
+            std::vector<T, SRAMAllocator<T>> buffer;
+            buffer.reserve(run < n ? run : n);
+            for (std::size_t first = 0; first < n; first += run)
+            {
+                std::size_t last = first + run < n ? first + run : n;
+                buffer.assign(std::make_move_iterator(v.begin() + first), std::make_move_iterator(v.begin() + last));
+                std::sort(buffer.begin(), buffer.end(), comp);
+                std::move(buffer.begin(), buffer.end(), v.begin() + first);
+            }
+        }
+        if (n <= run)
+        {
+            return;
+        }
+
+        // Merge passes, ping-ponging between v and other
+        vector<T> other;
+        other.reserve(n);
+        bool constructed = false;
+        vector<T> *src = &v;
+        vector<T> *dst = &other;
+        for (std::size_t width = run; width < n; width *= 2)
+        {
+            for (std::size_t first = 0; first < n; first += 2 * width)
+            {
+                std::size_t mid = first + width < n ? first + width : n;
+                std::size_t last = first + 2 * width < n ? first + 2 * width : n;
+                auto a = std::make_move_iterator(src->begin() + first);
+                auto b = std::make_move_iterator(src->begin() + mid);
+                auto c = std::make_move_iterator(src->begin() + last);
+                if (constructed)
+                {
+                    std::merge(a, b, b, c, dst->begin() + first, comp);
+                }
+                else
+                {
+                    std::merge(a, b, b, c, std::back_inserter(*dst), comp);
+                }
+            }
+            constructed = true;
+            std::swap(src, dst);
+        }
+        if (src != &v)
+        {
+            v.swap(*src);
+        }
+    }
+
+    template <typename T>
+    void merge_sort(vector<T> &v)
+    {
+        merge_sort(v, std::less<T>());
+    }
+
+    ///////////////////////////////////////////////////
+    // sort: radix sort for arithmetic keys, merge sort for everything else
+    template <typename T>
+    typename std::enable_if<detail::radix_sortable<T>::value>::type sort(vector<T> &v)
+    {
+        radix_sort(v);
+    }
+
+    template <typename T>
+    typename std::enable_if<!detail::radix_sortable<T>::value>::type sort(vector<T> &v)
+    {
+        merge_sort(v, std::less<T>());
+    }
+
+    template <typename T, typename Compare>
+    void sort(vector<T> &v, Compare comp)
+    {
+        merge_sort(v, comp);
+    }
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_SORT_H
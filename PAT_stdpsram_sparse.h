@@ -0,0 +1,343 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Sparse matrices in PSRAM:
+// - coo_matrix: (row, col, value) triplets in insertion order; cheap to assemble, any order, duplicates allowed
+// - csr_matrix: compressed sparse rows (row_ptr / col_idx / values); the format for solving
+// A mostly-zero matrix costs (sizeof(T) + sizeof(Index)) per non-zero plus one Index per row, instead of
+// rows * cols * sizeof(T), and spmv() touches each stored entry exactly once in address order.
+//
+//   stdpsram::coo_matrix<float> coo(n, n);
+//   coo.add(i, j, w);                                    // duplicates are summed on conversion
+//   stdpsram::csr_matrix<float> a(std::move(coo));       // sorts the triplets in place, no second copy
+//   a.spmv(x, y);                                        // y = A x
+//   a.spmv_transpose(x, y);                              // y = A^T x
+//   a.print_memory("laplacian");
+//
+// Conversion is a stable counting sort by row, applied in place by cycle swaps, then a per-row sort by column:
+// insertion sort for short rows, std::stable_sort through a scratch buffer for rows longer than
+// STDPSRAM_SPARSE_SHORT_ROW. Every pass is stable, so duplicates are summed in the order they were added. The
+// COO column and value arrays become the CSR arrays.
+
+#ifndef PAT_STDPSRAM_SPARSE_H
+#define PAT_STDPSRAM_SPARSE_H
+
+#include "PAT_stdpsram.h"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+#ifndef STDPSRAM_SPARSE_SHORT_ROW
+#define STDPSRAM_SPARSE_SHORT_ROW 32 // longest row sorted by insertion when converting COO to CSR
+#endif
+
+namespace stdpsram
+{
+    template <typename T, typename Index>
+    class csr_matrix;
+
+    ///////////////////////////////////////////////////
+    // coo_matrix: coordinate list
+    template <typename T, typename Index = uint32_t>
+    class coo_matrix
+    {
+    private:
+        friend class csr_matrix<T, Index>;
+
+        std::size_t n_rows;
+        std::size_t n_cols;
+        vector<Index> row_idx;
+        vector<Index> col_idx;
+        vector<T> vals;
+
+    public:
+        typedef T value_type;
+
+        coo_matrix(std::size_t rows, std::size_t cols) : n_rows(rows), n_cols(cols)
+        {
+            if (rows > std::size_t(Index(-1)) || cols > std::size_t(Index(-1)))
+            {
+                throw std::length_error("coo_matrix: dimensions exceed the index type");
+            }
+        }
+
+        void reserve(std::size_t nnz)
+        {
+            row_idx.reserve(nnz);
+            col_idx.reserve(nnz);
+            vals.reserve(nnz);
+        }
+
+        void add(std::size_t r, std::size_t c, const T &value)
+        {
+            if (r >= n_rows || c >= n_cols)
+            {
+                throw std::out_of_range("coo_matrix::add");
+            }
+            row_idx.push_back(Index(r));
+            col_idx.push_back(Index(c));
+            vals.push_back(value);
+        }
+
+        // y = A x (y has rows() elements)
+        void spmv(const T *x, T *y) const
+        {
+            for (std::size_t r = 0; r < n_rows; r++)
+                y[r] = T();
+            for (std::size_t k = 0; k < vals.size(); k++)
+                y[row_idx[k]] += vals[k] * x[col_idx[k]];
+        }
+
+        std::size_t rows() const noexcept { return n_rows; }
+        std::size_t cols() const noexcept { return n_cols; }
+        std::size_t nonzeros() const noexcept { return vals.size(); }
+
+        std::size_t bytes() const noexcept
+        {
+            return row_idx.capacity() * sizeof(Index) + col_idx.capacity() * sizeof(Index) + vals.capacity() * sizeof(T);
+        }
+
+        const vector<Index> &row_indices() const noexcept { return row_idx; }
+        const vector<Index> &col_indices() const noexcept { return col_idx; }
+        const vector<T> &values() const noexcept { return vals; }
+    };
+
+    ///////////////////////////////////////////////////
+    // csr_matrix: compressed sparse rows
+    template <typename T, typename Index = uint32_t>
+    class csr_matrix
+    {
+    private:
+        std::size_t n_rows;
+        std::size_t n_cols;
+        vector<Index> row_ptr; // rows + 1 entries; row r is [row_ptr[r], row_ptr[r + 1])
+        vector<Index> col_idx;
+        vector<T> vals;
+
+    public:
+        typedef T value_type;
+
+        // Takes over the triplet arrays: sorted by (row, col), duplicates summed, row indices released
+        explicit csr_matrix(coo_matrix<T, Index> &&coo)
+            : n_rows(coo.n_rows), n_cols(coo.n_cols), row_ptr(coo.n_rows + 1, Index(0)),
+              col_idx(std::move(coo.col_idx)), vals(std::move(coo.vals))
+        {
+            vector<Index> rows(std::move(coo.row_idx));
+            coo.row_idx.clear();
+            coo.col_idx.clear();
+            coo.vals.clear();
+            std::size_t nnz = vals.size();
+            if (nnz > std::size_t(Index(-1)))
+            {
+                throw std::length_error("csr_matrix: too many non-zeros for the index type");
+            }
+
+            // Stable counting sort by row: each entry's slot is handed out in input order (next[r] is the first
+            // unassigned slot of row r) and overwrites its row index, then the permutation is applied in place
+            for (std::size_t k = 0; k < nnz; k++)
+                row_ptr[rows[k] + 1]++;
+            for (std::size_t r = 0; r < n_rows; r++)
+                row_ptr[r + 1] += row_ptr[r];
+            vector<Index> next(row_ptr.begin(), row_ptr.end() - 1);
+            for (std::size_t k = 0; k < nnz; k++)
+                rows[k] = next[rows[k]]++;
+            for (std::size_t k = 0; k < nnz; k++)
+            {
+                while (rows[k] != Index(k))
+                {
+                    // Send entry k to its slot and take whatever was there
+                    std::size_t slot = rows[k];
+                    std::swap(rows[k], rows[slot]);
+                    std::swap(col_idx[k], col_idx[slot]);
+                    std::swap(vals[k], vals[slot]);
+                }
+            }
+            next = vector<Index>();
+            rows = vector<Index>();
+
+            // Sort each row by column and merge duplicates
+            vector<std::pair<Index, T>> scratch; // only used by long rows
+            std::size_t out = 0;
+            std::size_t begin = 0;
+            for (std::size_t r = 0; r < n_rows; r++)
+            {
+                std::size_t end = row_ptr[r + 1];
+                if (end - begin > STDPSRAM_SPARSE_SHORT_ROW)
+                {
+                    scratch.clear();
+                    for (std::size_t i = begin; i < end; i++)
+                        scratch.push_back(std::make_pair(col_idx[i], vals[i]));
+                    std::stable_sort(scratch.begin(), scratch.end(),
+                                     [](const std::pair<Index, T> &a, const std::pair<Index, T> &b)
+                                     { return a.first < b.first; });
+                    for (std::size_t i = begin; i < end; i++)
+                    {
+                        col_idx[i] = scratch[i - begin].first;
+                        vals[i] = scratch[i - begin].second;
+                    }
+                }
+                else
+                {
+                    for (std::size_t i = begin + 1; i < end; i++)
+                    {
+                        Index c = col_idx[i];
+                        T v = vals[i];
+                        std::size_t j = i;
+                        for (; j > begin && col_idx[j - 1] > c; j--)
+                        {
+                            col_idx[j] = col_idx[j - 1];
+                            vals[j] = vals[j - 1];
+                        }
+                        col_idx[j] = c;
+                        vals[j] = v;
+                    }
+                }
+                row_ptr[r] = Index(out);
+                for (std::size_t i = begin; i < end; i++)
+                {
+                    if (out > row_ptr[r] && col_idx[out - 1] == col_idx[i])
+                    {
+                        vals[out - 1] += vals[i];
+                    }
+                    else
+                    {
+                        col_idx[out] = col_idx[i];
+                        vals[out] = vals[i];
+                        out++;
+                    }
+                }
+                begin = end;
+            }
+            row_ptr[n_rows] = Index(out);
+            col_idx.resize(out);
+            vals.resize(out);
+            col_idx.shrink_to_fit();
+            vals.shrink_to_fit();
+        }
+
+        // From ready-made CSR arrays, validated in O(rows + nnz): row_ptr runs from 0 to nnz and never decreases, each
+        // row's columns are below cols and strictly increasing (get() relies on the order)
+        csr_matrix(std::size_t rows, std::size_t cols, vector<Index> &&row_ptr, vector<Index> &&col_idx, vector<T> &&vals)
+            : n_rows(rows), n_cols(cols), row_ptr(std::move(row_ptr)), col_idx(std::move(col_idx)), vals(std::move(vals))
+        {
+            if (rows > std::size_t(Index(-1)) || cols > std::size_t(Index(-1)))
+            {
+                throw std::length_error("csr_matrix: dimensions exceed the index type");
+            }
+            if (this->row_ptr.size() != rows + 1 || this->row_ptr[0] != 0 || this->row_ptr[rows] != this->col_idx.size() ||
+                this->col_idx.size() != this->vals.size())
+            {
+                throw std::invalid_argument("csr_matrix: inconsistent arrays");
+            }
+            for (std::size_t r = 0; r < rows; r++)
+            {
+                Index begin = this->row_ptr[r], end = this->row_ptr[r + 1];
+                if (end < begin || end > this->col_idx.size())
+                {
+                    throw std::invalid_argument("csr_matrix: row offsets decrease or overrun the arrays");
+                }
+                for (Index k = begin; k < end; k++)
+                {
+                    if (this->col_idx[k] >= cols || (k > begin && this->col_idx[k] <= this->col_idx[k - 1]))
+                    {
+                        throw std::invalid_argument("csr_matrix: column index out of range or out of order");
+                    }
+                }
+            }
+        }
+
+        //--------------------------------
+        // y = A x   (x has cols() elements, y has rows())
+        void spmv(const T *x, T *y) const
+        {
+            const Index *cp = col_idx.data();
+            const T *vp = vals.data();
+            for (std::size_t r = 0; r < n_rows; r++)
+            {
+                T sum = T();
+                for (Index k = row_ptr[r], end = row_ptr[r + 1]; k < end; k++)
+                    sum += vp[k] * x[cp[k]];
+                y[r] = sum;
+            }
+        }
+
+        // y = A^T x   (x has rows() elements, y has cols())
+        void spmv_transpose(const T *x, T *y) const
+        {
+            for (std::size_t c = 0; c < n_cols; c++)
+                y[c] = T();
+            const Index *cp = col_idx.data();
+            const T *vp = vals.data();
+            for (std::size_t r = 0; r < n_rows; r++)
+            {
+                T xr = x[r];
+                for (Index k = row_ptr[r], end = row_ptr[r + 1]; k < end; k++)
+                    y[cp[k]] += vp[k] * xr;
+            }
+        }
+
+        void spmv(const vector<T> &x, vector<T> &y) const
+        {
+            if (x.size() != n_cols)
+            {
+                throw std::invalid_argument("csr_matrix::spmv: shape mismatch");
+            }
+            y.resize(n_rows);
+            spmv(x.data(), y.data());
+        }
+
+        void spmv_transpose(const vector<T> &x, vector<T> &y) const
+        {
+            if (x.size() != n_rows)
+            {
+                throw std::invalid_argument("csr_matrix::spmv_transpose: shape mismatch");
+            }
+            y.resize(n_cols);
+            spmv_transpose(x.data(), y.data());
+        }
+
+        // Stored value at (r, c), or T() (binary search within the row)
+        T get(std::size_t r, std::size_t c) const
+        {
+            std::size_t lo = row_ptr.at(r), hi = row_ptr[r + 1];
+            while (lo < hi)
+            {
+                std::size_t mid = (lo + hi) / 2;
+                if (col_idx[mid] < c)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return lo < row_ptr[r + 1] && col_idx[lo] == c ? vals[lo] : T();
+        }
+
+        //--------------------------------
+        std::size_t rows() const noexcept { return n_rows; }
+        std::size_t cols() const noexcept { return n_cols; }
+        std::size_t nonzeros() const noexcept { return vals.size(); }
+
+        std::size_t bytes() const noexcept
+        {
+            return row_ptr.capacity() * sizeof(Index) + col_idx.capacity() * sizeof(Index) + vals.capacity() * sizeof(T);
+        }
+
+        // Size of the same matrix stored densely
+        std::size_t dense_bytes() const noexcept { return n_rows * n_cols * sizeof(T); }
+
+        void print_memory(const char *name) const
+        {
+            STDPSRAM_PRINTF("%s: %ux%u, %u non-zeros (%.3f%%), %u bytes in PSRAM, dense would be %llu bytes\n", name,
+                            unsigned(n_rows), unsigned(n_cols), unsigned(nonzeros()),
+                            n_rows && n_cols ? 100.0 * double(nonzeros()) / (double(n_rows) * double(n_cols)) : 0.0,
+                            unsigned(bytes()), (unsigned long long)dense_bytes());
+        }
+
+        const vector<Index> &row_offsets() const noexcept { return row_ptr; }
+        const vector<Index> &col_indices() const noexcept { return col_idx; }
+        const vector<T> &values() const noexcept { return vals; }
+    };
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_SPARSE_H
@@ -0,0 +1,365 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Double-buffered staging of PSRAM data into internal SRAM:
+// stdpsram::staged_range walks a large PSRAM array chunk by chunk. While the caller works on the current chunk
+// (already in SRAM), a helper copies the next chunk from PSRAM into the second SRAM buffer, so the PSRAM
+// transfer overlaps with compute instead of stalling it on cache misses.
+//
+// The helper is a FreeRTOS task pinned to the other core on ESP32 (STDPSRAM_STAGE_CORE, default 0 since the
+// Arduino loop runs on core 1) and a std::thread on host builds.
+//
+//   stdpsram::vector<float> signal(1 << 20);
+//   for (auto chunk : stdpsram::staged(signal))
+//   {
+//       for (float x : chunk) { ... }          // chunk.offset() is the index of chunk[0] in signal
+//   }
+//
+// The range is read-only and single pass; chunks are only valid until the iterator is advanced.
+
+#ifndef PAT_STDPSRAM_STAGED_H
+#define PAT_STDPSRAM_STAGED_H
+
+#include "PAT_stdpsram.h"
+#include "PAT_stdpsram_memory.h"
+#include <cstdint>
+#include <type_traits>
+
+#if defined(ARDUINO)
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#else
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#endif
+
+#ifndef STDPSRAM_STAGE_CHUNK
+#define STDPSRAM_STAGE_CHUNK 4096 // bytes per staging buffer
+#endif
+
+#ifndef STDPSRAM_STAGE_CORE
+#define STDPSRAM_STAGE_CORE 0
+#endif
+
+namespace stdpsram
+{
+    ///////////////////////////////////////////////////
+    // copy_job: one asynchronous block copy handled by the copy_engine
+    class copy_job
+    {
+    public:
+        void *dst = nullptr;
+        const void *src = nullptr;
+        std::size_t size = 0;
+
+#if defined(ARDUINO)
+        copy_job() : done(xSemaphoreCreateBinary())
+        {
+            if (!done)
+            {
+                throw std::bad_alloc();
+            }
+        }
+
+        ~copy_job()
+        {
+            vSemaphoreDelete(done);
+        }
+#else
+        copy_job() = default;
+#endif
+
+        copy_job(const copy_job &) = delete;
+        copy_job &operator=(const copy_job &) = delete;
+
+    private:
+        friend class copy_engine;
+#if defined(ARDUINO)
+        SemaphoreHandle_t done;
+#else
+        bool finished = true;
+#endif
+    };
+
+    ///////////////////////////////////////////////////
+    // copy_engine: background block mover shared by all staged ranges
+    class copy_engine
+    {
+    public:
+        static copy_engine &instance()
+        {
+            static copy_engine engine;
+            return engine;
+        }
+
+        // Queue a copy; the job must stay alive until wait() returns
+        void submit(copy_job &job)
+        {
+#if defined(ARDUINO)
+            copy_job *ptr = &job;
+            xQueueSend(queue, &ptr, portMAX_DELAY);
+#else
+            std::lock_guard<std::mutex> lock(mutex);
+            job.finished = false;
+            pending.push_back(&job);
+            work.notify_one();
+#endif
+        }
+
+        // Block until the job has completed
+        void wait(copy_job &job)
+        {
+#if defined(ARDUINO)
+            xSemaphoreTake(job.done, portMAX_DELAY);
+#else
+            std::unique_lock<std::mutex> lock(mutex);
+            completed.wait(lock, [&job]
+                           { return job.finished; });
+#endif
+        }
+
+        copy_engine(const copy_engine &) = delete;
+        copy_engine &operator=(const copy_engine &) = delete;
+
+    private:
+#if defined(ARDUINO)
+        QueueHandle_t queue;
+
+        copy_engine()
+        {
+            queue = xQueueCreate(8, sizeof(copy_job *));
+            xTaskCreatePinnedToCore(run, "stdpsram_copy", 2048, this, configMAX_PRIORITIES - 2, nullptr, STDPSRAM_STAGE_CORE);
+        }
+
+        static void run(void *arg)
+        {
+            copy_engine *self = static_cast<copy_engine *>(arg);
+            copy_job *job;
+            while (true)
+            {
+                if (xQueueReceive(self->queue, &job, portMAX_DELAY) == pdTRUE)
+                {
+                    stdpsram::memcpy(job->dst, job->src, job->size);
+                    xSemaphoreGive(job->done);
+                }
+            }
+        }
+#else
+        std::mutex mutex;
+        std::condition_variable work;
+        std::condition_variable completed;
+        std::deque<copy_job *> pending;
+        bool stopping = false;
+        std::thread worker;
+
+        copy_engine() : worker([this]
+                               { run(); }) {}
+
+        ~copy_engine()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+                work.notify_one();
+            }
+            worker.join();
+        }
+
+        void run()
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true)
+            {
+                work.wait(lock, [this]
+                          { return stopping || !pending.empty(); });
+                if (pending.empty())
+                {
+                    return;
+                }
+                copy_job *job = pending.front();
+                pending.pop_front();
+                lock.unlock();
+                stdpsram::memcpy(job->dst, job->src, job->size);
+                lock.lock();
+                job->finished = true;
+                completed.notify_all();
+            }
+        }
+#endif
+    };
+
+    ///////////////////////////////////////////////////
+    // staged_chunk: view of one chunk in an SRAM staging buffer
+    template <typename T>
+    class staged_chunk
+    {
+    private:
+        const T *first;
+        std::size_t count;
+        std::size_t start;
+
+    public:
+        staged_chunk(const T *data, std::size_t size, std::size_t offset)
+            : first(data), count(size), start(offset) {}
+
+        const T *begin() const { return first; }
+        const T *end() const { return first + count; }
+        const T *data() const { return first; }
+        std::size_t size() const { return count; }
+        const T &operator[](std::size_t i) const { return first[i]; }
+
+        // Index of the first element of this chunk in the source array
+        std::size_t offset() const { return start; }
+    };
+
+    ///////////////////////////////////////////////////
+    // staged_range: chunked, prefetching view of a PSRAM array
+    template <typename T>
+    class staged_range
+    {
+    private:
+        const T *source;
+        std::size_t length;
+        std::size_t chunk;
+        T *buffers[2];
+        copy_job job;
+        bool in_flight;
+        int current;
+        std::size_t position; // offset of the chunk in buffers[current]
+
+        std::size_t chunk_size(std::size_t offset) const
+        {
+            return length - offset < chunk ? length - offset : chunk;
+        }
+
+        void prefetch(std::size_t offset, int buffer)
+        {
+            if (offset >= length)
+            {
+                return;
+            }
+            job.dst = buffers[buffer];
+            job.src = source + offset;
+            job.size = chunk_size(offset) * sizeof(T);
+            copy_engine::instance().submit(job);
+            in_flight = true;
+        }
+
+        void settle()
+        {
+            if (in_flight)
+            {
+                copy_engine::instance().wait(job);
+                in_flight = false;
+            }
+        }
+
+        // Make the next chunk current and start fetching the one after it
+        void advance()
+        {
+            settle();
+            position += chunk;
+            current ^= 1;
+            prefetch(position + chunk, current ^ 1);
+        }
+
+    public:
+        static_assert(std::is_trivially_copyable<T>::value, "staged_range copies with memcpy; T must be trivially copyable");
+
+        class iterator
+        {
+        private:
+            staged_range *range;
+
+        public:
+            explicit iterator(staged_range *range) : range(range) {}
+
+            staged_chunk<T> operator*() const
+            {
+                return staged_chunk<T>(range->buffers[range->current], range->chunk_size(range->position), range->position);
+            }
+
+            iterator &operator++()
+            {
+                range->advance();
+                return *this;
+            }
+
+            bool operator!=(const iterator &) const
+            {
+                return range->position < range->length;
+            }
+        };
+
+        // chunk_elements: elements per SRAM staging buffer (two are allocated)
+        staged_range(const T *data, std::size_t size, std::size_t chunk_elements = STDPSRAM_STAGE_CHUNK / sizeof(T))
+            : source(data), length(size), chunk(chunk_elements ? chunk_elements : 1), in_flight(false), current(0), position(0)
+        {
+            buffers[0] = SRAMAllocator<T>().allocate(chunk);
+            try
+            {
+                buffers[1] = SRAMAllocator<T>().allocate(chunk);
+            }
+            catch (...)
+            {
+                SRAMAllocator<T>().deallocate(buffers[0], chunk);
+                throw;
+            }
+        }
+
+        ~staged_range()
+        {
+            settle();
+            SRAMAllocator<T>().deallocate(buffers[0], chunk);
+            SRAMAllocator<T>().deallocate(buffers[1], chunk);
+        }
+
+        // Moving waits for any copy in flight; the moved-from range becomes empty
+        staged_range(staged_range &&other)
+            : source(other.source), length(other.length), chunk(other.chunk), in_flight(false), current(0), position(0)
+        {
+            other.settle();
+            buffers[0] = other.buffers[0];
+            buffers[1] = other.buffers[1];
+            other.buffers[0] = other.buffers[1] = nullptr;
+            other.length = 0;
+        }
+
+        staged_range(const staged_range &) = delete;
+        staged_range &operator=(const staged_range &) = delete;
+
+        // Starts the pipeline: the first chunk is copied synchronously, the second in the background
+        iterator begin()
+        {
+            settle();
+            position = 0;
+            current = 0;
+            if (length)
+            {
+                stdpsram::memcpy(buffers[0], source, chunk_size(0) * sizeof(T));
+                prefetch(chunk, 1);
+            }
+            return iterator(this);
+        }
+
+        iterator end()
+        {
+            return iterator(this);
+        }
+    };
+
+    ///////////////////////////////////////////////////
+    // staged(): convenience for stdpsram::vector
+    template <typename T>
+    staged_range<T> staged(const vector<T> &v, std::size_t chunk_elements = STDPSRAM_STAGE_CHUNK / sizeof(T))
+    {
+        return staged_range<T>(v.data(), v.size(), chunk_elements);
+    }
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_STAGED_H
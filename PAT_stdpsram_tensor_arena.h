@@ -0,0 +1,262 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Tensor arena with a lifetime-based memory planner:
+// Intermediate tensors of a model rarely live at the same time, yet one stdpsram::vector per tensor makes the
+// peak PSRAM use the sum of all of them. memory_planner takes every buffer's size and lifetime (first and last
+// operator that touches it) and packs them into one address range, so buffers whose lifetimes do not overlap
+// share memory. tensor_arena then allocates that range once, aligned, through PSRAMAllocator.
+//
+//   stdpsram::memory_planner plan;
+//   auto in  = plan.add(96 * 96 * 4, 0, 1);          // bytes, first use, last use (inclusive)
+//   auto c1  = plan.add(48 * 48 * 64 * 4, 1, 2);
+//   auto c2  = plan.add(24 * 24 * 128 * 4, 2, 3);
+//   plan.plan();                                     // greedy by size; or plan(stdpsram::plan_strategy::best_fit)
+//   stdpsram::tensor_arena arena(plan);              // one PSRAM allocation of plan.arena_size() bytes
+//   float *x = arena.get<float>(c1);
+//
+// Planning is cheap (quadratic in the number of buffers) but need not run on the device: offsets() can be
+// dumped once and the arena built from the stored table.
+
+#ifndef PAT_STDPSRAM_TENSOR_ARENA_H
+#define PAT_STDPSRAM_TENSOR_ARENA_H
+
+#include "PAT_stdpsram.h"
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+
+#ifndef STDPSRAM_TENSOR_ALIGN
+#define STDPSRAM_TENSOR_ALIGN 16 // alignment of every planned buffer (SIMD loads, DMA)
+#endif
+
+namespace stdpsram
+{
+    enum class plan_strategy
+    {
+        greedy_by_size, // largest buffers first, each at the lowest offset that fits
+        best_fit        // largest buffers first, each in the tightest gap that fits
+    };
+
+    ///////////////////////////////////////////////////
+    // memory_planner: offsets for buffers with known lifetimes
+    class memory_planner
+    {
+    public:
+        struct buffer
+        {
+            std::size_t size;
+            uint32_t first;
+            uint32_t last;
+            std::size_t offset;
+        };
+
+    private:
+        vector<buffer> buffers;
+        std::size_t total;
+        bool planned;
+
+        static std::size_t align_up(std::size_t n)
+        {
+            return (n + STDPSRAM_TENSOR_ALIGN - 1) & ~std::size_t(STDPSRAM_TENSOR_ALIGN - 1);
+        }
+
+        static bool overlap(const buffer &a, const buffer &b)
+        {
+            return a.first <= b.last && b.first <= a.last;
+        }
+
+    public:
+        memory_planner() : total(0), planned(false) {}
+
+        // Register a buffer used by operators first..last (inclusive); returns its id
+        std::size_t add(std::size_t bytes, uint32_t first, uint32_t last)
+        {
+            if (last < first)
+            {
+                throw std::invalid_argument("memory_planner: lifetime ends before it starts");
+            }
+            buffers.push_back(buffer{bytes, first, last, 0});
+            planned = false;
+            return buffers.size() - 1;
+        }
+
+        // Compute the offsets; returns the arena size
+        std::size_t plan(plan_strategy strategy = plan_strategy::greedy_by_size)
+        {
+            vector<std::size_t> order(buffers.size());
+            for (std::size_t i = 0; i < order.size(); i++)
+            {
+                order[i] = i;
+            }
+            std::stable_sort(order.begin(), order.end(), [this](std::size_t a, std::size_t b)
+                             { return buffers[a].size > buffers[b].size; });
+
+            vector<std::size_t> placed;   // ids already placed, sorted by offset
+            vector<std::size_t> conflict; // placed buffers alive at the same time as the current one
+            total = 0;
+            for (std::size_t id : order)
+            {
+                buffer &b = buffers[id];
+                std::size_t need = align_up(b.size);
+                conflict.clear();
+                for (std::size_t p : placed)
+                {
+                    if (overlap(b, buffers[p]))
+                    {
+                        conflict.push_back(p);
+                    }
+                }
+
+                // Walk the gaps between conflicting buffers in address order
+                std::size_t best = std::size_t(-1);
+                std::size_t best_gap = std::size_t(-1);
+                std::size_t cursor = 0;
+                for (std::size_t p : conflict)
+                {
+                    const buffer &o = buffers[p];
+                    if (o.offset >= cursor && o.offset - cursor >= need)
+                    {
+                        std::size_t gap = o.offset - cursor;
+                        if (strategy == plan_strategy::greedy_by_size)
+                        {
+                            best = cursor;
+                            break;
+                        }
+                        if (gap < best_gap)
+                        {
+                            best = cursor;
+                            best_gap = gap;
+                        }
+                    }
+                    cursor = std::max(cursor, o.offset + align_up(o.size));
+                }
+                b.offset = best != std::size_t(-1) ? best : cursor;
+                total = std::max(total, b.offset + need);
+
+                auto at = std::upper_bound(placed.begin(), placed.end(), b.offset, [this](std::size_t off, std::size_t p)
+                                           { return off < buffers[p].offset; });
+                placed.insert(at, id);
+            }
+            planned = true;
+            return total;
+        }
+
+        bool is_planned() const noexcept { return planned; }
+        std::size_t size() const noexcept { return buffers.size(); }
+        const buffer &operator[](std::size_t id) const { return buffers[id]; }
+
+        // Planned arena size in bytes
+        std::size_t arena_size() const
+        {
+            if (!planned)
+            {
+                throw std::logic_error("memory_planner: plan() has not run");
+            }
+            return total;
+        }
+
+        // Bytes needed with one allocation per buffer (for comparison)
+        std::size_t unplanned_size() const noexcept
+        {
+            std::size_t sum = 0;
+            for (const buffer &b : buffers)
+            {
+                sum += align_up(b.size);
+            }
+            return sum;
+        }
+
+        // Largest sum of buffer sizes alive at one time: a lower bound for any plan
+        std::size_t live_peak() const
+        {
+            std::size_t peak = 0;
+            for (const buffer &at : buffers)
+            {
+                std::size_t live = 0;
+                for (const buffer &b : buffers)
+                {
+                    if (b.first <= at.first && at.first <= b.last)
+                    {
+                        live += align_up(b.size);
+                    }
+                }
+                peak = std::max(peak, live);
+            }
+            return peak;
+        }
+
+        vector<std::size_t> offsets() const
+        {
+            arena_size();
+            vector<std::size_t> out(buffers.size());
+            for (std::size_t i = 0; i < buffers.size(); i++)
+            {
+                out[i] = buffers[i].offset;
+            }
+            return out;
+        }
+    };
+
+    ///////////////////////////////////////////////////
+    // tensor_arena: one aligned PSRAM block laid out by a plan
+    class tensor_arena
+    {
+    private:
+        uint8_t *raw;
+        std::size_t raw_size;
+        uint8_t *base;
+        std::size_t bytes;
+        vector<std::size_t> offset_table;
+
+        void allocate()
+        {
+            raw_size = bytes + STDPSRAM_TENSOR_ALIGN;
+            raw = PSRAMAllocator<uint8_t>().allocate(raw_size);
+            base = reinterpret_cast<uint8_t *>((reinterpret_cast<uintptr_t>(raw) + STDPSRAM_TENSOR_ALIGN - 1) &
+                                               ~uintptr_t(STDPSRAM_TENSOR_ALIGN - 1));
+        }
+
+    public:
+        explicit tensor_arena(const memory_planner &plan)
+            : raw(nullptr), raw_size(0), base(nullptr), bytes(plan.arena_size()), offset_table(plan.offsets())
+        {
+            allocate();
+        }
+
+        // From a stored plan (offsets as produced by memory_planner::offsets())
+        tensor_arena(std::size_t arena_bytes, const std::size_t *offsets, std::size_t count)
+            : raw(nullptr), raw_size(0), base(nullptr), bytes(arena_bytes), offset_table(offsets, offsets + count)
+        {
+            allocate();
+        }
+
+        ~tensor_arena()
+        {
+            PSRAMAllocator<uint8_t>().deallocate(raw, raw_size);
+        }
+
+        tensor_arena(const tensor_arena &) = delete;
+        tensor_arena &operator=(const tensor_arena &) = delete;
+
+        //--------------------------------
+        template <typename T = uint8_t>
+        T *get(std::size_t id)
+        {
+            return reinterpret_cast<T *>(base + offset_table.at(id));
+        }
+
+        template <typename T = uint8_t>
+        const T *get(std::size_t id) const
+        {
+            return reinterpret_cast<const T *>(base + offset_table.at(id));
+        }
+
+        uint8_t *data() noexcept { return base; }
+        std::size_t size() const noexcept { return bytes; }
+        std::size_t buffers() const noexcept { return offset_table.size(); }
+    };
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_TENSOR_ARENA_H
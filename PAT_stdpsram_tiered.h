@@ -0,0 +1,306 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Tiered SRAM/PSRAM storage:
+// Blocks are reached through handles and every access is counted. rebalance() moves the most frequently used
+// blocks into internal SRAM, within a fixed budget, and pushes cold ones back to PSRAM. Placement therefore
+// follows the actual access pattern instead of the choice of container alias.
+//
+// Pointers returned by access() stay valid until the next rebalance(); call rebalance() from idle time.
+//
+// Typical use:
+//   stdpsram::tiered_heap tiers(64 * 1024);           // 64 KB SRAM budget
+//   stdpsram::tiered<float> coeffs(tiers, 1024);       // starts in PSRAM
+//   coeffs[3] = 1.0f;                                  // counted access
+//   tiers.rebalance();                                 // hot blocks migrate to SRAM
+
+#ifndef PAT_STDPSRAM_TIERED_H
+#define PAT_STDPSRAM_TIERED_H
+
+#include "PAT_stdpsram.h"
+#include "PAT_stdpsram_memory.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+namespace stdpsram
+{
+    ///////////////////////////////////////////////////
+    // tiered_heap: access-counted blocks migrating between SRAM and PSRAM
+    class tiered_heap
+    {
+    public:
+        struct handle
+        {
+            uint32_t index;
+            uint32_t generation;
+        };
+
+        // sram_budget: maximum bytes kept in internal SRAM
+        // promote_threshold: minimum (decayed) access count before a block is considered hot
+        explicit tiered_heap(std::size_t sram_budget, uint32_t promote_threshold = 2)
+            : budget(sram_budget), threshold(promote_threshold), sram_bytes(0) {}
+
+        ~tiered_heap()
+        {
+            for (entry &e : entries)
+            {
+                if (e.live)
+                {
+                    release(e);
+                }
+            }
+        }
+
+        tiered_heap(const tiered_heap &) = delete;
+        tiered_heap &operator=(const tiered_heap &) = delete;
+
+        //--------------------------------
+        // Allocate a zero-filled block; new blocks start in PSRAM
+        handle allocate(std::size_t size)
+        {
+            uint8_t *data = PSRAMAllocator<uint8_t>().allocate(size ? size : 1);
+            stdpsram::memset(data, 0, size);
+
+            uint32_t index;
+            if (!free_entries.empty())
+            {
+                index = free_entries.back();
+                free_entries.pop_back();
+            }
+            else
+            {
+                index = static_cast<uint32_t>(entries.size());
+                entries.push_back(entry{nullptr, 0, 0, 0, false, false});
+            }
+            entry &e = entries[index];
+            e.data = data;
+            e.size = static_cast<uint32_t>(size);
+            e.count = 0;
+            e.in_sram = false;
+            e.live = true;
+            return handle{index, e.generation};
+        }
+
+        void deallocate(handle h)
+        {
+            entry &e = checked_entry(h);
+            release(e);
+            e.live = false;
+            e.generation++;
+            free_entries.push_back(h.index);
+        }
+
+        //--------------------------------
+        // Counted access; the pointer is valid until the next rebalance()
+        void *access(handle h)
+        {
+            entry &e = checked_entry(h);
+            if (e.count != 0xFFFFFFFFu)
+            {
+                e.count++;
+            }
+            return e.data;
+        }
+
+        // Uncounted access, e.g. for bulk initialisation that should not look hot
+        void *peek(handle h)
+        {
+            return checked_entry(h).data;
+        }
+
+        std::size_t size(handle h) const
+        {
+            return const_cast<tiered_heap *>(this)->checked_entry(h).size;
+        }
+
+        bool in_sram(handle h) const
+        {
+            return const_cast<tiered_heap *>(this)->checked_entry(h).in_sram;
+        }
+
+        //--------------------------------
+        // Re-place blocks: the hottest (by accesses per byte) go to SRAM until the budget is used up, everything
+        // else goes back to PSRAM. Access counts are halved afterwards so placement follows recent behaviour.
+        // Returns the number of blocks that moved.
+        std::size_t rebalance()
+        {
+            std::vector<uint32_t, SRAMAllocator<uint32_t>> order;
+            order.reserve(entries.size());
+            for (uint32_t i = 0; i < entries.size(); i++)
+            {
+                if (entries[i].live)
+                {
+                    order.push_back(i);
+                }
+            }
+            std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b)
+                      {
+                          // count_a / size_a > count_b / size_b, without division
+                          return uint64_t(entries[a].count) * (entries[b].size + 1) >
+                                 uint64_t(entries[b].count) * (entries[a].size + 1);
+                      });
+
+            std::vector<bool, SRAMAllocator<bool>> hot(entries.size(), false);
+            std::size_t planned = 0;
+            for (uint32_t i : order)
+            {
+                const entry &e = entries[i];
+                // order is by density, not by count: a tiny block can rank high with few accesses, so
+                // cold blocks are skipped rather than ending the scan
+                if (e.count < threshold)
+                {
+                    continue;
+                }
+                if (planned + e.size <= budget)
+                {
+                    hot[i] = true;
+                    planned += e.size;
+                }
+            }
+
+            std::size_t moves = 0;
+            // Demote first so the SRAM they free is available for promotions
+            for (uint32_t i : order)
+            {
+                if (entries[i].in_sram && !hot[i])
+                {
+                    moves += migrate(entries[i], false);
+                }
+            }
+            for (uint32_t i : order)
+            {
+                if (!entries[i].in_sram && hot[i])
+                {
+                    moves += migrate(entries[i], true);
+                }
+            }
+            for (uint32_t i : order)
+            {
+                entries[i].count >>= 1;
+            }
+            return moves;
+        }
+
+        //--------------------------------
+        std::size_t sram_budget() const noexcept
+        {
+            return budget;
+        }
+
+        std::size_t sram_used() const noexcept
+        {
+            return sram_bytes;
+        }
+
+    private:
+        struct entry
+        {
+            uint8_t *data;
+            uint32_t size;
+            uint32_t count;
+            uint32_t generation;
+            bool in_sram;
+            bool live;
+        };
+
+        std::size_t budget;
+        uint32_t threshold;
+        std::size_t sram_bytes;
+        vector<entry> entries;
+        vector<uint32_t> free_entries;
+
+        entry &checked_entry(handle h)
+        {
+            if (h.index >= entries.size() || !entries[h.index].live || entries[h.index].generation != h.generation)
+            {
+                throw std::invalid_argument("tiered_heap: stale or invalid handle");
+            }
+            return entries[h.index];
+        }
+
+        void release(entry &e) noexcept
+        {
+            std::size_t n = e.size ? e.size : 1;
+            if (e.in_sram)
+            {
+                SRAMAllocator<uint8_t>().deallocate(e.data, n);
+                sram_bytes -= e.size;
+            }
+            else
+            {
+                PSRAMAllocator<uint8_t>().deallocate(e.data, n);
+            }
+            e.data = nullptr;
+        }
+
+        // Copy a block to the other tier. SRAM exhaustion is not an error: the block simply stays in PSRAM.
+        std::size_t migrate(entry &e, bool to_sram)
+        {
+            std::size_t n = e.size ? e.size : 1;
+            uint8_t *data;
+            try
+            {
+                data = to_sram ? SRAMAllocator<uint8_t>().allocate(n) : PSRAMAllocator<uint8_t>().allocate(n);
+            }
+            catch (const std::bad_alloc &)
+            {
+                if (to_sram)
+                {
+                    return 0;
+                }
+                throw;
+            }
+            stdpsram::memcpy(data, e.data, e.size);
+            release(e);
+            e.data = data;
+            e.in_sram = to_sram;
+            if (to_sram)
+            {
+                sram_bytes += e.size;
+            }
+            return 1;
+        }
+    };
+
+    ///////////////////////////////////////////////////
+    // tiered: owning, typed array of T in a tiered_heap; every element access is counted
+    template <typename T>
+    class tiered
+    {
+    private:
+        tiered_heap &heap;
+        tiered_heap::handle h;
+        std::size_t n;
+
+    public:
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "tiered_heap migrates blocks with memcpy; T must be trivially copyable");
+
+        explicit tiered(tiered_heap &heap, std::size_t count = 1)
+            : heap(heap), h(heap.allocate(count * sizeof(T))), n(count) {}
+
+        ~tiered()
+        {
+            heap.deallocate(h);
+        }
+
+        tiered(const tiered &) = delete;
+        tiered &operator=(const tiered &) = delete;
+
+        T &operator[](std::size_t i) { return static_cast<T *>(heap.access(h))[i]; }
+        T &operator*() { return *static_cast<T *>(heap.access(h)); }
+        T *operator->() { return static_cast<T *>(heap.access(h)); }
+
+        // One counted access for a whole batch; valid until the next rebalance()
+        T *data() { return static_cast<T *>(heap.access(h)); }
+
+        std::size_t size() const noexcept { return n; }
+        bool in_sram() const { return heap.in_sram(h); }
+    };
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_TIERED_H
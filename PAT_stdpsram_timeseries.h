@@ -0,0 +1,592 @@
+// Copyright (c) 2023, Pourya Afshintabar (PAT). All rights reserved.
+// This project is licensed under the BSD 3-Clause License, which can be found in the LICENSE file of this repository.
+//
+// Compressed time series in PSRAM:
+// stdpsram::timeseries keeps (timestamp, float) samples in fixed-size compressed blocks, Gorilla style:
+// - timestamps as delta-of-delta with variable-length prefixes (regular sampling costs 1 bit per sample),
+// - values as the XOR with the previous value, storing only the meaningful bits (slow signals cost a few bits).
+// The block being filled lives in SRAM; full blocks are sealed into a PSRAM ring and, once the ring is full,
+// the oldest block is dropped. Each block header keeps its time span and min/max/sum, so range reads skip whole
+// blocks and downsampling uses the header instead of decoding when a block falls inside one bucket.
+//
+//   stdpsram::timeseries history(512 * 1024);      // PSRAM budget in bytes
+//   history.append(millis(), temperature);
+//   for (const stdpsram::timeseries::sample &s : history.range(t0, t1)) { ... }
+//   history.downsample(t0, t1, 60000, [](const stdpsram::timeseries::bucket &b) { plot(b.start, b.mean); });
+//
+// Timestamps must not decrease. Appending invalidates running ranges.
+
+#ifndef PAT_STDPSRAM_TIMESERIES_H
+#define PAT_STDPSRAM_TIMESERIES_H
+
+#include "PAT_stdpsram.h"
+#include "PAT_stdpsram_memory.h"
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+#ifndef STDPSRAM_TIMESERIES_BLOCK
+#define STDPSRAM_TIMESERIES_BLOCK 1024 // bytes per compressed block
+#endif
+
+namespace stdpsram
+{
+    namespace detail
+    {
+        // Summary of one compressed block
+        struct ts_block
+        {
+            int64_t first_time;
+            int64_t last_time;
+            float min;
+            float max;
+            double sum;
+            uint32_t count;
+            uint32_t bits;
+        };
+
+        // Largest encoding of one sample: 4 + 64 timestamp bits, 2 + 5 + 5 + 32 value bits
+        static const uint32_t ts_max_sample_bits = 112;
+
+        inline uint32_t float_bits(float v)
+        {
+            uint32_t b;
+            std::memcpy(&b, &v, sizeof(b));
+            return b;
+        }
+
+        inline float bits_float(uint32_t b)
+        {
+            float v;
+            std::memcpy(&v, &b, sizeof(v));
+            return v;
+        }
+
+        inline int leading_zeros(uint32_t x)
+        {
+            int n = 0;
+            for (uint32_t bit = 0x80000000u; bit && !(x & bit); bit >>= 1)
+            {
+                n++;
+            }
+            return n;
+        }
+
+        inline int trailing_zeros(uint32_t x)
+        {
+            int n = 0;
+            for (uint32_t bit = 1; bit && !(x & bit); bit <<= 1)
+            {
+                n++;
+            }
+            return n;
+        }
+
+        // State shared by the encoder and decoder: previous timestamp, delta, value and XOR window
+        struct ts_state
+        {
+            int64_t time;
+            int64_t delta;
+            uint32_t value;
+            int leading;
+            int meaningful; // 0: no window yet
+        };
+
+        class ts_encoder
+        {
+        private:
+            uint8_t *data;
+            uint32_t pos;
+            ts_state s;
+
+            void put(uint64_t value, int bits)
+            {
+                while (bits--)
+                {
+                    uint32_t byte = pos >> 3;
+                    uint8_t mask = uint8_t(0x80 >> (pos & 7));
+                    if ((value >> bits) & 1)
+                        data[byte] |= mask;
+                    else
+                        data[byte] &= uint8_t(~mask);
+                    pos++;
+                }
+            }
+
+        public:
+            void reset(uint8_t *block)
+            {
+                data = block;
+                pos = 0;
+                s = ts_state();
+            }
+
+            uint32_t bits() const { return pos; }
+
+            void first(int64_t time, float value)
+            {
+                s.time = time;
+                s.value = float_bits(value);
+                put(s.value, 32);
+            }
+
+            void next(int64_t time, float value)
+            {
+                int64_t delta = time - s.time;
+                int64_t dod = delta - s.delta;
+                if (dod == 0)
+                    put(0, 1);
+                else if (dod >= -64 && dod <= 63)
+                    put((0x2ull << 7) | (uint64_t(dod) & 0x7F), 9);
+                else if (dod >= -256 && dod <= 255)
+                    put((0x6ull << 9) | (uint64_t(dod) & 0x1FF), 12);
+                else if (dod >= -2048 && dod <= 2047)
+                    put((0xEull << 12) | (uint64_t(dod) & 0xFFF), 16);
+                else
+                {
+                    put(0xF, 4);
+                    put(uint64_t(dod), 64);
+                }
+                s.time = time;
+                s.delta = delta;
+
+                uint32_t bits = float_bits(value);
+                uint32_t x = bits ^ s.value;
+                s.value = bits;
+                if (x == 0)
+                {
+                    put(0, 1);
+                    return;
+                }
+                int leading = leading_zeros(x);
+                int trailing = trailing_zeros(x);
+                if (s.meaningful && leading >= s.leading && trailing >= 32 - s.leading - s.meaningful)
+                {
+                    // Fits in the previous window
+                    put(0x2, 2);
+                    put(x >> (32 - s.leading - s.meaningful), s.meaningful);
+                    return;
+                }
+                s.leading = leading;
+                s.meaningful = 32 - leading - trailing;
+                put(0x3, 2);
+                put(uint64_t(leading), 5);
+                put(uint64_t(s.meaningful - 1), 5);
+                put(x >> trailing, s.meaningful);
+            }
+        };
+
+        class ts_decoder
+        {
+        private:
+            const uint8_t *data;
+            uint32_t pos;
+            uint32_t left;
+            ts_state s;
+
+            uint64_t get(int bits)
+            {
+                uint64_t v = 0;
+                while (bits--)
+                {
+                    v = (v << 1) | ((data[pos >> 3] >> (7 - (pos & 7))) & 1);
+                    pos++;
+                }
+                return v;
+            }
+
+            static int64_t sign_extend(uint64_t v, int bits)
+            {
+                uint64_t sign = uint64_t(1) << (bits - 1);
+                return int64_t((v ^ sign) - sign);
+            }
+
+        public:
+            ts_decoder() : data(nullptr), pos(0), left(0), s() {}
+
+            void reset(const uint8_t *block, const ts_block &info)
+            {
+                data = block;
+                pos = 0;
+                left = info.count;
+                s = ts_state();
+                s.time = info.first_time;
+            }
+
+            uint32_t remaining() const { return left; }
+
+            void next(int64_t &time, float &value)
+            {
+                if (pos == 0)
+                {
+                    s.value = uint32_t(get(32));
+                }
+                else
+                {
+                    int64_t dod;
+                    if (!get(1))
+                        dod = 0;
+                    else if (!get(1))
+                        dod = sign_extend(get(7), 7);
+                    else if (!get(1))
+                        dod = sign_extend(get(9), 9);
+                    else if (!get(1))
+                        dod = sign_extend(get(12), 12);
+                    else
+                        dod = int64_t(get(64));
+                    s.delta += dod;
+                    s.time += s.delta;
+
+                    if (get(1))
+                    {
+                        if (get(1))
+                        {
+                            s.leading = int(get(5));
+                            s.meaningful = int(get(5)) + 1;
+                        }
+                        s.value ^= uint32_t(get(s.meaningful)) << (32 - s.leading - s.meaningful);
+                    }
+                }
+                left--;
+                time = s.time;
+                value = bits_float(s.value);
+            }
+        };
+    }
+
+    ///////////////////////////////////////////////////
+    // timeseries: append-only compressed samples in a ring of PSRAM blocks
+    class timeseries
+    {
+    public:
+        struct sample
+        {
+            int64_t time;
+            float value;
+        };
+
+        // Aggregate of the samples in [start, start + width)
+        struct bucket
+        {
+            int64_t start;
+            float min;
+            float max;
+            float mean;
+            std::size_t count;
+        };
+
+    private:
+        std::size_t block_bytes;
+        std::size_t max_blocks;
+        vector<uint8_t> pool;            // sealed blocks, max_blocks * block_bytes
+        vector<detail::ts_block> sealed; // ring of headers, oldest at head
+        std::size_t head;
+        std::size_t sealed_count;
+        std::vector<uint8_t, SRAMAllocator<uint8_t>> active_data;
+        detail::ts_block active;
+        detail::ts_encoder encoder;
+        std::size_t samples;
+
+        // Blocks in time order: the sealed ring, then the active block if it holds samples
+        std::size_t block_count() const
+        {
+            return sealed_count + (active.count ? 1 : 0);
+        }
+
+        const detail::ts_block &block_info(std::size_t i) const
+        {
+            return i < sealed_count ? sealed[(head + i) % max_blocks] : active;
+        }
+
+        const uint8_t *block_data(std::size_t i) const
+        {
+            return i < sealed_count ? pool.data() + ((head + i) % max_blocks) * block_bytes : active_data.data();
+        }
+
+        // Start of the bucket of the given width (counted from `from`) that holds t >= from. The offset is taken in
+        // uint64_t: t - from overflows int64_t for a wide query such as range()'s default [INT64_MIN, INT64_MAX].
+        // The result lies in [from, t], so converting back is exact.
+        static int64_t bucket_start(int64_t from, int64_t t, int64_t width)
+        {
+            uint64_t offset = uint64_t(t) - uint64_t(from);
+            return int64_t(uint64_t(from) + offset / uint64_t(width) * uint64_t(width));
+        }
+
+        // First block whose samples may reach time t
+        std::size_t first_block_at(int64_t t) const
+        {
+            std::size_t lo = 0, hi = block_count();
+            while (lo < hi)
+            {
+                std::size_t mid = (lo + hi) / 2;
+                if (block_info(mid).last_time < t)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            return lo;
+        }
+
+        void seal()
+        {
+            std::size_t slot;
+            if (sealed_count == max_blocks)
+            {
+                slot = head; // overwrite the oldest block
+                samples -= sealed[head].count;
+                head = (head + 1) % max_blocks;
+            }
+            else
+            {
+                slot = (head + sealed_count) % max_blocks;
+                sealed_count++;
+            }
+            stdpsram::memcpy(pool.data() + slot * block_bytes, active_data.data(), (active.bits + 7) / 8);
+            sealed[slot] = active;
+            active = detail::ts_block();
+        }
+
+    public:
+        class iterator
+        {
+        private:
+            const timeseries *ts;
+            std::size_t block;
+            int64_t to;
+            detail::ts_decoder dec;
+            sample current;
+
+            void load(std::size_t b)
+            {
+                block = b;
+                if (block < ts->block_count() && ts->block_info(block).first_time <= to)
+                {
+                    dec.reset(ts->block_data(block), ts->block_info(block));
+                }
+                else
+                {
+                    ts = nullptr;
+                }
+            }
+
+        public:
+            typedef std::input_iterator_tag iterator_category;
+            typedef timeseries::sample value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const sample *pointer;
+            typedef const sample &reference;
+
+            iterator() : ts(nullptr), block(0), to(0), current() {}
+
+            iterator(const timeseries *owner, int64_t from, int64_t until) : ts(owner), block(0), to(until), current()
+            {
+                load(ts->first_block_at(from));
+                while (ts)
+                {
+                    ++*this;
+                    if (!ts || current.time >= from)
+                    {
+                        break;
+                    }
+                }
+            }
+
+            const sample &operator*() const { return current; }
+            const sample *operator->() const { return &current; }
+
+            iterator &operator++()
+            {
+                while (ts && !dec.remaining())
+                {
+                    load(block + 1);
+                }
+                if (ts)
+                {
+                    dec.next(current.time, current.value);
+                    if (current.time > to)
+                    {
+                        ts = nullptr;
+                    }
+                }
+                return *this;
+            }
+
+            bool operator==(const iterator &o) const
+            {
+                return ts == o.ts && (!ts || (block == o.block && dec.remaining() == o.dec.remaining()));
+            }
+            bool operator!=(const iterator &o) const { return !(*this == o); }
+        };
+
+        class range_view
+        {
+        private:
+            const timeseries *ts;
+            int64_t from, to;
+
+        public:
+            range_view(const timeseries *owner, int64_t from, int64_t to) : ts(owner), from(from), to(to) {}
+            iterator begin() const { return iterator(ts, from, to); }
+            iterator end() const { return iterator(); }
+        };
+
+        // psram_bytes: budget for sealed blocks (at least one block); block_bytes: size of one compressed block
+        explicit timeseries(std::size_t psram_bytes, std::size_t block_bytes = STDPSRAM_TIMESERIES_BLOCK)
+            : block_bytes(block_bytes < 64 ? 64 : block_bytes),
+              max_blocks(psram_bytes / this->block_bytes ? psram_bytes / this->block_bytes : 1),
+              pool(max_blocks * this->block_bytes), sealed(max_blocks), head(0), sealed_count(0),
+              active_data(this->block_bytes), active(), samples(0)
+        {
+            encoder.reset(active_data.data());
+        }
+
+        timeseries(const timeseries &) = delete;
+        timeseries &operator=(const timeseries &) = delete;
+
+        //--------------------------------
+        void append(int64_t time, float value)
+        {
+            if (active.count && time < active.last_time)
+            {
+                throw std::invalid_argument("timeseries: timestamps must not decrease");
+            }
+            if (!active.count && sealed_count && time < block_info(sealed_count - 1).last_time)
+            {
+                throw std::invalid_argument("timeseries: timestamps must not decrease");
+            }
+            if (active.count && active.bits + detail::ts_max_sample_bits > block_bytes * 8)
+            {
+                seal();
+                encoder.reset(active_data.data());
+            }
+            if (!active.count)
+            {
+                encoder.first(time, value);
+                active.first_time = time;
+                active.min = active.max = value;
+            }
+            else
+            {
+                encoder.next(time, value);
+                active.min = value < active.min ? value : active.min;
+                active.max = value > active.max ? value : active.max;
+            }
+            active.last_time = time;
+            active.sum += value;
+            active.count++;
+            active.bits = encoder.bits();
+            samples++;
+        }
+
+        // Samples with from <= time <= to, in time order
+        range_view range(int64_t from = std::numeric_limits<int64_t>::min(),
+                         int64_t to = std::numeric_limits<int64_t>::max()) const
+        {
+            return range_view(this, from, to);
+        }
+
+        // Calls f(const bucket &) for every non-empty bucket of the given width in [from, to], in order
+        template <typename F>
+        void downsample(int64_t from, int64_t to, int64_t width, F f) const
+        {
+            if (width <= 0)
+            {
+                throw std::invalid_argument("timeseries: bucket width must be positive");
+            }
+            bucket b = {0, 0, 0, 0, 0};
+            double sum = 0;
+            auto add = [&](int64_t start, float lo, float hi, double s, std::size_t n)
+            {
+                if (b.count && b.start != start)
+                {
+                    b.mean = float(sum / double(b.count));
+                    f(b);
+                    b.count = 0;
+                }
+                if (!b.count)
+                {
+                    b.start = start;
+                    b.min = lo;
+                    b.max = hi;
+                    sum = 0;
+                }
+                b.min = lo < b.min ? lo : b.min;
+                b.max = hi > b.max ? hi : b.max;
+                sum += s;
+                b.count += n;
+            };
+
+            detail::ts_decoder dec;
+            for (std::size_t i = first_block_at(from); i < block_count(); i++)
+            {
+                const detail::ts_block &info = block_info(i);
+                if (info.first_time > to)
+                {
+                    break;
+                }
+                if (info.first_time >= from && info.last_time <= to)
+                {
+                    int64_t start = bucket_start(from, info.first_time, width);
+                    if (uint64_t(info.last_time) - uint64_t(start) < uint64_t(width))
+                    {
+                        add(start, info.min, info.max, info.sum, info.count); // whole block in one bucket
+                        continue;
+                    }
+                }
+                dec.reset(block_data(i), info);
+                while (dec.remaining())
+                {
+                    int64_t t;
+                    float v;
+                    dec.next(t, v);
+                    if (t > to)
+                    {
+                        break;
+                    }
+                    if (t >= from)
+                    {
+                        add(bucket_start(from, t, width), v, v, v, 1);
+                    }
+                }
+            }
+            if (b.count)
+            {
+                b.mean = float(sum / double(b.count));
+                f(b);
+            }
+        }
+
+        void clear()
+        {
+            head = 0;
+            sealed_count = 0;
+            active = detail::ts_block();
+            encoder.reset(active_data.data());
+            samples = 0;
+        }
+
+        std::size_t size() const noexcept { return samples; }
+        bool empty() const noexcept { return samples == 0; }
+        std::size_t blocks() const noexcept { return block_count(); }
+
+        // Time of the oldest / newest stored sample (undefined when empty)
+        int64_t oldest() const { return block_info(0).first_time; }
+        int64_t newest() const { return active.count ? active.last_time : block_info(sealed_count - 1).last_time; }
+
+        // Bytes of compressed data currently stored, for comparing against 12 bytes per raw sample
+        std::size_t compressed_bytes() const
+        {
+            std::size_t bits = 0;
+            for (std::size_t i = 0; i < block_count(); i++)
+            {
+                bits += block_info(i).bits;
+            }
+            return (bits + 7) / 8;
+        }
+    };
+}
+
+///////////////////////////////////////////////////
+#endif // PAT_STDPSRAM_TIMESERIES_H
@@ -14,7 +14,40 @@
 //_____________________________________________________________________________________________________________________
 
 #include <Arduino.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+/// Log flusher output goes to Serial as usual; lines are counted so test_log_ring can see what was drained.
+static std::atomic<std::size_t> log_lines(0);
+static std::atomic<std::size_t> log_bad_formats(0);
+static void log_output(const char *data, std::size_t size)
+{
+      static const char bad[] = "[log] bad format";
+      log_lines += std::count(data, data + size, '\n');
+      for (const char *p = data; (p = std::search(p, data + size, bad, bad + sizeof(bad) - 1)) != data + size; p++)
+            log_bad_formats++;
+      Serial.write(reinterpret_cast<const uint8_t *>(data), size);
+}
+#define STDPSRAM_LOG_OUTPUT(data, size) log_output(data, size)
+
 #include <PAT_stdpsram.h>
+#include <PAT_stdpsram_format.h>
+#include <PAT_stdpsram_heap.h>
+#include <PAT_stdpsram_image.h>
+#include <PAT_stdpsram_json.h>
+#include <PAT_stdpsram_log.h>
+#include <PAT_stdpsram_matrix.h>
+#include <PAT_stdpsram_memory.h>
+#include <PAT_stdpsram_paged.h>
+#include <PAT_stdpsram_parallel.h>
+#include <PAT_stdpsram_relocatable.h>
+#include <PAT_stdpsram_simd.h>
+#include <PAT_stdpsram_sort.h>
+#include <PAT_stdpsram_sparse.h>
+#include <PAT_stdpsram_tiered.h>
+#include <PAT_stdpsram_timeseries.h>
 
 /// Prints the free heap and PSRAM memory to the serial console.
 #define PRINT_FREE_HEAP_AND_PSRAM                                           \
@@ -22,6 +55,891 @@
                     __LINE__, String((ESP.getFreeHeap()) / 1000.0).c_str(), \
                     String((heap_caps_get_free_size(MALLOC_CAP_SPIRAM)) / 1000.0).c_str());
 
+/// Prints PASS/FAIL for one check and returns the result.
+static bool check(bool ok, const char *what)
+{
+      Serial.printf("  %s: %s\n", ok ? "PASS" : "FAIL", what);
+      return ok;
+}
+
+/// Runs f once and returns the elapsed time in microseconds (at least 1).
+template <typename F>
+static unsigned long time_us(F f)
+{
+      unsigned long start = micros();
+      f();
+      unsigned long elapsed = micros() - start;
+      return elapsed ? elapsed : 1;
+}
+
+/// Prints one benchmark line: throughput of the plain loop and of the stdpsram version.
+static void report(const char *what, std::size_t bytes, unsigned long plain_us, unsigned long fast_us)
+{
+      Serial.printf("  %-28s plain: %8.1f MB/s  stdpsram: %8.1f MB/s  (x%.2f)\n", what,
+                    double(bytes) / plain_us, double(bytes) / fast_us, double(plain_us) / fast_us);
+}
+
+/// Keeps benchmark results alive so the compiler cannot drop the measured loops.
+static volatile double benchmark_sink;
+
+//_____________________________________________________________________________________________________________________
+// compacting_heap: the largest free block recovers after fragmentation, and compaction interleaved with
+// allocate/deallocate keeps every block intact
+static void test_compacting_heap()
+{
+      Serial.println("Testing compacting_heap:");
+      {
+            stdpsram::compacting_heap heap(32 * (1024 + 8)); // exactly 32 blocks of 1 KB plus their 8-byte headers
+            stdpsram::compacting_heap::handle blocks[32];
+            for (int i = 0; i < 32; i++)
+            {
+                  blocks[i] = heap.allocate(1024);
+                  stdpsram::pinned<uint8_t> p(heap, blocks[i]);
+                  memset(p.get(), i, 1024);
+            }
+            for (int i = 0; i < 32; i += 2)
+            {
+                  heap.deallocate(blocks[i]);
+            }
+            std::size_t fragmented = heap.largest_free_block();
+            while (heap.compact_step(4096))
+            {
+            }
+            std::size_t compacted = heap.largest_free_block();
+            Serial.printf("  largest free block: %u -> %u bytes\n", unsigned(fragmented), unsigned(compacted));
+            check(fragmented < 2 * 1024 && compacted >= 16 * 1024, "largest free block recovers");
+            bool intact = true;
+            for (int i = 1; i < 32; i += 2)
+            {
+                  stdpsram::pinned<uint8_t> p(heap, blocks[i]);
+                  for (int k = 0; k < 1024; k++)
+                        intact = intact && p[k] == uint8_t(i);
+            }
+            check(intact, "moved blocks keep their contents");
+      }
+      {
+            // Partial compaction steps interleaved with deallocate/allocate
+            stdpsram::compacting_heap heap(4096);
+            heap.allocate(64);
+            stdpsram::compacting_heap::handle b = heap.allocate(64);
+            stdpsram::compacting_heap::handle c = heap.allocate(256);
+            stdpsram::compacting_heap::handle d = heap.allocate(256);
+            heap.allocate(256);
+            heap.deallocate(b);
+            heap.compact_step(1);
+            heap.compact_step(1);
+            heap.deallocate(d);
+            heap.deallocate(c);
+            stdpsram::compacting_heap::handle e = heap.allocate(600);
+            {
+                  stdpsram::pinned<uint8_t> p(heap, e);
+                  memset(p.get(), 0xAB, 600);
+            }
+            std::size_t before = heap.free_bytes();
+            heap.compact_step(100000);
+            check(heap.free_bytes() == before, "interleaved compact_step keeps free bytes");
+            bool intact = true;
+            stdpsram::pinned<uint8_t> p(heap, e);
+            for (int k = 0; k < 600; k++)
+                  intact = intact && p[k] == 0xAB;
+            check(intact, "interleaved compact_step keeps block contents");
+      }
+}
+
+//_____________________________________________________________________________________________________________________
+// stdpsram::simd kernels against the plain loops they replace, on PSRAM arrays larger than the cache
+static void benchmark_simd()
+{
+      Serial.printf("Benchmarking stdpsram::simd (%s):\n", stdpsram::simd::backend());
+      const std::size_t n = 256 * 1024;
+      stdpsram::vector<float> a(n), b(n);
+      stdpsram::vector<int16_t> p(n), q(n);
+      for (std::size_t i = 0; i < n; i++)
+      {
+            a[i] = float(i % 1000) * 0.001f;
+            b[i] = float(i % 7) - 3.0f;
+            p[i] = int16_t(i * 31);
+            q[i] = int16_t(i * 17);
+      }
+
+      unsigned long plain = time_us([&]
+                                    {
+            float total = 0.0f;
+            for (std::size_t i = 0; i < n; i++)
+                  total += a[i];
+            benchmark_sink = total; });
+      unsigned long fast = time_us([&]
+                                   { benchmark_sink = stdpsram::simd::sum(a); });
+      report("sum(float)", n * sizeof(float), plain, fast);
+
+      plain = time_us([&]
+                      {
+            float total = 0.0f;
+            for (std::size_t i = 0; i < n; i++)
+                  total += a[i] * b[i];
+            benchmark_sink = total; });
+      fast = time_us([&]
+                     { benchmark_sink = stdpsram::simd::dot(a, b); });
+      report("dot(float)", 2 * n * sizeof(float), plain, fast);
+
+      plain = time_us([&]
+                      {
+            int64_t total = 0;
+            for (std::size_t i = 0; i < n; i++)
+                  total += int32_t(p[i]) * q[i];
+            benchmark_sink = double(total); });
+      fast = time_us([&]
+                     { benchmark_sink = double(stdpsram::simd::dot(p, q)); });
+      report("dot(int16)", 2 * n * sizeof(int16_t), plain, fast);
+
+      plain = time_us([&]
+                      {
+            for (std::size_t i = 0; i < n; i++)
+                  a[i] *= 1.0001f; });
+      fast = time_us([&]
+                     { stdpsram::simd::scale(a, 1.0001f); });
+      report("scale(float)", 2 * n * sizeof(float), plain, fast);
+
+      plain = time_us([&]
+                      {
+            for (std::size_t i = 0; i < n; i++)
+            {
+                  float v = a[i] * 100.0f;
+                  p[i] = int16_t(v > 32767.0f ? 32767.0f : v < -32768.0f ? -32768.0f : v);
+            } });
+      fast = time_us([&]
+                     { stdpsram::simd::convert(a.data(), p.data(), n, 100.0f); });
+      report("convert(float -> int16)", n * (sizeof(float) + sizeof(int16_t)), plain, fast);
+}
+
+//_____________________________________________________________________________________________________________________
+// stdpsram::memcpy / memset against libc ("plain") on PSRAM buffers larger than the cache
+static void benchmark_memory()
+{
+      Serial.printf("Benchmarking stdpsram::memcpy / memset against libc:\n");
+      const std::size_t n = 1024 * 1024;
+      stdpsram::vector<uint8_t> src(n + 64, 0x5A), dst(n + 64);
+      const int rounds = 4;
+
+      unsigned long plain = time_us([&]
+                                    {
+            for (int r = 0; r < rounds; r++)
+                  ::memcpy(dst.data(), src.data(), n); });
+      unsigned long fast = time_us([&]
+                                   {
+            for (int r = 0; r < rounds; r++)
+                  stdpsram::memcpy(dst.data(), src.data(), n); });
+      report("memcpy (aligned)", rounds * n, plain, fast);
+
+      // Same misalignment on both sides: the burst path aligns the destination and copies whole lines
+      plain = time_us([&]
+                      {
+            for (int r = 0; r < rounds; r++)
+                  ::memcpy(dst.data() + 4, src.data() + 4, n); });
+      fast = time_us([&]
+                     {
+            for (int r = 0; r < rounds; r++)
+                  stdpsram::memcpy(dst.data() + 4, src.data() + 4, n); });
+      report("memcpy (offset 4)", rounds * n, plain, fast);
+
+      plain = time_us([&]
+                      {
+            for (int r = 0; r < rounds; r++)
+                  ::memset(dst.data(), r, n); });
+      fast = time_us([&]
+                     {
+            for (int r = 0; r < rounds; r++)
+                  stdpsram::memset(dst.data(), r, n); });
+      report("memset", rounds * n, plain, fast);
+      benchmark_sink = dst[n / 2];
+}
+
+//_____________________________________________________________________________________________________________________
+// stdpsram::sort against std::sort ("plain") on the same PSRAM vectors
+static void benchmark_sort()
+{
+      Serial.printf("Benchmarking stdpsram::sort against std::sort:\n");
+      const std::size_t n = 256 * 1024;
+      stdpsram::vector<uint32_t> keys(n), copy;
+      uint32_t x = 2463534242u;
+      for (std::size_t i = 0; i < n; i++)
+      {
+            x ^= x << 13, x ^= x >> 17, x ^= x << 5; // xorshift32
+            keys[i] = x;
+      }
+
+      copy = keys;
+      unsigned long plain = time_us([&]
+                                    { std::sort(copy.begin(), copy.end()); });
+      stdpsram::vector<uint32_t> expected = copy;
+      copy = keys;
+      unsigned long fast = time_us([&]
+                                   { stdpsram::sort(copy); });
+      report("uint32 (radix_sort)", n * sizeof(uint32_t), plain, fast);
+      check(copy == expected, "radix_sort matches std::sort");
+
+      stdpsram::vector<float> values(n), fcopy;
+      for (std::size_t i = 0; i < n; i++)
+            values[i] = float(int32_t(keys[i])) * 1e-3f;
+      fcopy = values;
+      plain = time_us([&]
+                      { std::sort(fcopy.begin(), fcopy.end()); });
+      stdpsram::vector<float> fexpected = fcopy;
+      fcopy = values;
+      fast = time_us([&]
+                     { stdpsram::sort(fcopy); });
+      report("float (radix_sort)", n * sizeof(float), plain, fast);
+      check(fcopy == fexpected, "float radix_sort matches std::sort");
+
+      // Descending order is not the default ordering, so this goes through merge_sort
+      copy = keys;
+      plain = time_us([&]
+                      { std::sort(copy.begin(), copy.end(), std::greater<uint32_t>()); });
+      expected = copy;
+      copy = keys;
+      fast = time_us([&]
+                     { stdpsram::sort(copy, std::greater<uint32_t>()); });
+      report("uint32 desc (merge_sort)", n * sizeof(uint32_t), plain, fast);
+      check(copy == expected, "merge_sort matches std::sort");
+}
+
+//_____________________________________________________________________________________________________________________
+// stdpsram::parallel on all cores against the same work on the calling core ("plain")
+static void benchmark_parallel()
+{
+      Serial.printf("Benchmarking stdpsram::parallel on %u workers:\n", unsigned(stdpsram::parallel::workers()));
+      const std::size_t n = 256 * 1024;
+      stdpsram::vector<float> in(n), out(n);
+      for (std::size_t i = 0; i < n; i++)
+            in[i] = float(i % 4096) * 0.25f;
+      auto work = [](float x)
+      { return x * x * 0.5f + x * 3.0f + 1.0f; };
+
+      unsigned long plain = time_us([&]
+                                    { std::transform(in.begin(), in.end(), out.begin(), work); });
+      unsigned long fast = time_us([&]
+                                   { stdpsram::parallel::transform(in, out, work); });
+      report("transform", 2 * n * sizeof(float), plain, fast);
+
+      double total = 0.0;
+      plain = time_us([&]
+                      {
+            for (std::size_t i = 0; i < n; i++)
+                  total += in[i]; });
+      double parallel_total = 0.0;
+      fast = time_us([&]
+                     { parallel_total = stdpsram::parallel::reduce(in, 0.0, std::plus<double>()); });
+      report("reduce", n * sizeof(float), plain, fast);
+      check(total == parallel_total, "parallel::reduce matches the serial sum");
+
+      stdpsram::vector<uint32_t> keys(n), copy;
+      uint32_t x = 88172645u;
+      for (std::size_t i = 0; i < n; i++)
+      {
+            x ^= x << 13, x ^= x >> 17, x ^= x << 5; // xorshift32
+            keys[i] = x;
+      }
+      copy = keys;
+      plain = time_us([&]
+                      { std::sort(copy.begin(), copy.end()); });
+      stdpsram::vector<uint32_t> expected = copy;
+      copy = keys;
+      fast = time_us([&]
+                     { stdpsram::parallel::sort(copy); });
+      report("sort", n * sizeof(uint32_t), plain, fast);
+      check(copy == expected, "parallel::sort matches std::sort");
+}
+
+//_____________________________________________________________________________________________________________________
+// stdpsram::format_to into a PSRAM string against snprintf appended to an Arduino String ("plain")
+static void benchmark_format()
+{
+      Serial.printf("Benchmarking stdpsram::format_to against snprintf:\n");
+      const int lines = 2000;
+      String plain_text;
+      stdpsram::string text;
+      char line[96];
+
+      unsigned long plain = time_us([&]
+                                    {
+            for (int i = 0; i < lines; i++)
+            {
+                  snprintf(line, sizeof(line), "t=%d T=%.2f v=%g id=%#06x\n", i * 10, 21.5 + i * 0.013, 1.0 / (i + 1), i + 1);
+                  plain_text += line;
+            } });
+      unsigned long fast = time_us([&]
+                                   {
+            for (int i = 0; i < lines; i++)
+                  stdpsram::format_to(text, STDPSRAM_FMT("t={} T={:.2f} v={:g} id={:#06x}\n"), i * 10, 21.5 + i * 0.013, 1.0 / (i + 1), i + 1); });
+      report("mixed line", text.size(), plain, fast);
+      check(text.size() == plain_text.length() && text == plain_text.c_str(), "format_to matches snprintf");
+
+      // Values whose rounding moves the exponent or needs more than 64-bit fixed point
+      const double edge[] = {99999.95, 9.9999995, 999999.5, 9.9999999e-05, 1.9e19, 5e-324, 1.7976931348623157e308};
+      bool same = true;
+      for (double v : edge)
+      {
+            char want[800];
+            snprintf(want, sizeof(want), "%f %e %g %.3f", v, v, v, v);
+            stdpsram::string got = stdpsram::format(STDPSRAM_FMT("{:f} {:e} {:g} {:.3f}"), v, v, v, v);
+            same = same && got == want;
+      }
+      check(same, "float edge cases match snprintf");
+}
+
+//_____________________________________________________________________________________________________________________
+// log_ring: producers on both cores, then shutdown while the flusher may be mid-flush
+struct log_producer
+{
+      stdpsram::log_ring *ring;
+      int id;
+      std::atomic<int> *accepted;
+      SemaphoreHandle_t done;
+};
+
+static void log_producer_task(void *arg)
+{
+      log_producer *p = static_cast<log_producer *>(arg);
+      for (int i = 0; i < 64; i++)
+      {
+            if (p->ring->push(STDPSRAM_FMT("producer {} record {}"), p->id, i))
+                  (*p->accepted)++;
+      }
+      xSemaphoreGive(p->done);
+      vTaskDelete(nullptr);
+}
+
+static void test_log_ring()
+{
+      Serial.printf("Testing stdpsram::log_ring:\n");
+      std::atomic<int> accepted(0);
+      std::size_t lines = log_lines;
+      {
+            stdpsram::log_ring ring(256);
+            SemaphoreHandle_t done = xSemaphoreCreateCounting(2, 0);
+            log_producer producers[2] = {{&ring, 0, &accepted, done}, {&ring, 1, &accepted, done}};
+            for (int core = 0; core < 2; core++)
+                  xTaskCreatePinnedToCore(log_producer_task, "log_producer", 4096, &producers[core], 1, nullptr, core);
+            xSemaphoreTake(done, portMAX_DELAY);
+            xSemaphoreTake(done, portMAX_DELAY);
+            vSemaphoreDelete(done);
+            check(accepted == 128 && ring.dropped() == 0, "records from two cores accepted");
+      }
+      check(log_lines - lines == 128, "every accepted record written once");
+
+      // Destroying a ring right after a burst stops the flusher while it may be holding the drain lock
+      lines = log_lines;
+      std::size_t pushed = 0;
+      for (int round = 0; round < 8; round++)
+      {
+            stdpsram::log_ring ring(64);
+            for (int i = 0; i < 40; i++)
+                  pushed += ring.push(STDPSRAM_FMT("round {} record {}"), round, i);
+      }
+      check(pushed == 8 * 40 && log_lines - lines == pushed, "rings drained completely when shut down during a flush");
+
+      // A spec that does not fit its argument only shows up when the record is rendered
+      lines = log_lines;
+      std::size_t bad = log_bad_formats;
+      {
+            stdpsram::log_ring ring(64);
+            ring.push(STDPSRAM_FMT("bad {:.2f}"), 5);
+            ring.push(STDPSRAM_FMT("good {:.2f}"), 5.0);
+            ring.flush();
+            ring.push(STDPSRAM_FMT("after {}"), 1);
+      }
+      check(log_bad_formats - bad == 1 && log_lines - lines == 3, "bad format reported, later records still written");
+}
+
+//_____________________________________________________________________________________________________________________
+// JSON: write a multi-MB document with json_writer and with snprintf ("plain"), then parse it back
+static double json_sample(std::size_t i) { return double(i) * 0.001 + 1.0 / double(i + 3); }
+
+struct json_checker : stdpsram::json_handler
+{
+      std::size_t numbers = 0;
+      std::size_t mismatches = 0;
+
+      void on_number(double v)
+      {
+            mismatches += v != json_sample(numbers++);
+      }
+      void on_integer(int64_t v) { on_number(double(v)); }
+};
+
+static void benchmark_json()
+{
+      Serial.printf("Benchmarking stdpsram::json_writer / json_parse:\n");
+      const std::size_t samples = 128 * 1024;
+
+      stdpsram::string plain_doc;
+      plain_doc.reserve(samples * 24);
+      unsigned long plain = time_us([&]
+                                    {
+            char number[32];
+            plain_doc += '[';
+            for (std::size_t i = 0; i < samples; i++)
+            {
+                  int n = snprintf(number, sizeof(number), i ? ",%.17g" : "%.17g", json_sample(i));
+                  plain_doc.append(number, std::size_t(n));
+            }
+            plain_doc += ']'; });
+
+      stdpsram::string doc;
+      unsigned long fast = time_us([&]
+                                   { stdpsram::json_to(doc, [&](stdpsram::json_writer &w)
+                                                       {
+            w.begin_array();
+            for (std::size_t i = 0; i < samples; i++)
+                  w.value(json_sample(i));
+            w.end_array(); }); });
+      report("write doubles", doc.size(), plain, fast);
+      Serial.printf("  document: %u bytes (snprintf %%.17g: %u bytes)\n", unsigned(doc.size()), unsigned(plain_doc.size()));
+
+      json_checker checker;
+      unsigned long parse = time_us([&]
+                                    { stdpsram::json_parse(doc, checker); });
+      Serial.printf("  %-28s %8.1f MB/s\n", "parse", double(doc.size()) / parse);
+      check(checker.numbers == samples && checker.mismatches == 0, "doubles read back exactly");
+}
+
+//_____________________________________________________________________________________________________________________
+// Tiled stdpsram::image against a row-major frame in a PSRAM vector ("plain"): rotation and a 5x5 box blur
+static void benchmark_image()
+{
+      Serial.printf("Benchmarking stdpsram::image against a row-major frame:\n");
+      const std::size_t w = 640, h = 480;
+      const unsigned radius = 2;
+
+      stdpsram::vector<uint16_t> linear(w * h), linear_turned(w * h);
+      for (std::size_t i = 0; i < w * h; i++)
+            linear[i] = uint16_t(i * 2654435761u >> 16);
+      stdpsram::image<uint16_t> frame(w, h);
+      frame.from_linear(linear.data());
+
+      unsigned long plain = time_us([&]
+                                    {
+            for (std::size_t y = 0; y < h; y++)
+                  for (std::size_t x = 0; x < w; x++)
+                        linear_turned[x * h + (h - 1 - y)] = linear[y * w + x]; });
+      stdpsram::image<uint16_t> turned;
+      unsigned long fast = time_us([&]
+                                   { turned = stdpsram::rotate90(frame); });
+      report("rotate90 (RGB565)", w * h * sizeof(uint16_t), plain, fast);
+      stdpsram::vector<uint16_t> check_turned(w * h);
+      turned.to_linear(check_turned.data());
+      check(check_turned == linear_turned, "rotate90 matches the row-major rotation");
+
+      // Grayscale: separable running sums, the vertical pass walking down columns of the row-major frame
+      stdpsram::vector<uint8_t> gray(w * h), gray_blurred(w * h);
+      for (std::size_t i = 0; i < w * h; i++)
+            gray[i] = uint8_t(linear[i]);
+      const std::ptrdiff_t span = 2 * radius + 1, area = span * span;
+      stdpsram::vector<uint16_t> row_sums(w * h);
+      plain = time_us([&]
+                      {
+            for (std::size_t y = 0; y < h; y++)
+            {
+                  const uint8_t *in = gray.data() + y * w;
+                  for (std::size_t x = 0; x < w; x++)
+                  {
+                        uint16_t sum = 0;
+                        for (std::ptrdiff_t i = -std::ptrdiff_t(radius); i <= std::ptrdiff_t(radius); i++)
+                              sum += in[std::min(std::max(std::ptrdiff_t(x) + i, std::ptrdiff_t(0)), std::ptrdiff_t(w - 1))];
+                        row_sums[y * w + x] = sum;
+                  }
+            }
+            for (std::size_t x = 0; x < w; x++)
+            {
+                  for (std::size_t y = 0; y < h; y++)
+                  {
+                        uint32_t sum = 0;
+                        for (std::ptrdiff_t j = -std::ptrdiff_t(radius); j <= std::ptrdiff_t(radius); j++)
+                              sum += row_sums[std::min(std::max(std::ptrdiff_t(y) + j, std::ptrdiff_t(0)), std::ptrdiff_t(h - 1)) * w + x];
+                        gray_blurred[y * w + x] = uint8_t((sum + area / 2) / area);
+                  }
+            } });
+      stdpsram::image<uint8_t> gray_frame(w, h), blurred;
+      gray_frame.from_linear(gray.data());
+      fast = time_us([&]
+                     { blurred = stdpsram::box_blur(gray_frame, radius); });
+      report("box_blur 5x5 (gray)", w * h, plain, fast);
+      stdpsram::vector<uint8_t> check_blurred(w * h);
+      blurred.to_linear(check_blurred.data());
+      check(check_blurred == gray_blurred, "box_blur matches the row-major blur");
+
+      fast = time_us([&]
+                     { turned = stdpsram::box_blur_rgb565(frame, radius); });
+      Serial.printf("  %-28s %8.1f MB/s\n", "box_blur_rgb565 5x5", double(w * h * sizeof(uint16_t)) / fast);
+}
+
+//_____________________________________________________________________________________________________________________
+// gemm / gemv on matrices too large for internal SRAM, against plain loops over the same PSRAM matrices
+static void report_flops(const char *what, double flops, unsigned long plain_us, unsigned long fast_us)
+{
+      Serial.printf("  %-28s plain: %6.3f GFLOP/s  stdpsram: %6.3f GFLOP/s  (x%.2f)\n", what,
+                    flops / plain_us / 1000.0, flops / fast_us / 1000.0, double(plain_us) / fast_us);
+}
+
+static void benchmark_matrix()
+{
+      const std::size_t n = 256; // three 256 KB float matrices: PSRAM only
+      Serial.printf("Benchmarking stdpsram::gemm / gemv at %ux%u:\n", unsigned(n), unsigned(n));
+      stdpsram::matrix<float> a(n, n), b(n, n), c(n, n), expected(n, n);
+      for (std::size_t r = 0; r < n; r++)
+            for (std::size_t k = 0; k < n; k++)
+            {
+                  a(r, k) = float((r * 7 + k * 3) % 17) - 8.0f;
+                  b(r, k) = float((r * 5 + k * 11) % 13) - 6.0f;
+            }
+
+      // i-k-j order: unit stride through rows of b and the result, no staging
+      unsigned long plain = time_us([&]
+                                    {
+            for (std::size_t i = 0; i < n; i++)
+            {
+                  float *out = expected.row(i);
+                  for (std::size_t k = 0; k < n; k++)
+                  {
+                        float aik = a(i, k);
+                        const float *row = b.row(k);
+                        for (std::size_t j = 0; j < n; j++)
+                              out[j] += aik * row[j];
+                  }
+            } });
+      unsigned long fast = time_us([&]
+                                   { stdpsram::gemm(a, b, c); });
+      report_flops("gemm", 2.0 * n * n * n, plain, fast);
+      bool same = true;
+      for (std::size_t r = 0; r < n; r++)
+            for (std::size_t k = 0; k < n; k++)
+                  same = same && c(r, k) == expected(r, k); // small integers: exact in float
+      check(same, "gemm matches the plain product");
+
+      stdpsram::vector<float> x(n, 1.5f), y(n), y_plain(n);
+      plain = time_us([&]
+                      {
+            for (std::size_t r = 0; r < n; r++)
+            {
+                  float total = 0.0f;
+                  for (std::size_t k = 0; k < n; k++)
+                        total += a(r, k) * x[k];
+                  y_plain[r] = total;
+            } });
+      fast = time_us([&]
+                     { stdpsram::gemv(a, x, y); });
+      report_flops("gemv", 2.0 * n * n, plain, fast);
+      check(y == y_plain, "gemv matches the plain product");
+}
+
+//_____________________________________________________________________________________________________________________
+// COO -> CSR conversion (duplicates, unordered input, a row long enough for the std::stable_sort path) and the
+// checks of the ready-made-arrays constructor
+static void test_sparse()
+{
+      Serial.printf("Testing stdpsram::csr_matrix:\n");
+      const std::size_t n = 200;
+      stdpsram::coo_matrix<float> coo(n, n);
+      stdpsram::vector<float> dense(n * n, 0.0f);
+      unsigned seed = 12345;
+      for (int i = 0; i < 2000; i++)
+      {
+            seed = seed * 1103515245u + 12345u;
+            std::size_t r = (seed >> 8) % n;
+            seed = seed * 1103515245u + 12345u;
+            std::size_t c = (seed >> 8) % n;
+            float v = float(int(seed >> 24) % 7 - 3);
+            coo.add(r, c, v);
+            dense[r * n + c] += v;
+      }
+      for (std::size_t c = n; c-- > 0;) // row 7 gets every column, in reverse, plus duplicates
+      {
+            coo.add(7, c, 1.0f);
+            dense[7 * n + c] += 1.0f;
+      }
+
+      stdpsram::vector<float> x(n), y_coo, y_csr;
+      for (std::size_t i = 0; i < n; i++)
+            x[i] = float(i % 5) - 2.0f;
+      y_coo.resize(n);
+      coo.spmv(x.data(), y_coo.data());
+      stdpsram::csr_matrix<float> a(std::move(coo));
+      a.spmv(x, y_csr);
+      check(y_csr == y_coo, "spmv matches the COO product");
+
+      bool same = true, sorted = true;
+      for (std::size_t r = 0; r < n; r++)
+      {
+            for (std::size_t c = 0; c < n; c++)
+                  same = same && a.get(r, c) == dense[r * n + c];
+            for (std::size_t k = a.row_offsets()[r] + 1; k < a.row_offsets()[r + 1]; k++)
+                  sorted = sorted && a.col_indices()[k - 1] < a.col_indices()[k];
+      }
+      check(same, "csr_matrix holds the summed duplicates");
+      check(sorted, "csr_matrix rows sorted by column (short and long rows)");
+
+      // Duplicates are summed in the order they were added. Few columns and values of very different magnitude make
+      // float sums order-dependent; a long first row also takes the stable_sort path.
+      stdpsram::coo_matrix<float> dup(300, 4);
+      stdpsram::vector<float> in_order(300 * 4, 0.0f);
+      for (int i = 0; i < 3000; i++)
+      {
+            seed = seed * 1103515245u + 12345u;
+            std::size_t r = i < 200 ? 0 : (seed >> 8) % 300;
+            std::size_t c = (seed >> 20) % 4;
+            float v = float(int(seed >> 8) % 2001 - 1000) * (seed & 0x100 ? 1e5f : 1e-3f);
+            dup.add(r, c, v);
+            in_order[r * 4 + c] += v;
+      }
+      stdpsram::csr_matrix<float> summed(std::move(dup));
+      same = true;
+      for (std::size_t r = 0; r < 300; r++)
+            for (std::size_t c = 0; c < 4; c++)
+                  same = same && summed.get(r, c) == in_order[r * 4 + c];
+      check(same, "duplicates summed in insertion order");
+
+      // row_ptr and col_idx of a 2x3 matrix (all values 1); true if the constructor rejects them
+      auto rejects = [](std::initializer_list<uint32_t> rp, std::initializer_list<uint32_t> ci)
+      {
+            try
+            {
+                  stdpsram::csr_matrix<float> m(2, 3, stdpsram::vector<uint32_t>(rp), stdpsram::vector<uint32_t>(ci),
+                                                stdpsram::vector<float>(ci.size(), 1.0f));
+                  return false;
+            }
+            catch (const std::invalid_argument &)
+            {
+                  return true;
+            }
+      };
+      check(!rejects({0, 2, 3}, {0, 2, 1}), "valid CSR arrays accepted");
+      check(rejects({1, 2, 3}, {0, 2, 1}), "row_ptr[0] != 0 rejected");
+      check(rejects({0, 3, 2}, {0, 1}), "decreasing row_ptr rejected");
+      check(rejects({0, 2, 3}, {0, 3, 1}), "column index >= cols rejected");
+      check(rejects({0, 2, 3}, {2, 0, 1}), "unsorted row rejected");
+}
+
+//_____________________________________________________________________________________________________________________
+// relocatable::arena: save / load (and map on host) round trip, and images whose header must be rejected
+#ifndef ARENA_TEST_PATH
+#define ARENA_TEST_PATH "/littlefs/stdpsram_arena.img" // needs a writable filesystem, e.g. LittleFS mounted there
+#endif
+static const char *arena_path = ARENA_TEST_PATH;
+
+// True if opening the image fails header validation (not merely a short read further on)
+template <typename Open>
+static bool arena_invalid(Open open)
+{
+      try
+      {
+            open(arena_path);
+      }
+      catch (const std::runtime_error &e)
+      {
+            return std::strstr(e.what(), "not a valid arena image") != nullptr;
+      }
+      return false;
+}
+
+static bool arena_rejected(const stdpsram::relocatable::detail::arena_header &h)
+{
+      FILE *f = std::fopen(arena_path, "wb");
+      std::fwrite(&h, sizeof(h), 1, f);
+      for (std::size_t i = 0; i < h.capacity; i++) // more data than the image holds: a bad header must not over-read
+            std::fputc(0xAA, f);
+      std::fclose(f);
+      bool rejected = arena_invalid(stdpsram::relocatable::arena::load);
+#if !defined(ARDUINO)
+      rejected = rejected && arena_invalid(stdpsram::relocatable::arena::map);
+#endif
+      return rejected;
+}
+
+static void test_relocatable()
+{
+      Serial.printf("Testing stdpsram::relocatable::arena:\n");
+      typedef stdpsram::relocatable::map<uint32_t, float> table_t;
+      FILE *probe = std::fopen(arena_path, "wb");
+      if (!probe)
+      {
+            Serial.printf("  SKIP: cannot write %s\n", arena_path);
+            return;
+      }
+      std::fclose(probe);
+
+      stdpsram::relocatable::detail::arena_header header;
+      {
+            stdpsram::relocatable::arena a = stdpsram::relocatable::arena::create(64 * 1024);
+            table_t *table = a.construct<table_t>(a);
+            for (uint32_t k = 0; k < 500; k++)
+                  (*table)[k * 7 % 500] = float(k * 7 % 500) * 0.5f;
+            a.set_root(table);
+            a.save(arena_path);
+            header = *a.image();
+      }
+
+      auto intact = [](const stdpsram::relocatable::arena &a)
+      {
+            const table_t *t = a.root<table_t>();
+            bool ok = t && t->size() == 500;
+            for (uint32_t k = 0; ok && k < 500; k++)
+                  ok = t->find(k) != t->end() && t->find(k)->second == float(k) * 0.5f;
+            return ok;
+      };
+      stdpsram::relocatable::arena loaded = stdpsram::relocatable::arena::load(arena_path);
+      check(intact(loaded), "loaded image finds every key");
+#if !defined(ARDUINO)
+      stdpsram::relocatable::arena mapped = stdpsram::relocatable::arena::map(arena_path);
+      check(intact(mapped), "mapped image finds every key");
+#endif
+
+      stdpsram::relocatable::detail::arena_header bad = header;
+      bad.used = 8; // valid magic, used part smaller than the header
+      check(arena_rejected(bad), "image with used below the header size rejected");
+      bad = header;
+      bad.used = bad.capacity + 8;
+      check(arena_rejected(bad), "image with used beyond its capacity rejected");
+      bad = header;
+      bad.root = bad.used;
+      check(arena_rejected(bad), "image with root outside the used part rejected");
+      std::remove(arena_path);
+}
+
+//_____________________________________________________________________________________________________________________
+// timeseries: lossless round trip through the compressed blocks, and downsample against buckets built from the
+// raw samples (including the full int64 range, where from is INT64_MIN)
+static bool buckets_match(const stdpsram::timeseries &ts, const stdpsram::vector<stdpsram::timeseries::sample> &raw,
+                          int64_t from, int64_t to, int64_t width)
+{
+      stdpsram::vector<stdpsram::timeseries::bucket> want, got;
+      double sum = 0;
+      for (const stdpsram::timeseries::sample &s : raw)
+      {
+            if (s.time < from || s.time > to)
+                  continue;
+            int64_t start = int64_t(uint64_t(from) + (uint64_t(s.time) - uint64_t(from)) / uint64_t(width) * uint64_t(width));
+            if (want.empty() || want.back().start != start)
+            {
+                  if (!want.empty())
+                        want.back().mean = float(sum / double(want.back().count));
+                  want.push_back(stdpsram::timeseries::bucket{start, s.value, s.value, 0.0f, 0});
+                  sum = 0;
+            }
+            stdpsram::timeseries::bucket &b = want.back();
+            b.min = s.value < b.min ? s.value : b.min;
+            b.max = s.value > b.max ? s.value : b.max;
+            b.count++;
+            sum += s.value;
+      }
+      if (!want.empty())
+            want.back().mean = float(sum / double(want.back().count));
+
+      ts.downsample(from, to, width, [&](const stdpsram::timeseries::bucket &b)
+                    { got.push_back(b); });
+      bool same = got.size() == want.size();
+      for (std::size_t i = 0; same && i < got.size(); i++)
+            same = got[i].start == want[i].start && got[i].count == want[i].count && got[i].min == want[i].min &&
+                   got[i].max == want[i].max && std::fabs(got[i].mean - want[i].mean) <= 1e-4f * (1.0f + std::fabs(want[i].mean));
+      return same;
+}
+
+static void test_timeseries()
+{
+      Serial.printf("Testing stdpsram::timeseries:\n");
+      stdpsram::timeseries ts(64 * 1024, 256);
+      stdpsram::vector<stdpsram::timeseries::sample> raw;
+      int64_t t = -500000; // crosses zero
+      for (int i = 0; i < 5000; i++)
+      {
+            t += 100 + (i % 7 == 0 ? 37 : 0) + (i % 500 == 0 ? 20000 : 0);
+            float v = float(i % 50) * 0.25f + (i % 13 == 0 ? 100.0f : 0.0f);
+            ts.append(t, v);
+            raw.push_back(stdpsram::timeseries::sample{t, v});
+      }
+
+      std::size_t n = 0;
+      bool same = true;
+      for (const stdpsram::timeseries::sample &s : ts.range())
+      {
+            same = same && n < raw.size() && s.time == raw[n].time && s.value == raw[n].value;
+            n++;
+      }
+      check(same && n == raw.size() && ts.blocks() > 1, "range() returns every sample unchanged");
+
+      check(buckets_match(ts, raw, -300000, 250000, 1000), "downsample over a sub-range");
+      check(buckets_match(ts, raw, -300000, 250000, 60000), "downsample with blocks inside one bucket");
+      check(buckets_match(ts, raw, std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max(), 60000),
+            "downsample over the full int64 range");
+}
+
+//_____________________________________________________________________________________________________________________
+// paged_vector: contents survive eviction through two resident pages; set / pop_back outside the vector throw
+#ifndef PAGED_TEST_PATH
+#define PAGED_TEST_PATH "/littlefs/stdpsram_swap.bin" // needs a writable filesystem, e.g. LittleFS mounted there
+#endif
+
+template <typename F>
+static bool throws_out_of_range(F f)
+{
+      try
+      {
+            f();
+      }
+      catch (const std::out_of_range &)
+      {
+            return true;
+      }
+      return false;
+}
+
+static void test_paged_vector()
+{
+      Serial.printf("Testing stdpsram::paged_vector:\n");
+      try
+      {
+            stdpsram::paged_vector<uint32_t> v(PAGED_TEST_PATH, 2);
+            for (uint32_t i = 0; i < 5000; i++)
+                  v.push_back(i * 3);
+            v.set(10, 7);
+            bool same = v.size() == 5000;
+            for (uint32_t i = 0; same && i < 5000; i++)
+                  same = v[i] == (i == 10 ? 7 : i * 3);
+            check(same, "elements survive eviction through two resident pages");
+            check(throws_out_of_range([&]
+                                      { v.set(5000, 1); }),
+                  "set past the end throws");
+            while (!v.empty())
+                  v.pop_back();
+            check(throws_out_of_range([&]
+                                      { v.pop_back(); }),
+                  "pop_back on an empty vector throws");
+      }
+      catch (const std::runtime_error &)
+      {
+            Serial.printf("  SKIP: cannot open %s\n", PAGED_TEST_PATH);
+      }
+}
+
+//_____________________________________________________________________________________________________________________
+// tiered_heap::rebalance: a cold block ranked ahead of a hot one (a tiny block touched once has a higher accesses
+// per byte than a hot 1 KB block) must not stop the hot block from reaching SRAM
+static void test_tiered_heap()
+{
+      Serial.printf("Testing stdpsram::tiered_heap:\n");
+      stdpsram::tiered_heap tiers(8 * 1024, 2);
+      stdpsram::tiered_heap::handle cold_tiny = tiers.allocate(4);
+      stdpsram::tiered_heap::handle cold_large = tiers.allocate(4 * 1024);
+      stdpsram::tiered_heap::handle hot = tiers.allocate(1024);
+      tiers.access(cold_tiny);  // 1 access / 4 bytes: ranks first, below the threshold
+      tiers.access(cold_large); // fits the budget, below the threshold
+      for (int i = 0; i < 100; i++)
+            tiers.access(hot); // 100 accesses / 1 KB
+      tiers.rebalance();
+      check(tiers.in_sram(hot), "hot block promoted past higher-ranked cold blocks");
+      check(!tiers.in_sram(cold_tiny) && !tiers.in_sram(cold_large), "cold blocks stay in PSRAM");
+      check(tiers.sram_used() <= tiers.sram_budget(), "SRAM use within the budget");
+}
+
 //_____________________________________________________________________________________________________________________
 void setup()
 {
@@ -80,6 +998,37 @@ void setup()
       Serial.println(std::get<2>(psramTuple).c_str());
       //-----------------------------------------
       PRINT_FREE_HEAP_AND_PSRAM
+      test_compacting_heap();
+      //-----------------------------------------
+      test_log_ring();
+      //-----------------------------------------
+      benchmark_simd();
+      //-----------------------------------------
+      benchmark_memory();
+      //-----------------------------------------
+      benchmark_sort();
+      //-----------------------------------------
+      benchmark_parallel();
+      //-----------------------------------------
+      benchmark_format();
+      //-----------------------------------------
+      benchmark_json();
+      //-----------------------------------------
+      benchmark_image();
+      //-----------------------------------------
+      benchmark_matrix();
+      //-----------------------------------------
+      test_sparse();
+      //-----------------------------------------
+      test_relocatable();
+      //-----------------------------------------
+      test_timeseries();
+      //-----------------------------------------
+      test_paged_vector();
+      //-----------------------------------------
+      test_tiered_heap();
+      //-----------------------------------------
+      PRINT_FREE_HEAP_AND_PSRAM
 }
 
 //_____________________________________________________________________________________________________________________